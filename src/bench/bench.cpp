@@ -0,0 +1,957 @@
+/**
+ * @file bench.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Microbenchmarks for the storage primitives.
+ *
+ * Usage: deltadb_bench [filter]
+ *
+ * Prints one CSV line per benchmark: name, ops, ns/op, bytes/s and heap allocations per op.
+ * All input is generated from a fixed seed so runs are comparable.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "../db/block.hpp"
+#include "../db/block_codec.hpp"
+#include "../db/block_lz.hpp"
+#include "../db/block_pax.hpp"
+#include "../db/block_pool.hpp"
+#include "../db/metrics.hpp"
+#include "../db/table.hpp"
+#include "../db/table_col.hpp"
+#include "../db/table_row.hpp"
+#include "../db/typed_table.hpp"
+#include "../internal/arena.hpp"
+#include "../internal/bitstream.hpp"
+
+/** Heap allocations since start */
+static std::atomic<uint64_t> g_allocs(0);
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+// kept out of line, gcc flags free() on memory from the inlined operator new otherwise
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace deltadb {
+    namespace {
+        /** Benchmark name filter */
+        const char* g_filter = nullptr;
+
+        /** Keeps results alive */
+        volatile uint64_t g_sink = 0;
+
+        /** xorshift64, fixed seed for reproducible input */
+        struct rng {
+            uint64_t m_state;
+
+            rng() : m_state(0x9E3779B97F4A7C15ull) {}
+
+            uint64_t next() {
+                m_state ^= m_state << 13;
+                m_state ^= m_state >> 7;
+                m_state ^= m_state << 17;
+                return m_state;
+            }
+        };
+
+        /**
+         * Run a benchmark.
+         *
+         * fn(ops) has to execute ops operations, bytes is the payload processed per op.
+         */
+        template <typename F>
+        void bench(const std::string& name, uint64_t ops, double bytes, F&& fn) {
+            if (g_filter && name.find(g_filter) == std::string::npos)
+                return;
+
+            // warm up caches and pools
+            fn(ops / 10 + 1);
+
+            const uint64_t allocs = g_allocs.load();
+            auto start = std::chrono::steady_clock::now();
+            fn(ops);
+            auto end = std::chrono::steady_clock::now();
+            const uint64_t allocs_done = g_allocs.load() - allocs;
+
+            const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+            printf("%s,%lu,%.3f,%.0f,%.3f\n",
+                name.c_str(), ops, ns / ops, bytes * ops / (ns / 1e9), (double)allocs_done / ops
+            );
+            fflush(stdout);
+        }
+
+        /** Create a column */
+        col* make_col(uint8_t type, uint32_t idx) {
+            col* c = new col();
+            c->m_data = type;
+            snprintf(c->m_name, sizeof(c->m_name), "c%u", idx);
+            c->m_comment[0] = '\0';
+            return c;
+        }
+
+        /** Fill value with random data of type */
+        row_value make_value(uint8_t type, rng& r) {
+            static const char* strings[] = {"ok", "pending", "failed", "eu-central-1", "us-west-2"};
+            static char bytes[256] = {0};
+
+            row_value v;
+            v.m_type = type;
+            v.m_size = 0;
+            v.m_value.v_u64 = r.next();
+
+            switch (type) {
+            case col_bool:
+                v.m_value.v_bool = v.m_value.v_u64 & 1;
+                break;
+            case col_float:
+                v.m_value.v_float = (v.m_value.v_u64 % 100000) / 100.0f;
+                break;
+            case col_double:
+                v.m_value.v_double = (v.m_value.v_u64 % 100000) / 100.0;
+                break;
+            case col_string:
+                v.m_value.v_bytes = const_cast<char*>(strings[v.m_value.v_u64 % 5]);
+                break;
+            case col_bytes:
+                v.m_size = 64;
+                v.m_value.v_bytes = bytes;
+                break;
+            }
+
+            return v;
+        }
+
+        /** Type names for output */
+        const char* type_name(uint8_t t) {
+            static const char* names[] = {
+                "int8", "int16", "int32", "int64", "bool", "float", "double", "string", "bytes"
+            };
+
+            return names[t];
+        }
+
+        void bench_bitstream() {
+            const uint32_t n = 1 << 16;
+            std::vector<uint32_t> values(n);
+            rng r;
+
+            for (auto &v : values) {
+                v = r.next();
+            }
+
+            const uint8_t widths[] = {1, 3, 7, 8, 13, 16, 21, 31, 32};
+            for (auto w : widths) {
+                bitstream out(n * 4 + 8);
+
+                bench("bitstream/write/" + std::to_string(w), 1 << 24, w / 8.0, [&](uint64_t ops) {
+                    for (uint64_t i = 0; i < ops; ++i) {
+                        if ((i & (n-1)) == 0)
+                            out.seek(0);
+
+                        out.write(w, values[i & (n-1)]);
+                    }
+                });
+
+                for (uint32_t i = 0; i < n; ++i) {
+                    out.write(w, values[i]);
+                }
+
+                bench("bitstream/read/" + std::to_string(w), 1 << 24, w / 8.0, [&](uint64_t ops) {
+                    bitstream in(out.buffer(), n * 4 + 8);
+                    uint64_t sum = 0;
+
+                    for (uint64_t i = 0; i < ops; ++i) {
+                        if ((i & (n-1)) == 0)
+                            in.seek(0);
+
+                        sum += in.read(w);
+                    }
+
+                    g_sink += sum;
+                });
+            }
+
+            // aligned vs unaligned byte I/O
+            const uint32_t chunk = 64;
+            std::vector<char> src(chunk, 'x');
+            std::vector<char> dst(chunk);
+
+            for (uint32_t offset : {0, 3}) {
+                const std::string suffix = offset ? "unaligned" : "aligned";
+                const uint32_t count = n / chunk;
+                bitstream out(n + 16);
+
+                bench("bitstream/write_bytes/" + suffix, 1 << 18, chunk, [&](uint64_t ops) {
+                    for (uint64_t i = 0; i < ops; ++i) {
+                        if (i % count == 0) {
+                            out.seek(0);
+                            if (offset)
+                                out.write(offset, 0);
+                        }
+
+                        out.write_bytes(src.data(), chunk);
+                    }
+                });
+
+                bench("bitstream/read_bytes/" + suffix, 1 << 18, chunk, [&](uint64_t ops) {
+                    bitstream in(out.buffer(), n + 16);
+
+                    for (uint64_t i = 0; i < ops; ++i) {
+                        if (i % count == 0)
+                            in.seek(offset);
+
+                        in.read_bytes(chunk, dst.data());
+                    }
+
+                    g_sink += dst[0];
+                });
+            }
+        }
+
+        /**
+         * Encode and decode rows of the given schema.
+         *
+         * Rows set the fields in mask, or a single random one if mask is empty. Flags are
+         * the table_flags the rows are coded with.
+         */
+        void bench_rows(const std::string& name, std::vector<col*>& cols, const bitfield& mask, uint8_t flags = 0) {
+            const uint32_t n = 1024;
+            std::vector<row> rows(n);
+            rng r;
+
+            for (auto &rw : rows) {
+                const uint32_t pick = r.next() % cols.size();
+
+                for (uint32_t i = 0; i < cols.size(); ++i) {
+                    if (mask.any() ? mask.at(i) : i == pick)
+                        rw.set(i, make_value(cols[i]->type(), r));
+                }
+            }
+
+            bitfield all;
+            for (uint32_t i = 0; i < cols.size(); ++i) {
+                all.set(i);
+            }
+
+            uint64_t size = 0;
+            for (auto &rw : rows) {
+                size += rw.size();
+            }
+
+            // dictionary encoded strings are smaller, take the size of an encoded pass
+            block_codec codec(cols, flags);
+            std::vector<char> buffer(size + codec.overhead(mask.any() ? mask : all) * n + 16);
+            {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size(), bitstream::mode::io_writer);
+                for (auto &rw : rows) {
+                    row_write(b, &rw, &codec);
+                }
+
+                size = b.position() / 8;
+            }
+
+            bench("row_write/" + name, 1 << 20, (double)size / n, [&](uint64_t ops) {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size(), bitstream::mode::io_writer);
+
+                for (uint64_t i = 0; i < ops; ++i) {
+                    if ((i % n) == 0) {
+                        b.seek(0);
+                        codec.reset();
+                    }
+
+                    row_write(b, &rows[i % n], &codec);
+                }
+            });
+
+            arena a;
+            bench("row_read/" + name, 1 << 20, (double)size / n, [&](uint64_t ops) {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size());
+                uint64_t sum = 0;
+
+                for (uint64_t i = 0; i < ops; ++i) {
+                    if ((i % n) == 0) {
+                        b.seek(0);
+                        a.reset();
+                        codec.reset();
+                    }
+
+                    sum += row_read(cols, b, &a, nullptr, &codec)->m_fields.word(0);
+                }
+
+                g_sink += sum;
+            });
+
+            row_plan plan(cols);
+            bench("row_read_plan/" + name, 1 << 20, (double)size / n, [&](uint64_t ops) {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size());
+                uint64_t sum = 0;
+
+                for (uint64_t i = 0; i < ops; ++i) {
+                    if ((i % n) == 0) {
+                        b.seek(0);
+                        a.reset();
+                        codec.reset();
+                    }
+
+                    sum += row_read(plan, b, &a, &codec)->m_fields.word(0);
+                }
+
+                g_sink += sum;
+            });
+
+            if (cols.size() > 64)
+                return;
+
+            compact_layout layout(cols);
+            bench("compact_row_read/" + name, 1 << 20, (double)size / n, [&](uint64_t ops) {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size());
+                uint64_t sum = 0;
+
+                for (uint64_t i = 0; i < ops; ++i) {
+                    if ((i % n) == 0) {
+                        b.seek(0);
+                        a.reset();
+                        codec.reset();
+                    }
+
+                    sum += compact_row_read(cols, layout, b, &a, &codec)->m_fields;
+                }
+
+                g_sink += sum;
+            });
+        }
+
+        void bench_row_codec() {
+            // one column of each type
+            for (uint8_t t = col_int8; t <= col_bytes; ++t) {
+                std::vector<col*> cols = {make_col(t, 0)};
+                bench_rows(type_name(t), cols, bitfield(1));
+
+                for (auto c : cols) {
+                    delete c;
+                }
+            }
+
+            // low cardinality strings with a block dictionary
+            {
+                std::vector<col*> cols = {make_col(col_string | col_encoded, 0)};
+                bench_rows("dict", cols, bitfield(1));
+                delete cols[0];
+            }
+
+            // XOR encoded floats and doubles
+            for (uint8_t t : {col_float, col_double}) {
+                std::vector<col*> cols = {make_col(t | col_encoded, 0)};
+                bench_rows(std::string("x") + type_name(t), cols, bitfield(1));
+                delete cols[0];
+            }
+
+            // 4 int32 columns, the same or a different field per row, with plain and compact masks
+            {
+                std::vector<col*> cols;
+                for (uint32_t i = 0; i < 4; ++i) {
+                    cols.push_back(make_col(col_int32, i));
+                }
+
+                bench_rows("narrow", cols, bitfield(1));
+                bench_rows("narrow/compact", cols, bitfield(1), table_compact_masks);
+                bench_rows("narrow/mixed", cols, bitfield());
+                bench_rows("narrow/mixed/compact", cols, bitfield(), table_compact_masks);
+
+                for (auto c : cols) {
+                    delete c;
+                }
+            }
+
+            // 64 int32 columns, sparse and dense masks
+            std::vector<col*> cols;
+            for (uint32_t i = 0; i < 64; ++i) {
+                cols.push_back(make_col(col_int32, i));
+            }
+
+            bench_rows("sparse", cols, bitfield(1ull << 17));
+            bench_rows("quarter", cols, bitfield(0x1111111111111111ull));
+            bench_rows("dense", cols, bitfield(~0ull));
+            bench_rows("dense/compact", cols, bitfield(~0ull), table_compact_masks);
+
+            for (auto c : cols) {
+                delete c;
+            }
+
+            // 256 int32 columns, a few fields per row and all of them
+            cols.clear();
+            bitfield few, every;
+            for (uint32_t i = 0; i < 256; ++i) {
+                cols.push_back(make_col(col_int32, i));
+                every.set(i);
+                if (i % 61 == 3)
+                    few.set(i);
+            }
+
+            bench_rows("wide/sparse", cols, few);
+            bench_rows("wide/sparse/compact", cols, few, table_compact_masks);
+            bench_rows("wide/dense", cols, every);
+            bench_rows("wide/dense/compact", cols, every, table_compact_masks);
+
+            for (auto c : cols) {
+                delete c;
+            }
+        }
+
+        /** Rows of a fixed schema through the dynamic and the typed codec */
+        void bench_typed() {
+            typedef typed_row<
+                typed_col<col_int32>,
+                typed_col<col_int64 | col_unsigned>,
+                typed_col<col_double | col_encoded>,
+                typed_col<col_string | col_encoded>,
+                typed_col<col_bool>
+            > typed;
+
+            std::vector<col*> cols = {
+                make_col(col_int32, 0), make_col(col_int64 | col_unsigned, 1), make_col(col_double | col_encoded, 2),
+                make_col(col_string | col_encoded, 3), make_col(col_bool, 4)
+            };
+
+            const uint32_t n = 1024;
+            const uint8_t flags = table_compact_masks;
+            std::vector<row> rows(n);
+            std::vector<typed> trows(n);
+            rng r;
+
+            for (uint32_t i = 0; i < n; ++i) {
+                for (uint32_t j = 0; j < cols.size(); ++j) {
+                    rows[i].set(j, make_value(cols[j]->type(), r));
+                }
+
+                typed_row_convert(rows[i], trows[i]);
+            }
+
+            block_codec codec(cols, flags);
+            std::vector<char> buffer(n * 64);
+            std::vector<char> check(n * 64);
+            uint64_t size;
+            {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size(), bitstream::mode::io_writer);
+                bitstream c((bitstream::word_t*)check.data(), check.size(), bitstream::mode::io_writer);
+                block_codec tcodec(cols, flags);
+
+                for (uint32_t i = 0; i < n; ++i) {
+                    row_write(b, &rows[i], &codec);
+                    typed_row_write(c, trows[i], tcodec);
+                }
+
+                size = b.position() / 8;
+                if (c.position() != b.position() || memcmp(buffer.data(), check.data(), size) != 0)
+                    fprintf(stderr, "typed_row_write differs from row_write\n");
+            }
+
+            bench("row_write/mixed", 1 << 20, (double)size / n, [&](uint64_t ops) {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size(), bitstream::mode::io_writer);
+
+                for (uint64_t i = 0; i < ops; ++i) {
+                    if ((i % n) == 0) {
+                        b.seek(0);
+                        codec.reset();
+                    }
+
+                    row_write(b, &rows[i % n], &codec);
+                }
+            });
+
+            bench("typed_row_write/mixed", 1 << 20, (double)size / n, [&](uint64_t ops) {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size(), bitstream::mode::io_writer);
+
+                for (uint64_t i = 0; i < ops; ++i) {
+                    if ((i % n) == 0) {
+                        b.seek(0);
+                        codec.reset();
+                    }
+
+                    typed_row_write<typed::all()>(b, trows[i % n], codec);
+                }
+            });
+
+            arena a;
+            bench("row_read/mixed", 1 << 20, (double)size / n, [&](uint64_t ops) {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size());
+                uint64_t sum = 0;
+
+                for (uint64_t i = 0; i < ops; ++i) {
+                    if ((i % n) == 0) {
+                        b.seek(0);
+                        a.reset();
+                        codec.reset();
+                    }
+
+                    sum += row_read(cols, b, &a, nullptr, &codec)->m_data[0].m_value.v_i32;
+                }
+
+                g_sink += sum;
+            });
+
+            bench("typed_row_read/mixed", 1 << 20, (double)size / n, [&](uint64_t ops) {
+                bitstream b((bitstream::word_t*)buffer.data(), buffer.size());
+                typed t;
+                uint64_t sum = 0;
+
+                for (uint64_t i = 0; i < ops; ++i) {
+                    if ((i % n) == 0) {
+                        b.seek(0);
+                        codec.reset();
+                    }
+
+                    typed_row_read(b, t, codec);
+                    sum += t.get<0>();
+                }
+
+                g_sink += sum;
+            });
+
+            for (auto c : cols) {
+                delete c;
+            }
+        }
+
+        /** Decode throughput of XOR encoded doubles, bytes are decoded values */
+        void bench_xor() {
+            const uint32_t n = 1 << 16;
+            std::vector<col*> cols = {make_col(col_double | col_encoded, 0)};
+            std::vector<double> values(n);
+            std::vector<char> buffer(n * 10 + 16);
+            block_codec codec(cols);
+            rng r;
+
+            // a sensor reading with two decimals, changing on every third sample
+            double cur = 20.0;
+            for (auto &v : values) {
+                if (r.next() % 3 == 0)
+                    cur = (int64_t)(cur * 100 + (int64_t)(r.next() % 21) - 10) / 100.0;
+
+                v = cur;
+            }
+
+            for (const char* series : {"constant", "sensor", "random"}) {
+                bitstream out((bitstream::word_t*)buffer.data(), buffer.size(), bitstream::mode::io_writer);
+                codec.reset();
+
+                for (uint32_t i = 0; i < n; ++i) {
+                    double v = values[i];
+                    if (series[0] == 'c') {
+                        v = 20.0;
+                    } else if (series[0] == 'r') {
+                        v = make_value(col_double, r).m_value.v_double;
+                    }
+
+                    uint64_t u;
+                    memcpy(&u, &v, sizeof(u));
+                    codec.write_xor(out, 0, u, 64);
+                }
+
+                bench(std::string("xor/decode/") + series, 1 << 24, sizeof(double), [&](uint64_t ops) {
+                    bitstream in((bitstream::word_t*)buffer.data(), buffer.size());
+                    uint64_t sum = 0;
+
+                    for (uint64_t i = 0; i < ops; ++i) {
+                        if ((i & (n-1)) == 0) {
+                            in.seek(0);
+                            codec.reset();
+                        }
+
+                        sum += codec.read_xor(in, 0, 64);
+                    }
+
+                    g_sink += sum;
+                });
+            }
+
+            delete cols[0];
+        }
+
+        /**
+         * Full row and single column decode of one sealed block, rows vs. PAX layout.
+         *
+         * Column 3 is random and stays raw, column 4 counts up and is delta coded, column 5
+         * spans 10 bits and is frame of reference coded.
+         */
+        void bench_pax() {
+            std::vector<col*> cols;
+            for (uint32_t i = 0; i < 8; ++i) {
+                cols.push_back(make_col(col_int64, i));
+            }
+
+            const uint8_t flags = table_compact_masks;
+            block_codec codec(cols, flags);
+            block* rows = block_alloc();
+            block* pax = block_alloc();
+            rng r;
+
+            // fill most of a block, a full one does not fit the presence bitmaps
+            uint32_t n = 0;
+            {
+                bitstream b((bitstream::word_t*)rows->data, BLOCK_DSIZE, bitstream::mode::io_writer);
+                for (;;) {
+                    row rw;
+                    for (uint32_t j = 0; j < cols.size(); ++j) {
+                        row_value v = make_value(col_int64, r);
+                        if (j == 4)
+                            v.m_value.v_u64 = n * 3;
+                        else if (j == 5)
+                            v.m_value.v_u64 = 1000000 + v.m_value.v_u64 % 1024;
+
+                        rw.set(j, v);
+                    }
+
+                    if (b.position() / 8 + rw.size() + codec.overhead(rw.m_fields) > BLOCK_USABLE * 15 / 16)
+                        break;
+
+                    row_write(b, &rw, &codec);
+                    ++n;
+                }
+
+                rows->pos = b.position() / 8;
+                rows->rows = n;
+            }
+
+            memcpy(pax, rows, sizeof(block));
+            if (!pax_transpose(cols, flags, pax)) {
+                fprintf(stderr, "Unable to transpose benchmark block\n");
+                return;
+            }
+
+            const double bytes = (double)rows->pos / n;
+            arena a;
+
+            bench("pax/rows/row", 1 << 20, bytes, [&](uint64_t ops) {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < ops; i += n) {
+                    bitstream b((bitstream::word_t*)rows->data, BLOCK_DSIZE);
+                    codec.reset();
+                    a.reset();
+
+                    for (uint32_t j = 0; j < n; ++j) {
+                        sum += row_read(cols, b, &a, nullptr, &codec)->m_fields.word(0);
+                    }
+                }
+
+                g_sink += sum;
+            });
+
+            bench("pax/rows/pax", 1 << 20, bytes, [&](uint64_t ops) {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < ops; i += n) {
+                    pax_reader p(cols, flags, pax);
+                    a.reset();
+
+                    while (row* rw = p.next(&a)) {
+                        sum += rw->m_fields.word(0);
+                    }
+                }
+
+                g_sink += sum;
+            });
+
+            bench("pax/column/row", 1 << 20, bytes, [&](uint64_t ops) {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < ops; i += n) {
+                    bitstream b((bitstream::word_t*)rows->data, BLOCK_DSIZE);
+                    codec.reset();
+                    a.reset();
+
+                    for (uint32_t j = 0; j < n; ++j) {
+                        sum += row_read(cols, b, &a, nullptr, &codec)->get(3)->m_value.v_u64;
+                    }
+                }
+
+                g_sink += sum;
+            });
+
+            bench("pax/column/pax", 1 << 20, bytes, [&](uint64_t ops) {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < ops; i += n) {
+                    pax_scan_column(cols, flags, pax, 3, &a, [&](const row_value& v) {
+                        sum += v.m_value.v_u64;
+                    });
+                    a.reset();
+                }
+
+                g_sink += sum;
+            });
+
+            bench("pax/column/delta", 1 << 20, bytes, [&](uint64_t ops) {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < ops; i += n) {
+                    pax_scan_column(cols, flags, pax, 4, &a, [&](const row_value& v) {
+                        sum += v.m_value.v_u64;
+                    });
+                    a.reset();
+                }
+
+                g_sink += sum;
+            });
+
+            bench("pax/column/for", 1 << 20, bytes, [&](uint64_t ops) {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < ops; i += n) {
+                    pax_scan_column(cols, flags, pax, 5, &a, [&](const row_value& v) {
+                        sum += v.m_value.v_u64;
+                    });
+                    a.reset();
+                }
+
+                g_sink += sum;
+            });
+
+            // a tenth of the values match, raw decodes and compares, FOR compares packed offsets
+            std::vector<uint64_t> match;
+            bench("pax/select/raw", 1 << 20, bytes, [&](uint64_t ops) {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < ops; i += n) {
+                    sum += pax_select_column(cols, pax, 3, 0, ~0ull / 10, match);
+                }
+
+                g_sink += sum;
+            });
+
+            bench("pax/select/for", 1 << 20, bytes, [&](uint64_t ops) {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < ops; i += n) {
+                    sum += pax_select_column(cols, pax, 5, 1000000, 1000102, match);
+                }
+
+                g_sink += sum;
+            });
+
+            block_free(rows);
+            block_free(pax);
+            for (auto c : cols) {
+                delete c;
+            }
+        }
+
+        void bench_lz() {
+            static const uint8_t types[] = {col_int32, col_string, col_bool, col_double, col_string, col_bytes};
+
+            std::vector<col*> cols;
+            for (uint32_t i = 0; i < sizeof(types); ++i) {
+                cols.push_back(make_col(types[i], i));
+            }
+
+            block_codec codec(cols, table_compact_masks);
+            block* b = block_alloc();
+            block* compressed = block_alloc();
+            block* out = block_alloc();
+            rng r;
+
+            // log like rows, small numbers and a handful of strings
+            {
+                bitstream bs((bitstream::word_t*)b->data, BLOCK_DSIZE, bitstream::mode::io_writer);
+                for (;;) {
+                    row rw;
+                    for (uint32_t j = 0; j < cols.size(); ++j) {
+                        row_value v = make_value(types[j], r);
+                        if (types[j] == col_int32)
+                            v.m_value.v_u64 %= 1000;
+
+                        rw.set(j, v);
+                    }
+
+                    if (bs.position() / 8 + rw.size() + codec.overhead(rw.m_fields) > BLOCK_USABLE)
+                        break;
+
+                    row_write(bs, &rw, &codec);
+                    ++b->rows;
+                }
+
+                b->pos = bs.position() / 8;
+            }
+
+            uint32_t size = 0;
+            bench("lz/compress", 256, b->pos, [&](uint64_t ops) {
+                for (uint64_t i = 0; i < ops; ++i) {
+                    size = lz_compress(b->data, b->pos, compressed->data, BLOCK_DSIZE);
+                }
+            });
+
+            bench("lz/decompress", 1024, b->pos, [&](uint64_t ops) {
+                for (uint64_t i = 0; i < ops; ++i) {
+                    g_sink += lz_decompress(compressed->data, size, out->data, BLOCK_DSIZE);
+                }
+            });
+
+            block_free(b);
+            block_free(compressed);
+            block_free(out);
+
+            for (auto c : cols) {
+                delete c;
+            }
+        }
+
+        void bench_metrics() {
+            bench("metrics/add", 1 << 24, 0, [&](uint64_t ops) {
+                for (uint64_t i = 0; i < ops; ++i) {
+                    metrics_add(metric_rows_decoded);
+                }
+            });
+
+            bench("metrics/timer", 1 << 22, 0, [&](uint64_t ops) {
+                for (uint64_t i = 0; i < ops; ++i) {
+                    metrics_timer t(hist_block_decode);
+                }
+            });
+        }
+
+        void bench_blocks() {
+            char dir[] = "/tmp/deltadb_bench.XXXXXX";
+            if (!mkdtemp(dir)) {
+                perror("Unable to create benchmark directory");
+                return;
+            }
+
+            char cwd[4096];
+            if (!getcwd(cwd, sizeof(cwd)) || chdir(dir) != 0) {
+                perror("Unable to enter benchmark directory");
+                return;
+            }
+
+            // fill blocks through the write path, each op seals one block
+            {
+                std::vector<col*> cols;
+                for (uint32_t i = 0; i < 8; ++i) {
+                    cols.push_back(make_col(col_int64, i));
+                }
+
+                table t("bench");
+                t.set_columns(cols.data(), cols.size());
+
+                row rw;
+                rng r;
+                for (uint32_t i = 0; i < 8; ++i) {
+                    rw.set(i, make_value(col_int64, r));
+                }
+
+                const uint64_t rows_per_block = BLOCK_DSIZE / rw.size() + 1;
+                bench("table_write/seal", 64, BLOCK_DSIZE, [&](uint64_t ops) {
+                    for (uint64_t i = 0; i < ops * rows_per_block; ++i) {
+                        t.write(&rw);
+                    }
+                });
+
+                // the same while another thread keeps scanning snapshots
+                std::atomic<bool> stop(false);
+                std::thread reader([&]() {
+                    arena a;
+                    uint64_t rows = 0;
+
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        t.scan([&](row*) { ++rows; }, a);
+                    }
+
+                    g_sink += rows;
+                });
+
+                bench("table_write/seal/scanned", 64, BLOCK_DSIZE, [&](uint64_t ops) {
+                    for (uint64_t i = 0; i < ops * rows_per_block; ++i) {
+                        t.write(&rw);
+                    }
+                });
+
+                stop = true;
+                reader.join();
+
+                bench("table_snapshot", 1 << 16, 0, [&](uint64_t ops) {
+                    for (uint64_t i = 0; i < ops; ++i) {
+                        table_snapshot snap = t.snapshot();
+                        g_sink += snap.size();
+                    }
+                });
+            }
+
+            const uint32_t blocks = block_num("bench.blk");
+            bench("block_read", 256, sizeof(block), [&](uint64_t ops) {
+                for (uint64_t i = 0; i < ops; ++i) {
+                    block* b = block_read("bench.blk", (i % blocks) + 1);
+                    g_sink += b->pos;
+                    block_free(b);
+                }
+            });
+
+            block* b = block_alloc();
+            bench("block_write/overwrite", 256, sizeof(block), [&](uint64_t ops) {
+                for (uint64_t i = 0; i < ops; ++i) {
+                    b->pos = i;
+                    block_write("bench.blk", b, true);
+                }
+            });
+            block_free(b);
+
+            unlink("bench.blk");
+            unlink("bench.tbl");
+            if (chdir(cwd) != 0 || rmdir(dir) != 0)
+                perror("Unable to remove benchmark directory");
+        }
+    }
+} /* deltadb */
+
+int main(int argc, char** argv) {
+    using namespace deltadb;
+
+    if (argc > 1)
+        g_filter = argv[1];
+
+    printf("benchmark,ops,ns_per_op,bytes_per_sec,allocs_per_op\n");
+
+    bench_bitstream();
+    bench_row_codec();
+    bench_typed();
+    bench_xor();
+    bench_pax();
+    bench_lz();
+    bench_metrics();
+    bench_blocks();
+    return 0;
+}
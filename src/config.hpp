@@ -0,0 +1,34 @@
+/**
+ * @file config.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_CONFIG_HPP
+#define DELTADB_CONFIG_HPP
+
+/// Path to configuration folder
+#define DELTADB_PATH_CONF "OFF"
+
+/// Path to data folder
+#define DELTADB_PATH_DATA "OFF"
+
+/// Compile in USDT tracepoints
+/* #undef DELTADB_TRACING */
+
+#endif /* DELTADB_CONFIG_HPP */
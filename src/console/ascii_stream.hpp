@@ -0,0 +1,257 @@
+/**
+ * @file ascii_stream.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_CONSOLE_ASCII_STREAM_HPP
+#define DELTADB_CONSOLE_ASCII_STREAM_HPP
+
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <boost/noncopyable.hpp>
+
+#include "../internal/format.hpp"
+
+/** Output buffer size */
+#define ASCII_STREAM_BUFFER (64 * 1024)
+
+/** Widest cell, longer values are cut */
+#define ASCII_STREAM_MAX_WIDTH 64
+
+namespace deltadb {
+    /**
+     * Streaming ascii table.
+     *
+     * Unlike ascii_table nothing is buffered per row: column widths are fixed up front,
+     * from the schema or a sampled prefix, and every cell is formatted straight into
+     * an output buffer. Values wider than their column are cut and end in '~'. Memory
+     * use is constant no matter how many rows are printed.
+     *
+     * Define all columns, call header() once and then pass cells in row order. A row
+     * ends after the cell of the last column.
+     */
+    class ascii_stream : private boost::noncopyable {
+    public:
+        /** Cell alignment */
+        enum align {
+            align_left  = 0,
+            align_right = 1
+        };
+
+        /** Constructor */
+        ascii_stream(FILE* fp = stdout) : m_fp(fp), m_len(0), m_cell(0), m_open(false) {}
+
+        /** Destructor, closes the table */
+        ~ascii_stream() {
+            finish();
+        }
+
+        /** Add a column, the width grows to fit the name */
+        void column(const char* name, uint32_t width, align a = align_left) {
+            assert(!m_open);
+
+            column_t c;
+            c.m_name = name;
+            c.m_width = std::min<uint32_t>(std::max<uint32_t>(width, strlen(name)), ASCII_STREAM_MAX_WIDTH);
+            c.m_align = a;
+            m_cols.push_back(c);
+        }
+
+        /** Widen column to at least width, use with a sampled prefix before header() */
+        void widen(uint32_t col, uint32_t width) {
+            assert(!m_open && col < m_cols.size());
+            m_cols[col].m_width = std::min<uint32_t>(std::max(m_cols[col].m_width, width), ASCII_STREAM_MAX_WIDTH);
+        }
+
+        /** Print the header */
+        void header() {
+            separator();
+
+            for (uint32_t i = 0; i < m_cols.size(); ++i) {
+                const column_t& c = m_cols[i];
+                const uint32_t len = std::min<uint32_t>(strlen(c.m_name), c.m_width);
+                const uint32_t left = (c.m_width - len) / 2;
+
+                put(i == 0 ? "| " : " | ", i == 0 ? 2 : 3);
+                pad(left);
+                put(c.m_name, len);
+                pad(c.m_width - len - left);
+            }
+
+            put(" |\n", 3);
+
+            separator();
+            m_open = true;
+        }
+
+        /** String cell */
+        void cell(const char* s, size_t len) {
+            const column_t& c = next();
+
+            if (len > c.m_width) {
+                put(s, c.m_width - 1);
+                put("~", 1);
+            } else if (c.m_align == align_left) {
+                put(s, len);
+                pad(c.m_width - len);
+            } else {
+                pad(c.m_width - len);
+                put(s, len);
+            }
+
+            end();
+        }
+
+        /** String cell */
+        void cell(const char* s) {
+            cell(s, strlen(s));
+        }
+
+        /** Unsigned cell */
+        void cell(uint64_t v) {
+            char buf[FORMAT_MAX];
+            char* end = buf + sizeof(buf);
+            char* p = format_uint(v, end);
+            cell(p, end - p);
+        }
+
+        /** Signed cell */
+        void cell(int64_t v) {
+            char buf[FORMAT_MAX];
+            char* end = buf + sizeof(buf);
+            char* p = format_int(v, end);
+            cell(p, end - p);
+        }
+
+        /** Floating point cell, 7 significant digits */
+        void cell(double v) {
+            char buf[32];
+            const int len = snprintf(buf, sizeof(buf), "%.7g", v);
+            cell(buf, std::min<int>(len, sizeof(buf) - 1));
+        }
+
+        /** Boolean cell */
+        void cell(bool v) {
+            cell(v ? "true" : "false", v ? 4 : 5);
+        }
+
+        /** Empty cell */
+        void empty() {
+            cell("", 0);
+        }
+
+        /** Print the closing separator and flush, may be called more than once */
+        void finish() {
+            if (m_open) {
+                assert(m_cell == 0);
+                separator();
+                m_open = false;
+            }
+
+            flush();
+        }
+
+        /** Write buffered output */
+        void flush() {
+            if (m_len) {
+                fwrite(m_buf, 1, m_len, m_fp);
+                m_len = 0;
+            }
+
+            fflush(m_fp);
+        }
+    private:
+        /** Column definition */
+        struct column_t {
+            /** Header, has to outlive the stream */
+            const char* m_name;
+            /** Width */
+            uint32_t m_width;
+            /** Alignment */
+            align m_align;
+        };
+
+        /** Output */
+        FILE* m_fp;
+        /** Pending output */
+        char m_buf[ASCII_STREAM_BUFFER];
+        /** Bytes in m_buf */
+        uint32_t m_len;
+        /** Columns */
+        std::vector<column_t> m_cols;
+        /** Next cell in the current row */
+        uint32_t m_cell;
+        /** Header printed and no closing separator yet */
+        bool m_open;
+
+        /** Append raw bytes */
+        void put(const char* s, size_t len) {
+            if (m_len + len > sizeof(m_buf)) {
+                fwrite(m_buf, 1, m_len, m_fp);
+                m_len = 0;
+            }
+
+            memcpy(m_buf + m_len, s, len);
+            m_len += len;
+        }
+
+        /** Append spaces */
+        void pad(size_t n) {
+            static const char spaces[ASCII_STREAM_MAX_WIDTH + 1] =
+                "                                                                ";
+
+            put(spaces, n);
+        }
+
+        /** Start next cell and return its column */
+        const column_t& next() {
+            assert(m_open && m_cell < m_cols.size());
+            put(m_cell == 0 ? "| " : " | ", m_cell == 0 ? 2 : 3);
+            return m_cols[m_cell];
+        }
+
+        /** Finish cell, ends the row after the last column */
+        void end() {
+            if (++m_cell == m_cols.size()) {
+                put(" |\n", 3);
+                m_cell = 0;
+            }
+        }
+
+        /** Print a separator line */
+        void separator() {
+            for (auto &c : m_cols) {
+                put("+-", 2);
+                for (uint32_t i = 0; i < c.m_width; ++i) {
+                    put("-", 1);
+                }
+                put("-", 1);
+            }
+
+            put("+\n", 2);
+        }
+    };
+} /* deltadb */
+
+#endif /* DELTADB_CONSOLE_ASCII_STREAM_HPP */
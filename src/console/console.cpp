@@ -19,9 +19,18 @@
  *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "ascii.hpp"
+#include <algorithm>
+#include <cstring>
+
+#include "ascii_stream.hpp"
+#include "console.hpp"
+#include "../db/table.hpp"
 #include "../db/table_col.hpp"
 #include "../db/table_row.hpp"
+
+/** Width of string columns when printing whole tables */
+#define CONSOLE_STRING_WIDTH 16
+
 namespace deltadb {
     static const char* t2s(uint8_t t) {
         switch (t) {
@@ -48,55 +57,135 @@ namespace deltadb {
         }
     }
 
-    static std::string rv2s(row_value* v) {
-        switch (v->m_type) {
+    /** Column width needed for any value of c */
+    static uint32_t c2w(col* c) {
+        switch (c->type()) {
         case col_int8:
-            return std::to_string(v->m_value.v_u8);
+            return 4;
         case col_int16:
-            return std::to_string(v->m_value.v_u16);
+            return 6;
         case col_int32:
-            return std::to_string(v->m_value.v_u32);
+            return 11;
+        case col_int64:
+            return 20;
+        case col_bool:
+            return 5;
         case col_float:
-            return std::to_string(v->m_value.v_float);
+        case col_double:
+            return 14;
+        case col_bytes:
+            return 6;
+        default:
+            return CONSOLE_STRING_WIDTH;
+        }
+    }
+
+    /** Print value as a single cell */
+    static void rv2c(ascii_stream& out, col* c, row_value* v) {
+        const bool sign = !c->is_unsigned();
+
+        switch (v->m_type) {
+        case col_int8:
+            sign ? out.cell((int64_t)v->m_value.v_i8) : out.cell((uint64_t)v->m_value.v_u8);
+            break;
+        case col_int16:
+            sign ? out.cell((int64_t)v->m_value.v_i16) : out.cell((uint64_t)v->m_value.v_u16);
+            break;
+        case col_int32:
+            sign ? out.cell((int64_t)v->m_value.v_i32) : out.cell((uint64_t)v->m_value.v_u32);
+            break;
         case col_int64:
-            return std::to_string(v->m_value.v_u64);
+            sign ? out.cell(v->m_value.v_i64) : out.cell(v->m_value.v_u64);
+            break;
+        case col_float:
+            out.cell((double)v->m_value.v_float);
+            break;
         case col_double:
-            return std::to_string(v->m_value.v_double);
+            out.cell(v->m_value.v_double);
+            break;
         case col_bool:
-            return std::to_string(v->m_value.v_bool);
+            out.cell(v->m_value.v_bool);
+            break;
         case col_string:
-            return std::string(v->m_value.v_bytes);
+            out.cell(v->m_value.v_bytes);
+            break;
         case col_bytes:
-            return std::string("binary");
+        case BLOB_REF:
+            out.cell("binary", 6);
+            break;
         default:
-            return "Unkown";
+            out.cell("Unkown", 6);
         }
     }
 
     void print_frm(std::vector<col*>& cols) {
-        ascii_table a;
+        uint32_t name = 0, comment = 0;
+        for (auto c : cols) {
+            name = std::max<uint32_t>(name, strlen(c->m_name));
+            comment = std::max<uint32_t>(comment, strlen(c->m_comment));
+        }
 
-        a.append("Name", "Type", "Comment");
+        ascii_stream out;
+        out.column("Name", name);
+        out.column("Type", 6);
+        out.column("Comment", comment);
+        out.header();
 
         for (auto c : cols) {
-            a.append(std::string(c->m_name), t2s(c->type()), std::string(c->m_comment));
+            out.cell(c->m_name);
+            out.cell(t2s(c->type()));
+            out.cell(c->m_comment);
         }
-
-        a.print({true, true, true});
     }
 
     void print_row(std::vector<col*>& cols, row* r) {
-        ascii_table a;
-        a.append("Field", "Value");
+        uint32_t name = 0, value = 9;
+        for (uint32_t i = 0; i < cols.size(); ++i) {
+            name = std::max<uint32_t>(name, strlen(cols[i]->m_name));
+
+            if (r->has(i))
+                value = std::max(value, cols[i]->type() == col_string ? (uint32_t)strlen(r->get(i)->m_value.v_bytes) : c2w(cols[i]));
+        }
+
+        ascii_stream out;
+        out.column("Field", name);
+        out.column("Value", value);
+        out.header();
 
         for (uint32_t i = 0; i < cols.size(); ++i) {
+            out.cell(cols[i]->m_name);
+
             if (r->has(i)) {
-                a.append(std::string(cols[i]->m_name), rv2s(r->get(i)));
+                rv2c(out, cols[i], r->get(i));
             } else {
-                a.append(std::string(cols[i]->m_name), "Inherited");
+                out.cell("Inherited", 9);
             }
         }
+    }
+
+    void print_table(table& t) {
+        std::vector<col*> cols = t.columns();
+
+        ascii_stream out;
+        for (auto c : cols) {
+            const uint8_t type = c->type();
+            const bool right = type != col_string && type != col_bytes && type != col_bool;
 
-        a.print({true, true, false});
+            out.column(c->m_name, c2w(c), right ? ascii_stream::align_right : ascii_stream::align_left);
+        }
+        out.header();
+
+        arena a;
+        t.scan([&](row* r) {
+            uint32_t idx = 0;
+
+            for (uint32_t i = 0; i < cols.size(); ++i) {
+                if (r->m_fields.at(i)) {
+                    rv2c(out, cols[i], &r->m_data[idx++]);
+                } else {
+                    out.empty();
+                }
+            }
+        }, a);
     }
 } /* deltadb */
@@ -26,6 +26,7 @@
 
 namespace deltadb {
     // forward decls
+    class table;
     struct row;
     struct col;
 
@@ -34,6 +35,12 @@ namespace deltadb {
 
     /** Print given rows */
     void print_row(std::vector<col*>& cols, row* r);
+
+    /**
+     * Print every row of a table, one column per field and empty cells for inherited
+     * values. Output is streamed, column widths come from the schema.
+     */
+    void print_table(table& t);
 } /* deltadb */
 
 #endif /* DELTADB_CONSOLE_CONSOLE_HPP */
@@ -20,42 +20,250 @@
  */
 
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <cassert>
+#include <cerrno>
 #include <cstdio>
 #include <cstdint>
+#include <cstring>
+#include <string>
 
+#include "../internal/trace.hpp"
 #include "block.hpp"
+#include "block_lz.hpp"
+#include "block_pool.hpp"
+#include "metrics.hpp"
 
 namespace deltadb {
+    namespace {
+        /** Bytes in front of the payload of a compressed block, the header and the payload size */
+        constexpr uint32_t lz_record = sizeof(block_header) + sizeof(uint32_t);
+
+        /** Returns the path of the index of a data file */
+        std::string index_path(const char* db) {
+            std::string ret(db);
+            if (ret.size() > 4 && ret.compare(ret.size()-4, 4, ".blk") == 0)
+                ret.resize(ret.size()-4);
+
+            return ret+".idx";
+        }
+
+        /** Returns the offset of block num, false if it does not exist */
+        bool block_offset(const char* db, uint32_t num, off_t& off) {
+            int idx = open(index_path(db).c_str(), O_RDONLY);
+            if (idx < 0) {
+                off = (off_t)sizeof(block) * (num-1);
+                return true;
+            }
+
+            uint64_t pos;
+            const ssize_t r = pread(idx, &pos, sizeof(pos), (off_t)sizeof(pos) * (num-1));
+            close(idx);
+
+            off = pos;
+            return r == sizeof(pos);
+        }
+
+        /** Writes a block, compressed if lz is set and the data file has an index */
+        void write_block(const char* db, block* b, bool overwrite, bool lz) {
+            assert(b);
+            metrics_timer timer(hist_block_write);
+            DELTADB_TRACE3(block_write_start, db, b->pos, b->rows);
+
+            int fd = open(db, O_RDWR);
+            assert(fd >= 0);
+
+            struct stat st;
+            fstat(fd, &st);
+
+            int idx = open(index_path(db).c_str(), O_RDWR);
+            uint32_t num;
+            off_t off = st.st_size;
+
+            if (idx < 0) {
+                if (overwrite && off >= (off_t)sizeof(block))
+                    off -= sizeof(block);
+
+                num = off / sizeof(block) + 1;
+            } else {
+                struct stat ist;
+                fstat(idx, &ist);
+                num = ist.st_size / sizeof(uint64_t) + 1;
+
+                if (overwrite && num > 1) {
+                    uint64_t pos = 0;
+                    --num;
+
+                    const ssize_t r = pread(idx, &pos, sizeof(pos), (off_t)sizeof(pos) * (num-1));
+                    assert(r == sizeof(pos));
+                    (void)r;
+
+                    off = pos;
+                }
+            }
+
+            // compressed into a pooled block, payload size first
+            block* compressed = nullptr;
+            uint32_t size = 0;
+
+            if (idx >= 0 && lz) {
+                compressed = block_alloc();
+                size = lz_compress(b->data, block_used(b), compressed->data + sizeof(size), BLOCK_DSIZE - sizeof(size));
+
+                if (size) {
+                    compressed->crc = b->crc;
+                    compressed->pos = b->pos | BLOCK_LZ;
+                    compressed->rows = b->rows;
+                    memcpy(compressed->data, &size, sizeof(size));
+                } else {
+                    block_free(compressed);
+                    compressed = nullptr;
+                }
+            }
+
+            // indexed files store blocks at their used size
+            const block* out = compressed ? compressed : b;
+            size_t bytes = sizeof(block);
+
+            if (compressed) {
+                bytes = lz_record + size;
+            } else if (idx >= 0) {
+                bytes = sizeof(block_header) + block_used(b);
+            }
+
+            // data first, header last, the index entry once the block is complete
+            const ssize_t dw = pwrite(fd, out->data, bytes - sizeof(block_header), off + sizeof(block_header));
+            const ssize_t hw = pwrite(fd, static_cast<const block_header*>(out), sizeof(block_header), off);
+            assert(dw == (ssize_t)(bytes - sizeof(block_header)) && hw == sizeof(block_header));
+            (void)dw; (void)hw;
+
+            if (idx >= 0) {
+                const uint64_t pos = off;
+                const ssize_t iw = pwrite(idx, &pos, sizeof(pos), (off_t)sizeof(pos) * (num-1));
+                assert(iw == sizeof(pos));
+                (void)iw;
+                close(idx);
+
+                // only the last block is overwritten, drop what is left of it
+                if (st.st_size > (off_t)(off + bytes) && ftruncate(fd, off + bytes) != 0)
+                    perror("Unable to truncate block file");
+            }
+
+            close(fd);
+
+            if (compressed)
+                block_free(compressed);
+
+            metrics_add(metric_bytes_written, bytes);
+            DELTADB_TRACE2(block_write_done, db, num);
+        }
+    }
+
+    bool block_create(const char* db, bool indexed) {
+        int fd = open(db, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+        close(fd);
+
+        // a stale index would change how the new file is read
+        const std::string idx = index_path(db);
+        if (!indexed)
+            return unlink(idx.c_str()) == 0 || errno == ENOENT;
+
+        fd = open(idx.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+        close(fd);
+        return true;
+    }
+
     block* block_read(const char* db, uint32_t num) {
         assert(num != 0);
-        block* ret = new block();
+        metrics_timer timer(hist_block_read);
+        DELTADB_TRACE2(block_read_start, db, num);
 
-        FILE* fp = fopen(db, "rb");
-        if (!fp)
+        int fd = open(db, O_RDONLY);
+        if (fd < 0)
             return nullptr; // unkown db?
 
-        fseek(fp, sizeof(block) * (num-1), SEEK_SET);
-        assert(1 == fread(ret, sizeof(block), 1, fp));
+        off_t off;
+        if (!block_offset(db, num, off)) {
+            close(fd);
+            return nullptr;
+        }
+
+        // a compressed block is shorter, it may be the last one in the file
+        block* ret = block_alloc();
+        const ssize_t r = pread(fd, ret, sizeof(block), off);
+        close(fd);
+
+        size_t bytes = sizeof(block);
+        if (r >= (ssize_t)lz_record && block_is_compressed(ret)) {
+            block* compressed = ret;
+            ret = block_alloc();
+
+            uint32_t size;
+            memcpy(&size, compressed->data, sizeof(size));
+            assert(lz_record + size <= (size_t)r);
+
+            const int64_t used = lz_decompress(compressed->data + sizeof(size), size, ret->data, BLOCK_DSIZE);
+            assert(used == block_used(compressed));
+            (void)used;
 
-        fclose(fp);
+            ret->crc = compressed->crc;
+            ret->pos = compressed->pos & ~BLOCK_LZ;
+            ret->rows = compressed->rows;
+            memset(ret->data + block_used(ret), 0, BLOCK_DSIZE - block_used(ret));
+
+            block_free(compressed);
+            bytes = lz_record + size;
+        } else {
+            // blocks of indexed files end at their used size, the next one may follow
+            assert(r >= (ssize_t)sizeof(block_header) && (size_t)r >= sizeof(block_header) + block_used(ret));
+            memset(ret->data + block_used(ret), 0, BLOCK_DSIZE - block_used(ret));
+            bytes = r;
+        }
+
+        metrics_add(metric_blocks_read);
+        metrics_add(metric_bytes_read, bytes);
+
+        DELTADB_TRACE2(block_read_done, db, num);
         return ret;
     }
 
-    void block_write(const char* db, block* b, bool overwrite) {
-        assert(b);
+    bool block_read_header(const char* db, uint32_t num, block_header* h) {
+        assert(num != 0);
+
+        int fd = open(db, O_RDONLY);
+        if (fd < 0)
+            return false;
 
-        FILE* fp = fopen(db, "rb+");
-        assert(fp);
+        off_t off;
+        const bool ok = block_offset(db, num, off)
+            && pread(fd, h, sizeof(block_header), off) == sizeof(block_header);
+        close(fd);
 
-        fseek(fp, overwrite ? -sizeof(block) : 0, SEEK_END);
-        assert(1 == fwrite(b, sizeof(block), 1, fp));
-        fclose(fp);
+        h->pos &= ~BLOCK_LZ;
+        return ok;
+    }
+
+    void block_write(const char* db, block* b, bool overwrite) {
+        write_block(db, b, overwrite, false);
+    }
+
+    void block_seal(const char* db, block* b, bool overwrite, bool lz) {
+        write_block(db, b, overwrite, lz);
     }
 
     uint32_t block_num(const char* db) {
         struct stat st;
+        if (stat(index_path(db).c_str(), &st) == 0)
+            return st.st_size / sizeof(uint64_t);
+
         stat(db, &st);
         return st.st_size / sizeof(block);
     }
@@ -22,28 +22,102 @@
 #ifndef DELTADB_DB_BLOCK_HPP
 #define DELTADB_DB_BLOCK_HPP
 
+#include <cstdint>
+
 /** Block datasize */
-#define BLOCK_DSIZE 131064
+#define BLOCK_DSIZE 131060
+
+/** Bytes rows may fill, bitstream writes whole words and touches up to 3 bytes past a row */
+#define BLOCK_USABLE (BLOCK_DSIZE - 4)
+
+/** Block datasize of tables without table_row_counts, see block_legacy */
+#define BLOCK_LEGACY_DSIZE 131064
+
+/** Set in block_header::pos of sealed blocks stored column by column, see block_pax.hpp */
+#define BLOCK_PAX 0x80000000u
+
+/** Set in block_header::pos of sealed blocks stored compressed, only ever seen on disk, see block_lz.hpp */
+#define BLOCK_LZ 0x40000000u
 
 namespace deltadb {
-    /** 128kb data blocks */
-    struct block {
+    /** Block header as stored on disk */
+    struct block_header {
         /** Block crc */
         uint32_t crc;
         /** Last written pos */
         uint32_t pos;
+        /** Number of rows */
+        uint32_t rows;
+    };
+
+    /** 128kb data blocks */
+    struct block : block_header {
         /** Block data */
         char data[BLOCK_DSIZE];
 
-        block() : crc(0), pos(0) {}
+        block() {
+            crc = 0;
+            pos = 0;
+            rows = 0;
+        }
+    };
+
+    /** 128kb data blocks as written before block_header had a row count */
+    struct block_legacy {
+        /** Block crc */
+        uint32_t crc;
+        /** Last written pos */
+        uint32_t pos;
+        /** Block data */
+        char data[BLOCK_LEGACY_DSIZE];
     };
 
-    /** Load block from data file */
+    /** Returns the bytes used by a block */
+    inline uint32_t block_used(const block_header* h) {
+        return h->pos & ~(BLOCK_PAX | BLOCK_LZ);
+    }
+
+    /** Whether a block is stored in the PAX layout */
+    inline bool block_is_pax(const block_header* h) {
+        return h->pos & BLOCK_PAX;
+    }
+
+    /** Whether a block header read straight from disk belongs to a compressed block */
+    inline bool block_is_compressed(const block_header* h) {
+        return h->pos & BLOCK_LZ;
+    }
+
+    /**
+     * Create an empty data file, replacing an existing one.
+     *
+     * An indexed data file comes with an index of block offsets, <name>.idx, which lets
+     * blocks be stored at their used size and sealed blocks compressed with block_seal.
+     * Everything else reads and writes both kinds of files the same.
+     */
+    bool block_create(const char* db, bool indexed = false);
+
+    /** Load block from data file, release with block_free */
     block* block_read(const char* db, uint32_t num);
 
-    /** Write block to data file, optionally overwriting the last block */
+    /** Load only the header of a block, returns false if it does not exist */
+    bool block_read_header(const char* db, uint32_t num, block_header* h);
+
+    /**
+     * Write block to data file, optionally overwriting the last block.
+     *
+     * The header is written after the data, so a concurrent reader never sees a pos
+     * that is ahead of the bytes backing it.
+     */
     void block_write(const char* db, block* b, bool overwrite = false);
 
+    /**
+     * Write a block that does not change anymore, compressed if lz is set and the data file is indexed.
+     *
+     * Blocks that do not compress are written as by block_write. Overwriting a block
+     * shrinks the file to the end of the new one.
+     */
+    void block_seal(const char* db, block* b, bool overwrite = false, bool lz = true);
+
     /** Return number of blocks in file */
     uint32_t block_num(const char* db);
 } /* deltadb */
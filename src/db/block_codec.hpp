@@ -0,0 +1,700 @@
+/**
+ * @file block_codec.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_BLOCK_CODEC_HPP
+#define DELTADB_DB_BLOCK_CODEC_HPP
+
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "../internal/bitfield.hpp"
+#include "../internal/bitstream.hpp"
+#include "table_col.hpp"
+#include "table_row.hpp"
+
+/** Entries per column and block, codes are stored in a single byte */
+#define DICT_MAX_ENTRIES 255
+
+/** Hash slots per column, a power of two */
+#define DICT_SLOTS 512
+
+/** Encoded byte announcing a string that follows in full */
+#define DICT_LITERAL 0
+
+/** row_value::m_code of values without a dictionary code */
+#define DICT_NONE 0xFFFF
+
+/** Set in row_value::m_code if the value added its code to the dictionary */
+#define DICT_ADDED 0x8000
+
+/** Bits storing the leading zeros of an XOR delta, counts are capped to fit */
+#define XOR_LEADING_BITS 5
+
+namespace deltadb {
+    /**
+     * Dictionaries of the encoded string columns of a single block.
+     *
+     * A dictionary encoded string is a single byte. DICT_LITERAL is followed by the string
+     * itself, which becomes the next entry unless the dictionary is full, any other byte
+     * is the entry code + 1. Writer and reader build the same dictionary as rows are
+     * encoded and decoded in order, so nothing is stored besides the rows and every block
+     * stays self-contained.
+     *
+     * Entries point at the literal inside the block, the block has to outlive the
+     * dictionary. Call reset() when a new block starts.
+     */
+    class block_dict {
+    public:
+        /** Constructor */
+        block_dict() {}
+
+        /** Constructor, see init */
+        block_dict(const std::vector<col*>& cols) {
+            init(cols);
+        }
+
+        /** Set up a dictionary for every encoded string column */
+        void init(const std::vector<col*>& cols) {
+            m_mask.reset();
+            for (uint32_t i = 0; i < cols.size(); ++i) {
+                if (cols[i]->is_encoded() && cols[i]->type() == col_string)
+                    m_mask.set(i);
+            }
+
+            m_dicts.resize(m_mask.count());
+            reset();
+        }
+
+        /** Clear all entries */
+        void reset() {
+            for (auto &d : m_dicts) {
+                d.m_size = 0;
+                memset(d.m_slots, 0, sizeof(d.m_slots));
+            }
+        }
+
+        /** Returns dictionary encoded columns */
+        const bitfield& columns() const {
+            return m_mask;
+        }
+
+        /** Whether field is dictionary encoded */
+        bool encoded(uint16_t field) const {
+            return m_mask.at(field);
+        }
+
+        /** Returns number of entries of field */
+        uint32_t size(uint16_t field) const {
+            return dict(field).m_size;
+        }
+
+        /** Returns entry, nullptr if code is out of range */
+        const char* get(uint16_t field, uint32_t code) const {
+            const entries& d = dict(field);
+            return code < d.m_size ? d.m_ptr[code] : nullptr;
+        }
+
+        /** Returns code of s, DICT_NONE if it is no entry */
+        uint32_t find(uint16_t field, const char* s, uint32_t len) const {
+            const entries& d = dict(field);
+
+            for (uint32_t i = hash(s, len);; i = (i + 1) & (DICT_SLOTS - 1)) {
+                const uint32_t slot = d.m_slots[i];
+                if (slot == 0)
+                    return DICT_NONE;
+
+                if (d.m_len[slot - 1] == len && memcmp(d.m_ptr[slot - 1], s, len) == 0)
+                    return slot - 1;
+            }
+        }
+
+        /** Add s as the next entry and return its code, DICT_NONE if full */
+        uint32_t add(uint16_t field, const char* s, uint32_t len) {
+            entries& d = dict(field);
+            if (d.m_size == DICT_MAX_ENTRIES)
+                return DICT_NONE;
+
+            uint32_t i = hash(s, len);
+            while (d.m_slots[i] != 0) {
+                i = (i + 1) & (DICT_SLOTS - 1);
+            }
+
+            d.m_ptr[d.m_size] = s;
+            d.m_len[d.m_size] = len;
+            d.m_slots[i] = ++d.m_size;
+            return d.m_size - 1;
+        }
+    private:
+        /** Dictionary of a single column */
+        struct entries {
+            /** Entries */
+            const char* m_ptr[DICT_MAX_ENTRIES];
+            /** Entry lengths, strings are at most 255 bytes */
+            uint8_t m_len[DICT_MAX_ENTRIES];
+            /** Open addressing table of code + 1, 0 is empty */
+            uint8_t m_slots[DICT_SLOTS];
+            /** Number of entries */
+            uint32_t m_size;
+        };
+
+        /** Encoded columns */
+        bitfield m_mask;
+        /** One dictionary per encoded column, in column order */
+        std::vector<entries> m_dicts;
+
+        /** Returns dictionary of field */
+        const entries& dict(uint16_t field) const {
+            assert(encoded(field));
+            return m_dicts[m_mask.rank(field)];
+        }
+
+        /** Returns dictionary of field */
+        entries& dict(uint16_t field) {
+            assert(encoded(field));
+            return m_dicts[m_mask.rank(field)];
+        }
+
+        /** FNV-1a */
+        static uint32_t hash(const char* s, uint32_t len) {
+            uint32_t h = 2166136261u;
+            for (uint32_t i = 0; i < len; ++i) {
+                h = (h ^ (uint8_t)s[i]) * 16777619u;
+            }
+
+            return (h ^ (h >> 16)) & (DICT_SLOTS - 1);
+        }
+    };
+
+    /**
+     * Caches a result per dictionary code of one encoded string column.
+     *
+     * Evaluates predicates or maps group-by keys once per distinct string and block
+     * instead of once per row. Codes are introduced by the value flagged DICT_ADDED before
+     * any row refers to them, also in every new block, so the cache stays valid without
+     * knowing where blocks start. Each scanning thread needs its own cache.
+     */
+    template <typename T>
+    class dict_cache {
+    public:
+        /** Returns the cached result for v, calls compute(v) for new codes */
+        template <typename F>
+        T get(const row_value& v, F&& compute) {
+            if (v.m_code == DICT_NONE)
+                return compute(v);
+
+            if (v.m_code & DICT_ADDED)
+                m_values[v.m_code & ~DICT_ADDED] = compute(v);
+
+            return m_values[v.m_code & ~DICT_ADDED];
+        }
+    private:
+        /** Result per code */
+        T m_values[DICT_MAX_ENTRIES];
+    };
+
+    /**
+     * Per block state of all encoded columns.
+     *
+     * Strings use a block_dict. Floats and doubles store the XOR with the previous value
+     * of their column in the block, as in Facebook's Gorilla: a 0 bit if nothing changed,
+     * otherwise the bits between the leading and trailing zeros, either inside the window
+     * of the previous delta or with a new window of XOR_LEADING_BITS leading zeros and the
+     * length. The first value of a column in each block is stored as is.
+     *
+     * XOR deltas are bit packed, every other value of a row starts on a byte and rows end
+     * on one. Writer and reader have to call reset() whenever a new block starts.
+     *
+     * Tables flagged table_compact_masks also code the field mask of each row against the
+     * one of the previous row, see write_mask.
+     */
+    class block_codec {
+    public:
+        /** Constructor */
+        block_codec() : m_mask_bits(0), m_index_bits(0), m_words(1), m_mask(0) {}
+
+        /** Constructor, see init */
+        block_codec(const std::vector<col*>& cols, uint8_t flags = 0) : m_mask_bits(0), m_index_bits(0), m_words(1), m_mask(0) {
+            init(cols, flags);
+        }
+
+        /** Set up state for every encoded column, flags are the table_flags of the table */
+        void init(const std::vector<col*>& cols, uint8_t flags = 0) {
+            assert(cols.size() <= TABLE_MAX_COLUMNS);
+            m_dict.init(cols);
+
+            m_words = std::max<uint32_t>((cols.size() + 63) / 64, 1);
+            m_mask_bits = 0;
+            m_index_bits = 0;
+            if (flags & table_compact_masks) {
+                m_mask_bits = std::max<uint32_t>(cols.size(), 1);
+                m_index_bits = 1;
+
+                while (bit_at(m_index_bits) < m_mask_bits) {
+                    ++m_index_bits;
+                }
+            }
+
+            m_xor.reset();
+            for (uint32_t i = 0; i < cols.size(); ++i) {
+                if (cols[i]->is_encoded() && (cols[i]->type() == col_float || cols[i]->type() == col_double))
+                    m_xor.set(i);
+            }
+
+            m_series.resize(m_xor.count());
+            reset();
+        }
+
+        /** Forget all state */
+        void reset() {
+            m_dict.reset();
+            m_mask = 0;
+            m_wide.reset();
+
+            for (auto &s : m_series) {
+                s.m_known = false;
+            }
+        }
+
+        /** Whether decoding a row depends on the rows before it in the block */
+        bool stateful() const {
+            return m_dict.columns().any() || m_xor.any() || m_mask_bits;
+        }
+
+        /** Whether field is encoded */
+        bool encoded(uint16_t field) const {
+            return m_dict.encoded(field) || m_xor.at(field);
+        }
+
+        /** Whether field is XOR encoded */
+        bool is_xor(uint16_t field) const {
+            return m_xor.at(field);
+        }
+
+        /**
+         * Returns the worst case extra bytes of a row over row::size().
+         *
+         * A literal string costs one byte more, an XOR delta up to 13 bits plus padding and
+         * a compact mask three bits more than a plain one. Plain masks of tables with more
+         * than 64 columns take a word per 64 of them.
+         */
+        uint32_t overhead(const bitfield& fields) const {
+            return fields.count_and(m_dict.columns()) + 2 * fields.count_and(m_xor)
+                + (m_mask_bits ? 1 : 0) + (m_words - 1) * 8;
+        }
+
+        /** Returns dictionaries */
+        const block_dict& dict() const {
+            return m_dict;
+        }
+
+        /** Read the field mask of a row of a table of up to 64 columns */
+        uint64_t read_mask(bitstream& b) {
+            assert(m_words == 1);
+
+            if (!m_mask_bits)
+                return ((uint64_t)b.read(32) << 32) | b.read(32);
+
+            if (b.read(1) == 0)
+                return m_mask;
+
+            if (b.read(1) == 0) {
+                m_mask ^= bit_at(b.read(m_index_bits));
+            } else {
+                m_mask ^= read_bits(b, m_mask_bits);
+            }
+
+            return m_mask;
+        }
+
+        /** Read the field mask of a row */
+        void read_mask(bitstream& b, bitfield& fields) {
+            if (m_words == 1) {
+                fields.reset();
+                fields.set_word(0, read_mask(b));
+                return;
+            }
+
+            if (!m_mask_bits) {
+                fields.reset();
+                for (uint32_t i = 0; i < m_words; ++i) {
+                    fields.set_word(i, ((uint64_t)b.read(32) << 32) | b.read(32));
+                }
+
+                return;
+            }
+
+            if (b.read(1) == 1) {
+                if (b.read(1) == 0) {
+                    m_wide.flip(b.read(m_index_bits));
+                } else if (b.read(1) == 1) {
+                    for (uint32_t n = b.read(m_index_bits); n > 0; --n) {
+                        m_wide.flip(b.read(m_index_bits));
+                    }
+                } else {
+                    for (uint32_t i = 0; i < m_words; ++i) {
+                        m_wide.set_word(i, m_wide.word(i) ^ read_bits(b, word_bits(i)));
+                    }
+                }
+            }
+
+            fields = m_wide;
+        }
+
+        /**
+         * Write the field mask of a row of a table of up to 64 columns.
+         *
+         * Plain masks are 64 bits. Compact ones are a 0 bit if the mask equals the one of the
+         * previous row, otherwise the XOR with it: bits 1,0 and the index of the one field
+         * that differs, or bits 1,1 and one bit per column.
+         */
+        void write_mask(bitstream& b, uint64_t fields) {
+            assert(m_words == 1);
+
+            if (!m_mask_bits) {
+                b.write(32, (uint32_t)(fields >> 32));
+                b.write(32, (uint32_t)(fields));
+                return;
+            }
+
+            assert(m_mask_bits == 64 || (fields & ~bits_until(m_mask_bits)) == 0);
+
+            const uint64_t x = fields ^ m_mask;
+            m_mask = fields;
+
+            if (x == 0) {
+                b.write(1, 0);
+            } else if ((x & (x - 1)) == 0 && m_index_bits < m_mask_bits) {
+                b.write(2, 1);
+                b.write(m_index_bits, __builtin_ctzll(x));
+            } else {
+                b.write(2, 3);
+                write_bits(b, x, m_mask_bits);
+            }
+        }
+
+        /**
+         * Write the field mask of a row.
+         *
+         * Tables of up to 64 columns code it as above. Wider plain masks are a word per 64
+         * columns. Wider compact masks differ after bits 1,1: a 1 bit, the number of fields
+         * that differ and their indices if that is shorter, else a 0 bit and the bitmap.
+         */
+        void write_mask(bitstream& b, const bitfield& fields) {
+            assert(fields.words() <= m_words);
+
+            if (m_words == 1) {
+                write_mask(b, fields.word(0));
+                return;
+            }
+
+            if (!m_mask_bits) {
+                for (uint32_t i = 0; i < m_words; ++i) {
+                    b.write(32, (uint32_t)(fields.word(i) >> 32));
+                    b.write(32, (uint32_t)(fields.word(i)));
+                }
+
+                return;
+            }
+
+            uint64_t x[BITFIELD_WORDS];
+            uint32_t n = 0;
+
+            for (uint32_t i = 0; i < m_words; ++i) {
+                x[i] = fields.word(i) ^ m_wide.word(i);
+                n += __builtin_popcountll(x[i]);
+                assert(i + 1 < m_words || (fields.word(i) & ~(~0ull >> (64 - word_bits(i)))) == 0);
+            }
+
+            m_wide = fields;
+
+            if (n == 0) {
+                b.write(1, 0);
+                return;
+            }
+
+            if (n == 1) {
+                b.write(2, 1);
+                for (uint32_t i = 0; i < m_words; ++i) {
+                    if (x[i])
+                        b.write(m_index_bits, i * 64 + __builtin_ctzll(x[i]));
+                }
+
+                return;
+            }
+
+            b.write(2, 3);
+
+            if ((n + 1) * m_index_bits < m_mask_bits) {
+                b.write(1, 1);
+                b.write(m_index_bits, n);
+
+                for (uint32_t i = 0; i < m_words; ++i) {
+                    for (uint64_t w = x[i]; w; w &= w - 1) {
+                        b.write(m_index_bits, i * 64 + __builtin_ctzll(w));
+                    }
+                }
+            } else {
+                b.write(1, 0);
+                for (uint32_t i = 0; i < m_words; ++i) {
+                    write_bits(b, x[i], word_bits(i));
+                }
+            }
+        }
+
+        /** Read a dictionary encoded string, returns it and stores its code */
+        const char* read_string(bitstream& b, uint16_t field, uint16_t* code) {
+            const uint32_t c = b.read(8);
+
+            if (c != DICT_LITERAL) {
+                const char* ret = m_dict.get(field, c - 1);
+                *code = c - 1;
+                return ret ? ret : "";
+            }
+
+            // use the literal in place, it stays in the block
+            assert((b.position() & 7) == 0);
+            const char* p = reinterpret_cast<const char*>(b.buffer()) + b.position() / 8;
+            const uint32_t len = strnlen(p, std::min<uint32_t>(256, b.left() / 8));
+
+            b.seek(b.position() + (len + 1) * 8);
+
+            const uint32_t added = m_dict.add(field, p, len);
+            *code = added == DICT_NONE ? DICT_NONE : added | DICT_ADDED;
+            return p;
+        }
+
+        /** Write a dictionary encoded string */
+        void write_string(bitstream& b, uint16_t field, const char* s, uint32_t len) {
+            const uint32_t code = m_dict.find(field, s, len);
+
+            if (code != DICT_NONE) {
+                b.write(8, code + 1);
+                return;
+            }
+
+            b.write(8, DICT_LITERAL);
+
+            assert((b.position() & 7) == 0);
+            const char* p = reinterpret_cast<const char*>(b.buffer()) + b.position() / 8;
+
+            b.write_bytes(s, len + 1);
+            m_dict.add(field, p, len);
+        }
+
+        /**
+         * Read an XOR encoded value of width bits, 32 or 64.
+         *
+         * Constant and random series decode at over 1 GB/s. Series that change at random,
+         * like sensor readings, stay at 0.5 to 0.9 GB/s because the branch on the control
+         * bit mispredicts. Known gap: a branchless decode makes the next position wait for
+         * the load of the control bits and was slower for every series.
+         */
+        uint64_t read_xor(bitstream& b, uint16_t field, uint32_t width) {
+            series& s = m_series[rank(field)];
+
+            if (!s.m_known) {
+                s.m_known = true;
+                s.m_leading = 0xFF;
+                s.m_prev = read_bits(b, width);
+                return s.m_prev;
+            }
+
+            // control bits and header come from one unaligned load, away from the end
+            uint32_t pos = b.position();
+            if (b.left() < 128)
+                return read_xor_slow(b, s, width);
+
+            uint64_t w = peek(b, pos);
+            if (!(w & 1)) {
+                b.seek(pos + 1);
+                return s.m_prev;
+            }
+
+            if ((w & 2) || s.m_leading == 0xFF) {
+                const uint32_t len_bits = width == 64 ? 6 : 5;
+
+                uint32_t len = (w >> (2 + XOR_LEADING_BITS)) & ((1 << len_bits) - 1);
+                if (len == 0)
+                    len = width;
+
+                s.m_leading = (w >> 2) & ((1 << XOR_LEADING_BITS) - 1);
+                s.m_trailing = width - s.m_leading - len;
+                pos += 2 + XOR_LEADING_BITS + len_bits;
+            } else {
+                pos += 2;
+            }
+
+            const uint32_t len = width - s.m_leading - s.m_trailing;
+            uint64_t bits = peek(b, pos);
+
+            // a peek has at least 57 valid bits
+            if (len > 57)
+                bits = (bits & 0xFFFFFFFFull) | (peek(b, pos + 32) << 32);
+
+            s.m_prev ^= (bits & (~0ull >> (64 - len))) << s.m_trailing;
+            b.seek(pos + len);
+            return s.m_prev;
+        }
+
+        /** Write v as XOR encoded value of width bits, 32 or 64 */
+        void write_xor(bitstream& b, uint16_t field, uint64_t v, uint32_t width) {
+            series& s = m_series[rank(field)];
+
+            if (!s.m_known) {
+                s.m_known = true;
+                s.m_leading = 0xFF;
+                s.m_prev = v;
+                write_bits(b, v, width);
+                return;
+            }
+
+            const uint64_t x = v ^ s.m_prev;
+            s.m_prev = v;
+
+            if (x == 0) {
+                b.write(1, 0);
+                return;
+            }
+
+            const uint32_t leading = std::min<uint32_t>(__builtin_clzll(x) - (64 - width), (1 << XOR_LEADING_BITS) - 1);
+            const uint32_t trailing = __builtin_ctzll(x);
+
+            if (s.m_leading != 0xFF && leading >= s.m_leading && trailing >= s.m_trailing) {
+                // fits the previous window, bits are written low to high: 1 then 0
+                b.write(2, 1);
+            } else {
+                const uint32_t len = width - leading - trailing;
+
+                b.write(2, 3);
+                b.write(XOR_LEADING_BITS, leading);
+                b.write(width == 64 ? 6 : 5, len & (width - 1));
+
+                s.m_leading = leading;
+                s.m_trailing = trailing;
+            }
+
+            write_bits(b, x >> s.m_trailing, width - s.m_leading - s.m_trailing);
+        }
+
+        /** Skip to the next byte, if not already on one */
+        static void read_padding(bitstream& b) {
+            if (b.position() & 7)
+                b.seek((b.position() + 7) & ~7u);
+        }
+
+        /** Write zero bits up to the next byte */
+        static void write_padding(bitstream& b) {
+            if (b.position() & 7)
+                b.write(8 - (b.position() & 7), 0);
+        }
+    private:
+        /** Previous value of an XOR encoded column */
+        struct series {
+            /** Previous value */
+            uint64_t m_prev;
+            /** Leading zeros of the current window, 0xFF if there is none */
+            uint8_t m_leading;
+            /** Trailing zeros of the current window */
+            uint8_t m_trailing;
+            /** Whether the block had a value yet */
+            bool m_known;
+        };
+
+        /** Dictionaries */
+        block_dict m_dict;
+        /** XOR encoded columns */
+        bitfield m_xor;
+        /** State per XOR encoded column, in column order */
+        std::vector<series> m_series;
+        /** Bits of a compact mask, 0 for plain 64 bit masks */
+        uint32_t m_mask_bits;
+        /** Bits of a field index in a compact mask */
+        uint32_t m_index_bits;
+        /** Words of a plain mask */
+        uint32_t m_words;
+        /** Mask of the previous row */
+        uint64_t m_mask;
+        /** Mask of the previous row, tables of more than 64 columns */
+        bitfield m_wide;
+
+        /** Returns index of field in m_series */
+        uint32_t rank(uint16_t field) const {
+            assert(is_xor(field));
+            return m_xor.rank(field);
+        }
+
+        /** Returns the 64 bits from pos on, the top (pos & 7) bits are zero */
+        static uint64_t peek(bitstream& b, uint32_t pos) {
+            uint64_t ret;
+            memcpy(&ret, reinterpret_cast<const char*>(b.buffer()) + (pos >> 3), sizeof(ret));
+            return ret >> (pos & 7);
+        }
+
+        /** read_xor for the last bits of a stream, reads the fields one by one */
+        static uint64_t read_xor_slow(bitstream& b, series& s, uint32_t width) {
+            if (b.read(1) == 0)
+                return s.m_prev;
+
+            if (b.read(1) == 1 || s.m_leading == 0xFF) {
+                s.m_leading = b.read(XOR_LEADING_BITS);
+
+                uint32_t len = b.read(width == 64 ? 6 : 5);
+                if (len == 0)
+                    len = width;
+
+                s.m_trailing = width - s.m_leading - len;
+            }
+
+            const uint32_t len = width - s.m_leading - s.m_trailing;
+            s.m_prev ^= read_bits(b, len) << s.m_trailing;
+            return s.m_prev;
+        }
+
+        /** Columns covered by word w of a compact mask */
+        uint32_t word_bits(uint32_t w) const {
+            return std::min<uint32_t>(m_mask_bits - w * 64, 64);
+        }
+
+        /** Read up to 64 bits */
+        static uint64_t read_bits(bitstream& b, uint32_t bits) {
+            if (bits <= 32)
+                return b.read(bits);
+
+            const uint64_t low = b.read(32);
+            return low | ((uint64_t)b.read(bits - 32) << 32);
+        }
+
+        /** Write up to 64 bits */
+        static void write_bits(bitstream& b, uint64_t v, uint32_t bits) {
+            if (bits <= 32) {
+                b.write(bits, v);
+            } else {
+                b.write(32, (uint32_t)v);
+                b.write(bits - 32, (uint32_t)(v >> 32));
+            }
+        }
+    };
+} /* deltadb */
+
+#endif /* DELTADB_DB_BLOCK_CODEC_HPP */
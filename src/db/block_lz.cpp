@@ -0,0 +1,272 @@
+/**
+ * @file block_lz.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "block_lz.hpp"
+
+namespace deltadb {
+    namespace {
+        /** Matches end this many bytes before the input */
+        constexpr uint32_t last_literals = 5;
+        /** and start no later than this many, as in LZ4 */
+        constexpr uint32_t match_limit = 12;
+
+        inline uint32_t load32(const uint8_t* p) {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t load64(const uint8_t* p) {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t lz_hash(uint32_t v) {
+            return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+        }
+
+        /** Writes the continuation of a length that did not fit its nibble */
+        inline uint8_t* write_length(uint8_t* op, uint32_t len) {
+            for (; len >= 255; len -= 255) {
+                *op++ = 255;
+            }
+
+            *op++ = len;
+            return op;
+        }
+
+        /** Reads the continuation of a length, returns false if the input ends first */
+        inline bool read_length(const uint8_t*& ip, const uint8_t* iend, uint32_t& len) {
+            uint8_t c;
+            do {
+                if (ip == iend)
+                    return false;
+
+                c = *ip++;
+                len += c;
+            } while (c == 255);
+
+            return true;
+        }
+
+        /** Bytes a sequence takes at most */
+        inline size_t sequence_bound(uint32_t lit, uint32_t match) {
+            return 1 + lit / 255 + 1 + lit + 2 + match / 255 + 1;
+        }
+    }
+
+    uint32_t lz_compress(const char* src, uint32_t size, char* dst, uint32_t cap) {
+        // positions of the last occurence of each hashed 4 byte sequence
+        static thread_local uint32_t table[1 << LZ_HASH_BITS];
+
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+        const uint8_t* end = in + size;
+        const uint8_t* ip = in;
+        const uint8_t* anchor = in;
+
+        uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+        uint8_t* op = out;
+        uint8_t* oend = out + cap;
+
+        if (size > match_limit) {
+            memset(table, 0, sizeof(table));
+
+            const uint8_t* mflimit = end - match_limit;
+            const uint8_t* mlimit = end - last_literals;
+
+            while (ip < mflimit) {
+                const uint32_t seq = load32(ip);
+                const uint32_t h = lz_hash(seq);
+                const uint8_t* ref = in + table[h];
+                table[h] = ip - in;
+
+                if (ref >= ip || ip - ref > LZ_MAX_OFFSET || load32(ref) != seq) {
+                    // step faster the longer nothing matched
+                    ip += 1 + ((ip - anchor) >> 6);
+                    continue;
+                }
+
+                while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+                    --ip;
+                    --ref;
+                }
+
+                const uint8_t* mp = ip + LZ_MIN_MATCH;
+                const uint8_t* rp = ref + LZ_MIN_MATCH;
+
+                // a word at a time, the rest byte by byte
+                for (;;) {
+                    if (mp + 8 > mlimit) {
+                        while (mp < mlimit && *mp == *rp) {
+                            ++mp;
+                            ++rp;
+                        }
+
+                        break;
+                    }
+
+                    const uint64_t diff = load64(mp) ^ load64(rp);
+                    if (diff) {
+                        mp += __builtin_ctzll(diff) >> 3;
+                        break;
+                    }
+
+                    mp += 8;
+                    rp += 8;
+                }
+
+                const uint32_t lit = ip - anchor;
+                const uint32_t match = (mp - ip) - LZ_MIN_MATCH;
+                if (sequence_bound(lit, match) > (size_t)(oend - op))
+                    return 0;
+
+                uint8_t* token = op++;
+                if (lit >= 15) {
+                    *token = 15 << 4;
+                    op = write_length(op, lit - 15);
+                } else {
+                    *token = lit << 4;
+                }
+
+                memcpy(op, anchor, lit);
+                op += lit;
+
+                const uint32_t off = ip - ref;
+                *op++ = off & 0xFF;
+                *op++ = off >> 8;
+
+                if (match >= 15) {
+                    *token |= 15;
+                    op = write_length(op, match - 15);
+                } else {
+                    *token |= match;
+                }
+
+                ip = anchor = mp;
+                if (ip < mflimit)
+                    table[lz_hash(load32(ip - 2))] = ip - 2 - in;
+            }
+        }
+
+        // trailing literals
+        const uint32_t lit = end - anchor;
+        if (sequence_bound(lit, 0) > (size_t)(oend - op))
+            return 0;
+
+        if (lit >= 15) {
+            *op++ = 15 << 4;
+            op = write_length(op, lit - 15);
+        } else {
+            *op++ = lit << 4;
+        }
+
+        if (lit)
+            memcpy(op, anchor, lit);
+
+        return op + lit - out;
+    }
+
+    int64_t lz_decompress(const char* src, uint32_t size, char* dst, uint32_t cap) {
+        const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+        const uint8_t* iend = ip + size;
+
+        uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+        uint8_t* op = out;
+        uint8_t* oend = out + cap;
+
+        for (;;) {
+            if (ip == iend)
+                return -1;
+
+            const uint8_t token = *ip++;
+
+            uint32_t lit = token >> 4;
+            if (lit == 15 && !read_length(ip, iend, lit))
+                return -1;
+
+            if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit)
+                return -1;
+
+            // short literals are copied as whole words where both sides have the room
+            if ((size_t)(iend - ip) >= lit + 16 && (size_t)(oend - op) >= lit + 16) {
+                for (uint32_t i = 0; i < lit; i += 16) {
+                    memcpy(op + i, ip + i, 16);
+                }
+            } else {
+                memcpy(op, ip, lit);
+            }
+
+            op += lit;
+            ip += lit;
+
+            // the last sequence has no match
+            if (ip == iend)
+                break;
+
+            if (iend - ip < 2)
+                return -1;
+
+            const uint32_t off = ip[0] | (ip[1] << 8);
+            ip += 2;
+
+            if (off == 0 || off > (size_t)(op - out))
+                return -1;
+
+            uint32_t match = token & 15;
+            if (match == 15 && !read_length(ip, iend, match))
+                return -1;
+
+            match += LZ_MIN_MATCH;
+            if ((size_t)(oend - op) < match)
+                return -1;
+
+            // a close match repeats with a period of off, widen it to a word before copying words
+            const uint8_t* ref = op - off;
+            uint32_t i = 0;
+
+            if (off < 8) {
+                const uint32_t period = off * ((8 + off - 1) / off);
+                for (; i < match && i < period; ++i) {
+                    op[i] = ref[i];
+                }
+
+                ref = op - period;
+            }
+
+            if ((size_t)(oend - op) >= match + 8) {
+                for (; i < match; i += 8) {
+                    memcpy(op + i, ref + i, 8);
+                }
+            } else {
+                for (; i < match; ++i) {
+                    op[i] = ref[i];
+                }
+            }
+
+            op += match;
+        }
+
+        return op - out;
+    }
+} /* deltadb */
@@ -0,0 +1,57 @@
+/**
+ * @file block_lz.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_BLOCK_LZ_HPP
+#define DELTADB_DB_BLOCK_LZ_HPP
+
+#include <cstdint>
+
+/** Bits of the match finder hash */
+#define LZ_HASH_BITS 14
+
+/** Shortest match, shorter ones are coded as literals */
+#define LZ_MIN_MATCH 4
+
+/** Farthest match */
+#define LZ_MAX_OFFSET 0xFFFF
+
+namespace deltadb {
+    /**
+     * Byte oriented LZ77 used to compress sealed blocks.
+     *
+     * The stream is a list of sequences in the LZ4 block format: a token with the literal
+     * length in the upper and the match length minus LZ_MIN_MATCH in the lower nibble, either
+     * extended by bytes of 255 while it is 15, the literals, then the 16 bit little endian
+     * offset of the match. The last sequence has literals only.
+     */
+
+    /** Compresses size bytes from src into at most cap bytes at dst, returns 0 if they don't fit */
+    uint32_t lz_compress(const char* src, uint32_t size, char* dst, uint32_t cap);
+
+    /**
+     * Decompresses size bytes from src into at most cap bytes at dst, returns the size or -1 if malformed.
+     *
+     * Bytes of dst past the returned size may be overwritten.
+     */
+    int64_t lz_decompress(const char* src, uint32_t size, char* dst, uint32_t cap);
+} /* deltadb */
+
+#endif /* DELTADB_DB_BLOCK_LZ_HPP */
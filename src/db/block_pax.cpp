@@ -0,0 +1,314 @@
+/**
+ * @file block_pax.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "../internal/arena.hpp"
+#include "../internal/bitstream.hpp"
+#include "block_codec.hpp"
+#include "block_pax.hpp"
+#include "column_codec.hpp"
+#include "table_col.hpp"
+#include "table_row.hpp"
+
+namespace deltadb {
+    namespace {
+        /** Round up to PAX_ALIGN */
+        inline uint32_t pax_align(uint32_t v) {
+            return (v + PAX_ALIGN - 1) & ~(PAX_ALIGN - 1);
+        }
+
+        /** Upper bound of the encoded size of v */
+        inline uint32_t pax_bound(const row_value& v) {
+            switch (v.m_type) {
+            case col_string:
+                return strlen(v.m_value.v_bytes) + 2;
+            case col_bytes:
+                return v.m_size + 2;
+            case BLOB_REF:
+                return 10;
+            default:
+                return 10; // a 64 bit XOR delta with a new window
+            }
+        }
+
+        /** Append the presence of field in rows as pax_runs */
+        void pax_runs_encode(const std::vector<row*>& rows, uint32_t field, std::vector<char>& runs) {
+            bool set = false;
+            uint32_t run = 0;
+
+            for (uint32_t r = 0; r <= rows.size(); ++r) {
+                if (r < rows.size() && rows[r]->has(field) == set) {
+                    ++run;
+                    continue;
+                }
+
+                const size_t pos = runs.size();
+                runs.resize(pos + 10);
+                runs.resize(pos + varint_write(runs.data() + pos, run));
+
+                set = !set;
+                run = 1;
+            }
+        }
+    }
+
+    bool pax_transpose(const std::vector<col*>& cols, uint8_t flags, block* blk) {
+        if (block_is_pax(blk))
+            return false;
+
+        arena a;
+        std::vector<row*> rows;
+        rows.reserve(blk->rows);
+
+        // decode first, dictionary strings keep pointing into the block
+        {
+            bitstream b((bitstream::word_t*)blk->data, BLOCK_DSIZE);
+            block_codec codec(cols, flags);
+            row_plan plan(cols);
+
+            while (b.position() < blk->pos * 8) {
+                rows.push_back(row_read(plan, b, &a, &codec));
+            }
+        }
+
+        const uint32_t n = rows.size();
+        std::vector<char> out(BLOCK_DSIZE + PAX_ALIGN, 0);
+        std::vector<uint64_t> fixed_values;
+        std::vector<char> runs;
+        pax_column* dir = reinterpret_cast<pax_column*>(out.data());
+        block_codec codec(cols, flags);
+        uint32_t off = pax_align(cols.size() * sizeof(pax_column));
+
+        for (uint32_t i = 0; i < cols.size(); ++i) {
+            const bool fixed = pax_fixed(cols[i]);
+            const uint32_t width = col_width(cols[i]->type());
+            const uint32_t bitmap = (n + 7) / 8;
+
+            // run lengths are smaller than the bitmap for columns that are set rarely or in streaks
+            runs.clear();
+            pax_runs_encode(rows, i, runs);
+
+            dir[i].m_present = off;
+            dir[i].m_presence = runs.size() < bitmap ? pax_runs : pax_bitmap;
+            off = pax_align(off + (dir[i].m_presence == pax_runs ? runs.size() : bitmap));
+            dir[i].m_values = off;
+            dir[i].m_count = 0;
+            dir[i].m_codec = column_raw;
+
+            if (off > BLOCK_USABLE)
+                return false;
+
+            uint8_t* present = reinterpret_cast<uint8_t*>(out.data() + dir[i].m_present);
+            char* values = out.data() + off;
+
+            if (dir[i].m_presence == pax_runs)
+                memcpy(present, runs.data(), runs.size());
+            bitstream b((bitstream::word_t*)values, BLOCK_DSIZE - off, bitstream::mode::io_writer);
+            fixed_values.clear();
+
+            for (uint32_t r = 0; r < n; ++r) {
+                if (!rows[r]->has(i))
+                    continue;
+
+                const row_value& v = *rows[r]->get(i);
+
+                if (fixed) {
+                    uint64_t u = 0;
+                    memcpy(&u, &v.m_value, width);
+                    fixed_values.push_back(u);
+                } else {
+                    if (off + b.position() / 8 + pax_bound(v) > BLOCK_USABLE)
+                        return false;
+
+                    row_value_write(b, v, &codec);
+                }
+
+                if (dir[i].m_presence == pax_bitmap)
+                    present[r >> 3] |= 1 << (r & 7);
+
+                ++dir[i].m_count;
+            }
+
+            if (fixed) {
+                // pick the codec from the statistics of this block
+                const column_stats st = column_analyze(fixed_values.data(), fixed_values.size(), width);
+                dir[i].m_codec = column_choose(st, width);
+                dir[i].m_size = column_size(st, dir[i].m_codec, width);
+
+                if (off + dir[i].m_size > BLOCK_USABLE)
+                    return false;
+
+                const uint32_t written = column_encoder(dir[i].m_codec, width)(
+                    fixed_values.data(), fixed_values.size(), values
+                );
+                assert(written == dir[i].m_size);
+                (void)written;
+            } else {
+                dir[i].m_size = (b.position() + 7) / 8;
+            }
+
+            off = pax_align(off + dir[i].m_size);
+        }
+
+        if (off > BLOCK_USABLE)
+            return false;
+
+        memcpy(blk->data, out.data(), off);
+        if (blk->pos > off)
+            memset(blk->data + off, 0, blk->pos - off);
+
+        blk->pos = off | BLOCK_PAX;
+        return true;
+    }
+
+    bool pax_presence_count(const block* blk, uint16_t field, uint32_t& set) {
+        const pax_column& pc = pax_directory(blk)[field];
+        set = 0;
+
+        if (pc.m_presence == pax_bitmap) {
+            if (pc.m_present + (blk->rows + 7) / 8 > pc.m_values)
+                return false;
+
+            const uint8_t* present = reinterpret_cast<const uint8_t*>(blk->data + pc.m_present);
+            for (uint32_t r = 0; r < blk->rows; ++r) {
+                set += pax_present(present, r);
+            }
+
+            return true;
+        }
+
+        if (pc.m_presence != pax_runs || pc.m_present > pc.m_values)
+            return false;
+
+        const char* src = blk->data + pc.m_present;
+        const char* end = blk->data + pc.m_values;
+        uint64_t rows = 0;
+        bool on = false;
+
+        // trailing bytes are alignment padding, runs end once they cover the block
+        while (rows < blk->rows) {
+            uint64_t run;
+            if (!varint_read(src, end, run) || run > blk->rows - rows)
+                return false;
+
+            rows += run;
+            if (on)
+                set += run;
+
+            on = !on;
+        }
+
+        return true;
+    }
+
+    uint32_t pax_select_column(const std::vector<col*>& cols, const block* blk, uint16_t field, uint64_t lo,
+        uint64_t hi, std::vector<uint64_t>& match)
+    {
+        const pax_column& pc = pax_directory(blk)[field];
+        col* c = cols[field];
+        assert(pax_fixed(c) && c->type() <= col_int64);
+
+        match.resize((pc.m_count + 63) / 64);
+        if (pc.m_count == 0)
+            return 0;
+
+        return column_selector(pc.m_codec, col_width(c->type()))(
+            blk->data + pc.m_values, pc.m_size, pc.m_count, lo, hi, !c->is_unsigned(), match.data()
+        );
+    }
+
+    pax_reader::pax_reader(const std::vector<col*>& cols, uint8_t flags, const block* blk)
+        : m_cols(cols), m_block(blk), m_stream((bitstream::word_t*)blk->data, BLOCK_DSIZE),
+          m_codec(cols, flags), m_row(0), m_next(cols.size(), 0)
+    {
+        assert(block_is_pax(blk));
+
+        const pax_column* dir = pax_directory(blk);
+        uint32_t fixed = 0;
+        m_present.reserve(cols.size());
+
+        for (uint32_t i = 0; i < cols.size(); ++i) {
+            m_present.emplace_back(blk, dir[i]);
+
+            if (pax_fixed(cols[i]))
+                fixed += dir[i].m_count;
+        }
+
+        // decode fixed width runs up front, each through the decoder of its codec
+        m_values.resize(fixed);
+        fixed = 0;
+
+        for (uint32_t i = 0; i < cols.size(); ++i) {
+            if (!pax_fixed(cols[i])) {
+                m_next[i] = dir[i].m_values * 8;
+                continue;
+            }
+
+            const bool ok = column_decoder(dir[i].m_codec, col_width(cols[i]->type()))(
+                blk->data + dir[i].m_values, dir[i].m_size, dir[i].m_count, m_values.data() + fixed
+            );
+            assert(ok);
+            (void)ok;
+
+            m_next[i] = fixed;
+            fixed += dir[i].m_count;
+        }
+    }
+
+    row* pax_reader::next(arena* a) {
+        if (m_row >= m_block->rows)
+            return nullptr;
+
+        row* ret = a ? a->create<row>(a) : new row();
+
+        for (uint32_t i = 0; i < m_cols.size(); ++i) {
+            if (!m_present[i].next())
+                continue;
+
+            col* c = m_cols[i];
+
+            if (pax_fixed(c)) {
+                row_value v;
+                v.m_size = 0;
+                v.m_pos = i;
+                v.m_code = DICT_NONE;
+                v.m_type = c->type();
+                v.m_value.v_u64 = m_values[m_next[i]++];
+
+                ret->m_data.push_back(v);
+            } else {
+                m_stream.seek(m_next[i]);
+                ret->m_data.push_back(row_value_read(m_stream, c, i, a, &m_codec));
+                m_next[i] = m_stream.position();
+            }
+
+            ret->m_fields.set(i);
+        }
+
+        ++m_row;
+        return ret;
+    }
+} /* deltadb */
@@ -0,0 +1,239 @@
+/**
+ * @file block_pax.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_BLOCK_PAX_HPP
+#define DELTADB_DB_BLOCK_PAX_HPP
+
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "../internal/arena.hpp"
+#include "../internal/bitstream.hpp"
+#include "block.hpp"
+#include "block_codec.hpp"
+#include "column_codec.hpp"
+#include "table_col.hpp"
+#include "table_row.hpp"
+
+/** Alignment of mini pages and value runs inside a PAX block */
+#define PAX_ALIGN 8
+
+namespace deltadb {
+    /**
+     * Directory entry of one column of a PAX block.
+     *
+     * A PAX block starts with one entry per column, followed by a mini page per column: the
+     * rows of the block that set the column, see pax_presence_kind, and the values of those
+     * rows back to back. Fixed width values are stored with the column_codec chosen for the
+     * block, raw runs can be processed as an array. Everything else is stored with the row
+     * encoding, encoded columns keep their block_codec state across the run.
+     */
+    struct pax_column {
+        /** Offset of the presence map in block::data */
+        uint32_t m_present;
+        /** Offset of the values */
+        uint32_t m_values;
+        /** Bytes of the values */
+        uint32_t m_size;
+        /** Number of values */
+        uint32_t m_count;
+        /** column_codec_id of fixed width values */
+        uint8_t m_codec;
+        /** pax_presence_kind of the presence map */
+        uint8_t m_presence;
+        /** Unused, zero */
+        uint8_t m_reserved[2];
+    };
+
+    /** Encodings of the presence map of a column, the smaller one is chosen per column and block */
+    enum pax_presence_kind {
+        /** A bit for every row of the block, set if the row sets the column */
+        pax_bitmap = 0,
+        /** Varint lengths of alternating runs of rows, starting with rows that do not set the column */
+        pax_runs,
+        /** Number of kinds */
+        pax_presence_kinds
+    };
+
+    /** Returns the column directory of a PAX block */
+    inline const pax_column* pax_directory(const block* blk) {
+        return reinterpret_cast<const pax_column*>(blk->data);
+    }
+
+    /** Whether the values of c are stored as an array in PAX blocks */
+    inline bool pax_fixed(col* c) {
+        return !c->is_encoded() && col_width(c->type()) != 0;
+    }
+
+    /** Whether row r sets the column of a presence bitmap */
+    inline bool pax_present(const uint8_t* present, uint32_t r) {
+        return present[r >> 3] & (1 << (r & 7));
+    }
+
+    /** Walks the presence map of a column row by row */
+    class pax_presence {
+    public:
+        /** Constructor */
+        pax_presence(const block* blk, const pax_column& pc)
+            : m_data(blk->data + pc.m_present), m_end(blk->data + pc.m_values), m_kind(pc.m_presence), m_set(true),
+              m_row(0), m_left(0) {}
+
+        /** Whether the next row sets the column, rows past a malformed map do not */
+        bool next() {
+            if (m_kind == pax_bitmap)
+                return pax_present(reinterpret_cast<const uint8_t*>(m_data), m_row++);
+
+            while (m_left == 0) {
+                if (!varint_read(m_data, m_end, m_left))
+                    return false;
+
+                m_set = !m_set;
+            }
+
+            --m_left;
+            return m_set;
+        }
+    private:
+        /** Bitmap or next run length */
+        const char* m_data;
+        /** End of the map */
+        const char* m_end;
+        /** pax_presence_kind */
+        uint8_t m_kind;
+        /** Whether the current run sets the column */
+        bool m_set;
+        /** Next row of a bitmap */
+        uint32_t m_row;
+        /** Rows left in the current run */
+        uint64_t m_left;
+    };
+
+    /**
+     * Counts the rows that set column field of a PAX block.
+     *
+     * Returns false if the presence map is malformed: an unknown kind, a map that exceeds
+     * the values, or runs that do not add up to the rows of the block.
+     */
+    bool pax_presence_count(const block* blk, uint16_t field, uint32_t& set);
+
+    /**
+     * Transpose a sealed block from rows to the PAX layout.
+     *
+     * Returns false and leaves the block untouched if it is already transposed, or if the
+     * PAX layout does not fit, which can happen for encoded columns only.
+     */
+    bool pax_transpose(const std::vector<col*>& cols, uint8_t flags, block* blk);
+
+    /** Decodes the rows of a PAX block in order, same result as row_read */
+    class pax_reader {
+    public:
+        /** Constructor */
+        pax_reader(const std::vector<col*>& cols, uint8_t flags, const block* blk);
+
+        /** Returns the next row or nullptr after the last one, allocated as in row_read */
+        row* next(arena* a = nullptr);
+    private:
+        /** Columns */
+        const std::vector<col*>& m_cols;
+        /** Block being read */
+        const block* m_block;
+        /** Stream over the whole block */
+        bitstream m_stream;
+        /** State of encoded columns */
+        block_codec m_codec;
+        /** Next row */
+        uint32_t m_row;
+        /** Per column, index of the next fixed value or bit position of the next value */
+        std::vector<uint32_t> m_next;
+        /** Per column, presence of the next row */
+        std::vector<pax_presence> m_present;
+        /** Decoded fixed width values of all columns */
+        std::vector<uint64_t> m_values;
+    };
+
+    /**
+     * Marks the values of an integer column of a PAX block within [lo, hi].
+     *
+     * Sets bit i of match for the i-th value of the column, not the i-th row, and returns
+     * the number of matches. Values compare signed unless the column is unsigned.
+     */
+    uint32_t pax_select_column(const std::vector<col*>& cols, const block* blk, uint16_t field, uint64_t lo,
+        uint64_t hi, std::vector<uint64_t>& match);
+
+    /**
+     * Calls fn(const row_value&) for every row of a PAX block that sets field, in order.
+     *
+     * Only reads the mini page of field, fixed width values are decoded into a first.
+     */
+    template <typename F>
+    void pax_scan_column(const std::vector<col*>& cols, uint8_t flags, const block* blk, uint16_t field,
+        arena* a, F&& fn)
+    {
+        const pax_column& pc = pax_directory(blk)[field];
+        col* c = cols[field];
+
+        if (pax_fixed(c)) {
+            if (pc.m_count == 0)
+                return;
+
+            std::vector<uint64_t> own;
+            uint64_t* values;
+
+            if (a) {
+                values = static_cast<uint64_t*>(a->allocate(pc.m_count * sizeof(uint64_t), alignof(uint64_t)));
+            } else {
+                own.resize(pc.m_count);
+                values = own.data();
+            }
+
+            const bool ok = column_decoder(pc.m_codec, col_width(c->type()))(
+                blk->data + pc.m_values, pc.m_size, pc.m_count, values
+            );
+            assert(ok);
+            (void)ok;
+
+            row_value v;
+            v.m_size = 0;
+            v.m_pos = field;
+            v.m_code = DICT_NONE;
+            v.m_type = c->type();
+
+            for (uint32_t i = 0; i < pc.m_count; ++i) {
+                v.m_value.v_u64 = values[i];
+                fn(v);
+            }
+
+            return;
+        }
+
+        bitstream b((bitstream::word_t*)blk->data, BLOCK_DSIZE);
+        block_codec codec(cols, flags);
+        b.seek(pc.m_values * 8);
+
+        for (uint32_t i = 0; i < pc.m_count; ++i) {
+            fn(row_value_read(b, c, field, a, &codec));
+        }
+    }
+} /* deltadb */
+
+#endif /* DELTADB_DB_BLOCK_PAX_HPP */
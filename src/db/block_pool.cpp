@@ -0,0 +1,206 @@
+/**
+ * @file block_pool.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/mman.h>
+
+#include "block.hpp"
+#include "block_pool.hpp"
+#include "metrics.hpp"
+
+namespace deltadb {
+    namespace {
+        static_assert(BLOCK_SLAB_SIZE % sizeof(block) == 0, "Slabs have to hold a whole number of blocks");
+
+        /** Blocks per slab */
+        static constexpr uint32_t slab_blocks = BLOCK_SLAB_SIZE / sizeof(block);
+
+        struct thread_cache;
+
+        /** State shared by all threads */
+        struct pool {
+            /** Guards everything below */
+            std::mutex m_lock;
+            /** Mapped slabs */
+            std::vector<char*> m_slabs;
+            /** Free blocks */
+            std::vector<block*> m_free;
+            /** Per thread caches, for occupancy */
+            std::vector<thread_cache*> m_caches;
+        };
+
+        /** Never destroyed, blocks may be returned by static destructors */
+        pool& global() {
+            static pool* p = new pool();
+            return *p;
+        }
+
+        /** Free blocks owned by a single thread */
+        struct thread_cache {
+            /** Free blocks */
+            block* m_free[BLOCK_THREAD_CACHE];
+            /** Number of free blocks, only written by the owning thread */
+            std::atomic<uint32_t> m_size;
+
+            thread_cache() : m_size(0) {
+                std::lock_guard<std::mutex> l(global().m_lock);
+                global().m_caches.push_back(this);
+            }
+
+            ~thread_cache() {
+                pool& p = global();
+                std::lock_guard<std::mutex> l(p.m_lock);
+
+                for (uint32_t i = 0; i < m_size; ++i) {
+                    p.m_free.push_back(m_free[i]);
+                }
+
+                for (auto it = p.m_caches.begin(); it != p.m_caches.end(); ++it) {
+                    if (*it == this) {
+                        p.m_caches.erase(it);
+                        break;
+                    }
+                }
+            }
+        };
+
+        thread_local thread_cache t_cache;
+
+        /** Map a new slab, requires the pool lock */
+        bool slab_map(pool& p) {
+            // over-allocate so the slab can be aligned on a huge page boundary
+            const size_t size = BLOCK_SLAB_SIZE * 2;
+            char* mem = static_cast<char*>(mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0));
+
+            if (mem == MAP_FAILED) {
+                perror("Unable to map block slab");
+                return false;
+            }
+
+            char* slab = reinterpret_cast<char*>(
+                (reinterpret_cast<uintptr_t>(mem) + BLOCK_SLAB_SIZE - 1) & ~static_cast<uintptr_t>(BLOCK_SLAB_SIZE - 1)
+            );
+
+            // hand back the unaligned head and tail
+            if (slab != mem)
+                munmap(mem, slab - mem);
+
+            if (slab + BLOCK_SLAB_SIZE != mem + size)
+                munmap(slab + BLOCK_SLAB_SIZE, (mem + size) - (slab + BLOCK_SLAB_SIZE));
+
+#ifdef MADV_HUGEPAGE
+            madvise(slab, BLOCK_SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+
+            p.m_slabs.push_back(slab);
+            for (uint32_t i = slab_blocks; i > 0; --i) {
+                p.m_free.push_back(reinterpret_cast<block*>(slab + (i-1) * sizeof(block)));
+            }
+
+            return true;
+        }
+    }
+
+    block* block_alloc() {
+        thread_cache& c = t_cache;
+        uint32_t size = c.m_size.load(std::memory_order_relaxed);
+
+        if (size == 0) {
+            metrics_add(metric_pool_misses);
+
+            // refill half of the cache from the shared list
+            pool& p = global();
+            std::lock_guard<std::mutex> l(p.m_lock);
+
+            while (size < BLOCK_THREAD_CACHE / 2) {
+                if (p.m_free.empty() && !slab_map(p))
+                    break;
+
+                c.m_free[size++] = p.m_free.back();
+                p.m_free.pop_back();
+            }
+
+            // callers can't do without the block, as with a failed new
+            if (size == 0) {
+                fprintf(stderr, "Unable to allocate a block, %zu slabs are mapped\n", p.m_slabs.size());
+                abort();
+            }
+        } else {
+            metrics_add(metric_pool_hits);
+        }
+
+        block* ret = c.m_free[--size];
+        c.m_size.store(size, std::memory_order_relaxed);
+
+        return new (ret) block();
+    }
+
+    void block_free(block* b) {
+        if (!b)
+            return;
+
+        thread_cache& c = t_cache;
+        uint32_t size = c.m_size.load(std::memory_order_relaxed);
+
+        if (size == BLOCK_THREAD_CACHE) {
+            // return the older half to the shared list
+            pool& p = global();
+            std::lock_guard<std::mutex> l(p.m_lock);
+
+            for (uint32_t i = 0; i < BLOCK_THREAD_CACHE / 2; ++i) {
+                p.m_free.push_back(c.m_free[i]);
+                c.m_free[i] = c.m_free[i + BLOCK_THREAD_CACHE / 2];
+            }
+
+            size = BLOCK_THREAD_CACHE / 2;
+        }
+
+        b->~block();
+        c.m_free[size++] = b;
+        c.m_size.store(size, std::memory_order_relaxed);
+    }
+
+    block_pool_stats block_pool_occupancy() {
+        pool& p = global();
+        std::lock_guard<std::mutex> l(p.m_lock);
+
+        block_pool_stats ret;
+        ret.m_slabs = p.m_slabs.size();
+        ret.m_capacity = ret.m_slabs * slab_blocks;
+        ret.m_free = p.m_free.size();
+        ret.m_cached = 0;
+
+        for (auto c : p.m_caches) {
+            ret.m_cached += c->m_size.load(std::memory_order_relaxed);
+        }
+
+        ret.m_used = ret.m_capacity - ret.m_free - ret.m_cached;
+        return ret;
+    }
+} /* deltadb */
@@ -0,0 +1,67 @@
+/**
+ * @file block_pool.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_BLOCK_POOL_HPP
+#define DELTADB_DB_BLOCK_POOL_HPP
+
+#include <cstdint>
+
+/** Slab size, matches a transparent huge page */
+#define BLOCK_SLAB_SIZE (2 * 1024 * 1024)
+
+/** Number of free blocks a thread keeps before returning them to the pool */
+#define BLOCK_THREAD_CACHE 32
+
+namespace deltadb {
+    // forward decl
+    struct block;
+
+    /** Block pool occupancy */
+    struct block_pool_stats {
+        /** Number of slabs mapped */
+        uint64_t m_slabs;
+        /** Total number of blocks in all slabs */
+        uint64_t m_capacity;
+        /** Blocks handed out */
+        uint64_t m_used;
+        /** Free blocks in the shared list */
+        uint64_t m_free;
+        /** Free blocks in per thread lists */
+        uint64_t m_cached;
+    };
+
+    /**
+     * Returns an empty block.
+     *
+     * Blocks come from huge page backed slabs and are recycled through a per thread free
+     * list first, only refilling from the shared list when that runs dry. Aborts if no
+     * slab can be mapped, it never returns nullptr.
+     */
+    block* block_alloc();
+
+    /** Return block to the pool */
+    void block_free(block* b);
+
+    /** Returns current pool occupancy */
+    block_pool_stats block_pool_occupancy();
+} /* deltadb */
+
+#endif /* DELTADB_DB_BLOCK_POOL_HPP */
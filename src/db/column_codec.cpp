@@ -0,0 +1,552 @@
+/**
+ * @file column_codec.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "../internal/bitstream.hpp"
+#include "column_codec.hpp"
+
+namespace deltadb {
+    namespace {
+        /** Load a value of W bytes */
+        template <uint32_t W>
+        inline uint64_t column_load(const char* src) {
+            uint64_t ret = 0;
+            memcpy(&ret, src, W);
+            return ret;
+        }
+
+        /** Bits used by a value of W bytes */
+        template <uint32_t W>
+        inline uint64_t column_mask() {
+            return W == 8 ? ~0ull : (1ull << (W * 8)) - 1;
+        }
+
+        /** Sign bit of a value of W bytes */
+        template <uint32_t W>
+        inline uint64_t column_sign() {
+            return 1ull << (W * 8 - 1);
+        }
+
+        /** Zigzag encoded difference of two values of W bytes, wrapping at the width */
+        template <uint32_t W>
+        inline uint64_t column_diff(uint64_t v, uint64_t prev) {
+            const int64_t d = (int64_t)((v - prev) << (64 - W * 8)) >> (64 - W * 8);
+            return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+        }
+
+        /** Apply a zigzag encoded difference */
+        template <uint32_t W>
+        inline uint64_t column_undiff(uint64_t prev, uint64_t z) {
+            return (prev + ((z >> 1) ^ (0 - (z & 1)))) & column_mask<W>();
+        }
+
+        /** Bits needed for v */
+        inline uint32_t bit_width(uint64_t v) {
+            return v ? 64 - __builtin_clzll(v) : 0;
+        }
+
+        /** Mask of the lower bits of a value */
+        inline uint64_t bit_mask(uint32_t bits) {
+            return bits == 64 ? ~0ull : (1ull << bits) - 1;
+        }
+
+        /** Base and bit width of a frame of reference */
+        struct for_frame {
+            uint64_t m_base;
+            uint32_t m_bits;
+        };
+
+        /** Narrowest frame of the values, with the minimum taken in signed or unsigned order */
+        template <uint32_t W>
+        for_frame frame(const uint64_t* values, uint32_t count) {
+            uint64_t umin = ~0ull, umax = 0, smin = ~0ull, smax = 0;
+
+            for (uint32_t i = 0; i < count; ++i) {
+                const uint64_t k = values[i] ^ column_sign<W>();
+                umin = std::min(umin, values[i]);
+                umax = std::max(umax, values[i]);
+                smin = std::min(smin, k);
+                smax = std::max(smax, k);
+            }
+
+            if (count == 0)
+                return {0, 0};
+
+            if (smax - smin < umax - umin)
+                return {smin ^ column_sign<W>(), bit_width(smax - smin)};
+
+            return {umin, bit_width(umax - umin)};
+        }
+
+        /** Bytes of a frame of reference run */
+        template <uint32_t W>
+        inline uint32_t for_size(uint32_t count, uint32_t bits) {
+            return 1 + W + ((uint64_t)count * bits + 7) / 8;
+        }
+
+        template <uint32_t W>
+        column_stats analyze(const uint64_t* values, uint32_t count) {
+            column_stats s = {count, 0, 0, 0, 0};
+            uint64_t prev = 0;
+            uint32_t run = 0;
+
+            for (uint32_t i = 0; i < count; ++i) {
+                s.m_delta += varint_size(column_diff<W>(values[i], prev));
+
+                if (i == 0 || values[i] != prev) {
+                    if (run)
+                        s.m_rle += W + varint_size(run);
+
+                    ++s.m_runs;
+                    run = 0;
+                }
+
+                prev = values[i];
+                ++run;
+            }
+
+            if (run)
+                s.m_rle += W + varint_size(run);
+
+            s.m_for = for_size<W>(count, frame<W>(values, count).m_bits);
+            return s;
+        }
+
+        template <uint32_t W>
+        uint32_t encode_raw(const uint64_t* values, uint32_t count, char* dst) {
+            for (uint32_t i = 0; i < count; ++i) {
+                memcpy(dst + i * W, &values[i], W);
+            }
+
+            return count * W;
+        }
+
+        template <uint32_t W>
+        bool decode_raw(const char* src, uint32_t size, uint32_t count, uint64_t* out) {
+            if (size != count * W)
+                return false;
+
+            for (uint32_t i = 0; i < count; ++i) {
+                out[i] = column_load<W>(src + i * W);
+            }
+
+            return true;
+        }
+
+        template <uint32_t W>
+        uint32_t encode_delta(const uint64_t* values, uint32_t count, char* dst) {
+            uint32_t n = 0;
+            uint64_t prev = 0;
+
+            for (uint32_t i = 0; i < count; ++i) {
+                n += varint_write(dst + n, column_diff<W>(values[i], prev));
+                prev = values[i];
+            }
+
+            return n;
+        }
+
+        template <uint32_t W>
+        bool decode_delta(const char* src, uint32_t size, uint32_t count, uint64_t* out) {
+            const char* end = src + size;
+            uint64_t prev = 0;
+
+            for (uint32_t i = 0; i < count; ++i) {
+                uint64_t z;
+                if (!varint_read(src, end, z))
+                    return false;
+
+                prev = column_undiff<W>(prev, z);
+                out[i] = prev;
+            }
+
+            return src == end;
+        }
+
+        template <uint32_t W>
+        uint32_t encode_rle(const uint64_t* values, uint32_t count, char* dst) {
+            uint32_t n = 0;
+
+            for (uint32_t i = 0; i < count;) {
+                uint32_t run = 1;
+                while (i + run < count && values[i + run] == values[i]) {
+                    ++run;
+                }
+
+                memcpy(dst + n, &values[i], W);
+                n += W;
+                n += varint_write(dst + n, run);
+                i += run;
+            }
+
+            return n;
+        }
+
+        template <uint32_t W>
+        bool decode_rle(const char* src, uint32_t size, uint32_t count, uint64_t* out) {
+            const char* end = src + size;
+
+            for (uint32_t i = 0; i < count;) {
+                if ((uint32_t)(end - src) < W)
+                    return false;
+
+                const uint64_t v = column_load<W>(src);
+                src += W;
+
+                uint64_t run;
+                if (!varint_read(src, end, run) || run == 0 || run > count - i)
+                    return false;
+
+                for (uint64_t j = 0; j < run; ++j) {
+                    out[i++] = v;
+                }
+            }
+
+            return src == end;
+        }
+
+        /** Write up to 64 bits */
+        inline void write_bits(bitstream& b, uint32_t bits, uint64_t v) {
+            if (bits > 32) {
+                b.write(32, (uint32_t)v);
+                b.write(bits - 32, (uint32_t)(v >> 32));
+            } else if (bits) {
+                b.write(bits, (uint32_t)v);
+            }
+        }
+
+        template <uint32_t W>
+        uint32_t encode_for(const uint64_t* values, uint32_t count, char* dst) {
+            assert(((uintptr_t)dst & 3) == 0);
+
+            const for_frame f = frame<W>(values, count);
+            const uint32_t size = for_size<W>(count, f.m_bits);
+            bitstream b((bitstream::word_t*)dst, (size + 3) & ~3u, bitstream::mode::io_writer);
+
+            b.write(8, f.m_bits);
+            write_bits(b, W * 8, f.m_base);
+
+            for (uint32_t i = 0; i < count; ++i) {
+                write_bits(b, f.m_bits, (values[i] - f.m_base) & column_mask<W>());
+            }
+
+            return size;
+        }
+
+        /** Unpacks count values of a fixed bit width from bytes at src */
+        typedef void (*unpack_fn)(const char* src, uint32_t bytes, uint32_t count, uint64_t* out);
+
+        /** Reads bits at bit offset pos without touching anything past bytes */
+        inline uint64_t unpack_one(const char* src, uint32_t bytes, uint64_t pos, uint32_t bits) {
+            const uint32_t first = pos >> 3;
+            const uint32_t shift = pos & 7;
+            unsigned __int128 acc = 0;
+
+            for (uint32_t k = 0; k < (shift + bits + 7) / 8 && first + k < bytes; ++k) {
+                acc |= (unsigned __int128)(uint8_t)src[first + k] << (8 * k);
+            }
+
+            return (uint64_t)(acc >> shift) & bit_mask(bits);
+        }
+
+        /**
+         * Unpack kernel of a bit width known at compile time.
+         *
+         * Groups of 8 values start on a byte, so every load and shift inside a group is a
+         * constant and the loop unrolls into straight line code. Values that could make a
+         * load run past the end, and widths above 56 bits, go through unpack_one.
+         */
+        template <uint32_t B>
+        void unpack(const char* src, uint32_t bytes, uint32_t count, uint64_t* out) {
+            uint32_t i = 0;
+
+            if (B == 0) {
+                std::fill(out, out + count, 0);
+                return;
+            }
+
+            if (B <= 56) {
+                constexpr uint64_t mask = (1ull << (B % 64)) - 1;
+                constexpr uint32_t reach = (7 * B) / 8 + 8;
+                const uint32_t groups = bytes >= reach ? std::min(count / 8, (bytes - reach) / (B ? B : 1) + 1) : 0;
+
+                for (uint32_t g = 0; g < groups; ++g) {
+                    const char* p = src + g * B;
+                    uint64_t* o = out + g * 8;
+
+                    for (uint32_t j = 0; j < 8; ++j) {
+                        uint64_t w;
+                        memcpy(&w, p + (j * B) / 8, sizeof(w));
+                        o[j] = (w >> ((j * B) & 7)) & mask;
+                    }
+                }
+
+                i = groups * 8;
+            }
+
+            for (; i < count; ++i) {
+                out[i] = unpack_one(src, bytes, (uint64_t)i * B, B);
+            }
+        }
+
+        template <uint32_t... B>
+        std::array<unpack_fn, sizeof...(B)> unpack_table(std::integer_sequence<uint32_t, B...>) {
+            return {{unpack<B>...}};
+        }
+
+        /** Unpack kernels by bit width */
+        const std::array<unpack_fn, 65> g_unpack = unpack_table(std::make_integer_sequence<uint32_t, 65>());
+
+        template <uint32_t W>
+        bool decode_for(const char* src, uint32_t size, uint32_t count, uint64_t* out) {
+            if (size < 1 + W)
+                return false;
+
+            const uint32_t bits = (uint8_t)src[0];
+            if (bits > W * 8 || size != for_size<W>(count, bits))
+                return false;
+
+            const uint64_t base = column_load<W>(src + 1);
+            g_unpack[bits](src + 1 + W, size - 1 - W, count, out);
+
+            for (uint32_t i = 0; i < count; ++i) {
+                out[i] = (out[i] + base) & column_mask<W>();
+            }
+
+            return true;
+        }
+
+        /** Converts the bounds of a range to keys in unsigned order, false if nothing can match */
+        template <uint32_t W>
+        bool select_keys(uint64_t lo, uint64_t hi, bool is_signed, uint64_t& klo, uint64_t& khi) {
+            const uint64_t mask = column_mask<W>();
+
+            if (is_signed) {
+                const int64_t smax = (int64_t)(mask >> 1);
+                const int64_t l = std::max((int64_t)lo, -smax - 1);
+                const int64_t h = std::min((int64_t)hi, smax);
+                if (l > h)
+                    return false;
+
+                klo = ((uint64_t)l & mask) ^ column_sign<W>();
+                khi = ((uint64_t)h & mask) ^ column_sign<W>();
+            } else {
+                if (lo > hi || lo > mask)
+                    return false;
+
+                klo = lo;
+                khi = std::min(hi, mask);
+            }
+
+            return true;
+        }
+
+        /** Sets the bits of values within [lo, hi], returns the number of matches */
+        inline uint32_t select_values(const uint64_t* values, uint32_t count, uint64_t lo, uint64_t hi, uint64_t* match) {
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < count; i += 64) {
+                const uint32_t end = std::min(count - i, 64u);
+                uint64_t bits = 0;
+
+                for (uint32_t j = 0; j < end; ++j) {
+                    bits |= (uint64_t)(values[i + j] - lo <= hi - lo) << j;
+                }
+
+                match[i >> 6] = bits;
+                n += __builtin_popcountll(bits);
+            }
+
+            return n;
+        }
+
+        template <uint32_t W, column_decode_fn D>
+        uint32_t select_decoded(const char* src, uint32_t size, uint32_t count, uint64_t lo, uint64_t hi,
+            bool is_signed, uint64_t* match)
+        {
+            memset(match, 0, (count + 63) / 64 * sizeof(uint64_t));
+
+            uint64_t klo, khi;
+            if (!select_keys<W>(lo, hi, is_signed, klo, khi))
+                return 0;
+
+            std::vector<uint64_t> values(count);
+            const bool ok = D(src, size, count, values.data());
+            assert(ok);
+            (void)ok;
+
+            if (is_signed) {
+                for (auto &v : values) {
+                    v ^= column_sign<W>();
+                }
+            }
+
+            return select_values(values.data(), count, klo, khi, match);
+        }
+
+        template <uint32_t W>
+        uint32_t select_for(const char* src, uint32_t size, uint32_t count, uint64_t lo, uint64_t hi,
+            bool is_signed, uint64_t* match)
+        {
+            memset(match, 0, (count + 63) / 64 * sizeof(uint64_t));
+
+            uint64_t klo, khi;
+            if (!select_keys<W>(lo, hi, is_signed, klo, khi))
+                return 0;
+
+            const uint32_t bits = (uint8_t)src[0];
+            const uint64_t range = bit_mask(bits);
+            const uint64_t kbase = column_load<W>(src + 1) ^ (is_signed ? column_sign<W>() : 0);
+
+            // the frame wraps around in this order, offsets are not monotonic
+            if (range > column_mask<W>() - kbase)
+                return select_decoded<W, decode_for<W>>(src, size, count, lo, hi, is_signed, match);
+
+            if (khi < kbase || klo > kbase + range)
+                return 0;
+
+            // translate the range to offsets from the base
+            const uint64_t olo = klo > kbase ? klo - kbase : 0;
+            const uint64_t ohi = std::min(khi, kbase + range) - kbase;
+
+            if (olo == 0 && ohi == range) {
+                for (uint32_t i = 0; i < count; i += 64) {
+                    match[i >> 6] = count - i >= 64 ? ~0ull : bit_mask(count - i);
+                }
+
+                return count;
+            }
+
+            // 64 packed values take 8 * bits bytes, unpack a match word at a time
+            const char* packed = src + 1 + W;
+            const uint32_t bytes = size - 1 - W;
+            uint64_t offsets[64];
+            uint32_t n = 0;
+
+            for (uint32_t i = 0; i < count; i += 64) {
+                const uint32_t at = (i / 8) * bits;
+                g_unpack[bits](packed + at, bytes - at, std::min(count - i, 64u), offsets);
+                n += select_values(offsets, std::min(count - i, 64u), olo, ohi, match + (i >> 6));
+            }
+
+            return n;
+        }
+
+        /** Index of a width in the codec tables */
+        inline uint32_t width_index(uint32_t width) {
+            assert(width == 1 || width == 2 || width == 4 || width == 8);
+            return __builtin_ctz(width);
+        }
+
+        const column_encode_fn g_encoders[column_codecs][4] = {
+            {encode_raw<1>, encode_raw<2>, encode_raw<4>, encode_raw<8>},
+            {encode_delta<1>, encode_delta<2>, encode_delta<4>, encode_delta<8>},
+            {encode_rle<1>, encode_rle<2>, encode_rle<4>, encode_rle<8>},
+            {encode_for<1>, encode_for<2>, encode_for<4>, encode_for<8>}
+        };
+
+        const column_decode_fn g_decoders[column_codecs][4] = {
+            {decode_raw<1>, decode_raw<2>, decode_raw<4>, decode_raw<8>},
+            {decode_delta<1>, decode_delta<2>, decode_delta<4>, decode_delta<8>},
+            {decode_rle<1>, decode_rle<2>, decode_rle<4>, decode_rle<8>},
+            {decode_for<1>, decode_for<2>, decode_for<4>, decode_for<8>}
+        };
+
+        const column_select_fn g_selectors[column_codecs][4] = {
+            {select_decoded<1, decode_raw<1>>, select_decoded<2, decode_raw<2>>,
+             select_decoded<4, decode_raw<4>>, select_decoded<8, decode_raw<8>>},
+            {select_decoded<1, decode_delta<1>>, select_decoded<2, decode_delta<2>>,
+             select_decoded<4, decode_delta<4>>, select_decoded<8, decode_delta<8>>},
+            {select_decoded<1, decode_rle<1>>, select_decoded<2, decode_rle<2>>,
+             select_decoded<4, decode_rle<4>>, select_decoded<8, decode_rle<8>>},
+            {select_for<1>, select_for<2>, select_for<4>, select_for<8>}
+        };
+    }
+
+    column_stats column_analyze(const uint64_t* values, uint32_t count, uint32_t width) {
+        switch (width) {
+        case 1:
+            return analyze<1>(values, count);
+        case 2:
+            return analyze<2>(values, count);
+        case 4:
+            return analyze<4>(values, count);
+        default:
+            assert(width == 8);
+            return analyze<8>(values, count);
+        }
+    }
+
+    uint32_t column_size(const column_stats& s, uint8_t codec, uint32_t width) {
+        switch (codec) {
+        case column_delta:
+            return s.m_delta;
+        case column_rle:
+            return s.m_rle;
+        case column_for:
+            return s.m_for;
+        default:
+            return s.m_count * width;
+        }
+    }
+
+    uint8_t column_choose(const column_stats& s, uint32_t width) {
+        const uint32_t raw = column_size(s, column_raw, width);
+        uint8_t ret = column_raw;
+        uint32_t size = raw - raw / 16;
+
+        for (uint8_t c = column_raw + 1; c < column_codecs; ++c) {
+            const uint32_t cs = column_size(s, c, width);
+            if (cs < size) {
+                ret = c;
+                size = cs;
+            }
+        }
+
+        return ret;
+    }
+
+    column_encode_fn column_encoder(uint8_t codec, uint32_t width) {
+        assert(codec < column_codecs);
+        return g_encoders[codec][width_index(width)];
+    }
+
+    column_decode_fn column_decoder(uint8_t codec, uint32_t width) {
+        assert(codec < column_codecs);
+        return g_decoders[codec][width_index(width)];
+    }
+
+    column_select_fn column_selector(uint8_t codec, uint32_t width) {
+        assert(codec < column_codecs);
+        return g_selectors[codec][width_index(width)];
+    }
+
+    const char* column_codec_name(uint8_t codec) {
+        static const char* names[] = {"raw", "delta", "rle", "for"};
+        return codec < column_codecs ? names[codec] : "invalid";
+    }
+} /* deltadb */
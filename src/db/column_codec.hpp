@@ -0,0 +1,142 @@
+/**
+ * @file column_codec.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_COLUMN_CODEC_HPP
+#define DELTADB_DB_COLUMN_CODEC_HPP
+
+#include <cstdint>
+
+namespace deltadb {
+    /**
+     * Codecs of the fixed width value runs in PAX blocks.
+     *
+     * A codec is chosen per column each time a block is transposed, based on statistics of
+     * the values in that block, and recorded in the column directory. Values are handled as
+     * zero extended bit patterns of 1, 2, 4 or 8 bytes, arithmetic wraps at the width.
+     */
+    enum column_codec_id {
+        /** Values as they are, width bytes each */
+        column_raw = 0,
+        /** Zigzag varint of the difference to the previous value, the first to 0 */
+        column_delta,
+        /** Runs of equal values, width bytes of value followed by a varint run length */
+        column_rle,
+        /**
+         * Frame of reference: a byte with the bit width, width bytes of base, then the
+         * offset of every value to the base packed at that bit width
+         */
+        column_for,
+        /** Number of codecs */
+        column_codecs
+    };
+
+    /** Statistics of a run of values, gathered on seal to choose a codec */
+    struct column_stats {
+        /** Number of values */
+        uint32_t m_count;
+        /** Number of runs of equal values */
+        uint32_t m_runs;
+        /** Bytes as column_delta */
+        uint32_t m_delta;
+        /** Bytes as column_rle */
+        uint32_t m_rle;
+        /** Bytes as column_for */
+        uint32_t m_for;
+    };
+
+    /** Encodes count values into dst, returns the number of bytes written */
+    typedef uint32_t (*column_encode_fn)(const uint64_t* values, uint32_t count, char* dst);
+
+    /** Decodes count values from size bytes at src, returns false if the run is malformed */
+    typedef bool (*column_decode_fn)(const char* src, uint32_t size, uint32_t count, uint64_t* out);
+
+    /**
+     * Sets bit i of match for every value i within [lo, hi] and returns the number of matches.
+     *
+     * Values compare signed if is_signed, lo and hi are sign extended then. match has to hold
+     * count bits and is cleared first. The run has to be valid.
+     */
+    typedef uint32_t (*column_select_fn)(const char* src, uint32_t size, uint32_t count, uint64_t lo, uint64_t hi,
+        bool is_signed, uint64_t* match);
+
+    /** Gather statistics of count values of width bytes */
+    column_stats column_analyze(const uint64_t* values, uint32_t count, uint32_t width);
+
+    /** Returns the encoded size of values described by s */
+    uint32_t column_size(const column_stats& s, uint8_t codec, uint32_t width);
+
+    /**
+     * Returns the codec with the smallest encoding.
+     *
+     * Raw decodes fastest and is kept unless another codec saves at least 1/16 of its size.
+     */
+    uint8_t column_choose(const column_stats& s, uint32_t width);
+
+    /** Returns the encoder of codec for values of width bytes */
+    column_encode_fn column_encoder(uint8_t codec, uint32_t width);
+
+    /** Returns the decoder of codec for values of width bytes */
+    column_decode_fn column_decoder(uint8_t codec, uint32_t width);
+
+    /**
+     * Returns the range selector of codec for values of width bytes.
+     *
+     * Frame of reference runs are compared on the packed offsets without adding the base,
+     * others are decoded first.
+     */
+    column_select_fn column_selector(uint8_t codec, uint32_t width);
+
+    /** Returns the name of codec */
+    const char* column_codec_name(uint8_t codec);
+
+    /** Bytes of v as varint */
+    inline uint32_t varint_size(uint64_t v) {
+        return (64 - __builtin_clzll(v | 1) + 6) / 7;
+    }
+
+    /** Write v as varint, returns bytes written */
+    inline uint32_t varint_write(char* dst, uint64_t v) {
+        uint32_t n = 0;
+        while (v >= 0x80) {
+            dst[n++] = (char)(v | 0x80);
+            v >>= 7;
+        }
+
+        dst[n++] = (char)v;
+        return n;
+    }
+
+    /** Read a varint, returns false if it exceeds end or 10 bytes */
+    inline bool varint_read(const char*& src, const char* end, uint64_t& v) {
+        v = 0;
+        for (uint32_t shift = 0; shift < 70 && src < end; shift += 7) {
+            const uint8_t b = *src++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+
+            if (!(b & 0x80))
+                return true;
+        }
+
+        return false;
+    }
+} /* deltadb */
+
+#endif /* DELTADB_DB_COLUMN_CODEC_HPP */
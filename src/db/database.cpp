@@ -32,11 +32,14 @@
 #include "table.hpp"
 #include "table_col.hpp"
 #include "database.hpp"
+#include "metrics.hpp"
 
 namespace deltadb {
-    bool database::open() {
+    bool database::open(const char* path) {
+        metrics_timer timer(hist_database_open);
+
         // Set cwd to data directory
-        if (chdir(DELTADB_PATH_DATA) != 0) {
+        if (chdir(path) != 0) {
             perror("Unable to set cwd");
             return false;
         }
@@ -59,6 +62,7 @@ namespace deltadb {
                 if (strcmp(file->d_name+(strlen(file->d_name)-3), "tbl") == 0) {
                     auto tbl_name = std::string(file->d_name, strlen(file->d_name)-4);
                     m_tables[tbl_name] = new table(tbl_name);
+                    metrics_add(metric_tables_opened);
                 }
             }
 
@@ -77,22 +81,22 @@ namespace deltadb {
         m_lock.release();
     }
 
-    void database::create(const char* name, col** t, uint32_t len) {
+    void database::create(const char* name, col** t, uint32_t len, uint8_t flags) {
         std::string frm = std::string(name)+".tbl";
         if (file_exists(frm.c_str())) {
             return; // @todo: error
         }
 
         table* t2 = new table(std::string(name));
-        t2->set_columns(t, len);
+        t2->set_columns(t, len, flags);
         m_tables[std::string(name)] = t2;
     }
 
-    void database::write_row(const char* table, row* r) {
+    bool database::write_row(const char* table, row* r) {
         auto tbl = m_tables.find(table);
         assert(tbl != m_tables.end());
 
         class table* t = tbl->second;
-        t->write(r);
+        return t->write(r);
     }
 }
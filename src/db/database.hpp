@@ -28,12 +28,13 @@
 
 #include <boost/noncopyable.hpp>
 
+#include "../config.hpp"
 #include "../internal/filesystem.hpp"
+#include "table_col.hpp"
 
 namespace deltadb {
     // forward decl
     class table;
-    struct col;
     struct row;
 
     class database : private boost::noncopyable {
@@ -46,17 +47,17 @@ namespace deltadb {
             close();
         }
 
-        /** Open the database */
-        bool open();
+        /** Open the database in the given data directory */
+        bool open(const char* path = DELTADB_PATH_DATA);
 
         /** Close database */
         void close();
 
-        /** Create a new table */
-        void create(const char* name, col** t, uint32_t len);
+        /** Create a new table with the given table_flags */
+        void create(const char* name, col** t, uint32_t len, uint8_t flags = table_compact_masks);
 
-        /** Append a new row to the table */
-        void write_row(const char* table, row* r);
+        /** Append a new row to the table, returns false if it does not fit into a block */
+        bool write_row(const char* table, row* r);
     private:
         /** Database lock */
         filelock m_lock;
@@ -0,0 +1,542 @@
+/**
+ * @file export.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../internal/arena.hpp"
+#include "../internal/bitfield.hpp"
+#include "../internal/format.hpp"
+#include "block.hpp"
+#include "export.hpp"
+#include "table.hpp"
+#include "table_col.hpp"
+#include "table_row.hpp"
+
+namespace deltadb {
+    namespace {
+        /** First pass result for a single block */
+        struct block_summary {
+            /** Rows in the block */
+            uint64_t m_rows;
+            /** Fields set at least once */
+            bitfield m_set;
+            /** Last value of every field set */
+            std::vector<row_value> m_last;
+            /** Copies of the last strings and bytes */
+            std::vector<std::string> m_data;
+            /** Row of the first set of every field */
+            std::vector<uint32_t> m_first;
+            /** Size of strings and bytes from their first set on */
+            std::vector<uint64_t> m_size;
+        };
+
+        /** Returns the size of a string or bytes value */
+        inline uint32_t value_size(const row_value& v) {
+            return v.m_type == col_string ? strlen(v.m_value.v_bytes) : v.m_size;
+        }
+
+        /** Whether type is stored as string or bytes */
+        inline bool is_variable(uint8_t type) {
+            return type == col_string || type == col_bytes;
+        }
+
+        /** Calls fn(i, arena&) for i in [begin, end) on up to threads threads */
+        template <typename F>
+        void parallel_for(uint32_t threads, uint32_t begin, uint32_t end, F&& fn) {
+            threads = std::max<uint32_t>(1, std::min(threads, end - begin));
+            std::atomic<uint32_t> next(begin);
+
+            auto work = [&]() {
+                arena a;
+                for (uint32_t i = next++; i < end; i = next++) {
+                    fn(i, a);
+                }
+            };
+
+            if (threads == 1) {
+                work();
+                return;
+            }
+
+            std::vector<std::thread> workers;
+            for (uint32_t i = 0; i < threads; ++i) {
+                workers.push_back(std::thread(work));
+            }
+
+            for (auto &w : workers) {
+                w.join();
+            }
+        }
+
+        /** Write all of [data, data + size) at off */
+        bool write_at(int fd, const void* data, size_t size, uint64_t off) {
+            const char* p = static_cast<const char*>(data);
+
+            while (size) {
+                const ssize_t n = pwrite(fd, p, size, off);
+                if (n <= 0)
+                    return false;
+
+                p += n;
+                size -= n;
+                off += n;
+            }
+
+            return true;
+        }
+
+        /**
+         * Resolves inherited fields block by block.
+         *
+         * summarize() decodes all blocks once in parallel and derives the state every block
+         * starts with. Afterwards resolve() can run for any block in any order.
+         */
+        class resolver {
+        public:
+            /** Columns */
+            std::vector<col*> m_cols;
+            /** Blocks in order */
+            std::vector<block*> m_blocks;
+            /** First pass results */
+            std::vector<block_summary> m_summary;
+            /** Field values each block starts with */
+            std::vector<std::vector<row_value>> m_entry;
+            /** Fields known when each block starts */
+            std::vector<bitfield> m_known;
+            /** First row of each block */
+            std::vector<uint64_t> m_start;
+            /** Total number of rows */
+            uint64_t m_rows;
+            /** Worker threads */
+            uint32_t m_threads;
+
+            /** Constructor */
+            resolver(table& t, uint32_t threads)
+                : m_cols(t.columns()), m_blocks(t.blocks()), m_rows(0),
+                  m_threads(threads ? threads : std::thread::hardware_concurrency()), m_table(t) {}
+
+            /** First pass */
+            void summarize() {
+                const uint32_t n = m_blocks.size();
+                const uint32_t cols = m_cols.size();
+                m_summary.resize(n);
+
+                parallel_for(m_threads, 0, n, [&](uint32_t i, arena& a) {
+                    block_summary& s = m_summary[i];
+                    s.m_rows = 0;
+                    s.m_set.reset();
+                    s.m_last.resize(cols);
+                    s.m_data.resize(cols);
+                    s.m_first.assign(cols, UINT32_MAX);
+                    s.m_size.assign(cols, 0);
+
+                    std::vector<uint32_t> size(cols, 0);
+
+                    auto fn = [&](row* r) {
+                        for (auto &v : r->m_data) {
+                            fetch(v, a);
+
+                            if (!s.m_set.at(v.m_pos)) {
+                                s.m_set.set(v.m_pos);
+                                s.m_first[v.m_pos] = s.m_rows;
+                            }
+
+                            s.m_last[v.m_pos] = v;
+                            if (is_variable(v.m_type)) {
+                                size[v.m_pos] = value_size(v);
+                                s.m_data[v.m_pos].assign(v.m_value.v_bytes, size[v.m_pos]);
+                            }
+                        }
+
+                        for (uint32_t c = 0; c < cols; ++c) {
+                            s.m_size[c] += size[c];
+                        }
+
+                        ++s.m_rows;
+                    };
+
+                    m_table.scan_block(m_blocks[i], fn, a);
+
+                    // the arena is gone, point at the copies
+                    for (uint32_t c = 0; c < cols; ++c) {
+                        if (s.m_set.at(c) && is_variable(m_cols[c]->type())) {
+                            s.m_data[c].push_back('\0');
+                            s.m_last[c].m_value.v_bytes = &s.m_data[c][0];
+                        }
+                    }
+                });
+
+                // each block starts with what the previous one ended with
+                m_entry.assign(n, std::vector<row_value>(cols));
+                m_known.assign(n, bitfield());
+                m_start.assign(n, 0);
+
+                for (uint32_t i = 0; i < n; ++i) {
+                    m_start[i] = m_rows;
+                    m_rows += m_summary[i].m_rows;
+
+                    if (i + 1 == n)
+                        break;
+
+                    m_entry[i + 1] = m_entry[i];
+                    m_known[i + 1] = m_known[i];
+                    m_known[i + 1] |= m_summary[i].m_set;
+
+                    for (uint32_t c = 0; c < cols; ++c) {
+                        if (m_summary[i].m_set.at(c))
+                            m_entry[i + 1][c] = m_summary[i].m_last[c];
+                    }
+                }
+            }
+
+            /** Calls fn(state, known) for every row of block i, state holds every known field */
+            template <typename F>
+            void resolve(uint32_t i, arena& a, F&& fn) {
+                std::vector<row_value> state(m_entry[i]);
+                bitfield known = m_known[i];
+
+                auto step = [&](row* r) {
+                    for (auto &v : r->m_data) {
+                        fetch(v, a);
+                        state[v.m_pos] = v;
+                    }
+
+                    known |= r->m_fields;
+                    fn(state.data(), known);
+                };
+
+                m_table.scan_block(m_blocks[i], step, a);
+            }
+
+            /** Returns size of column c's strings or bytes in block i after resolving */
+            uint64_t resolved_size(uint32_t i, uint32_t c) {
+                const block_summary& s = m_summary[i];
+                const uint64_t inherited = m_known[i].at(c) ? value_size(m_entry[i][c]) : 0;
+
+                if (s.m_set.at(c))
+                    return s.m_first[c] * inherited + s.m_size[c];
+
+                return s.m_rows * inherited;
+            }
+        private:
+            /** Table */
+            table& m_table;
+
+            /** Fetches a large value of a blob column, one that can't be read is exported empty */
+            void fetch(row_value& v, arena& a) {
+                if (v.m_type == BLOB_REF && !m_table.fetch(v, a)) {
+                    fprintf(stderr, "Unable to read a blob of column %s\n", m_cols[v.m_pos]->m_name);
+                    v.m_type = col_bytes;
+                    v.m_size = 0;
+                    v.m_value.v_bytes = const_cast<char*>("");
+                }
+            }
+        };
+
+        /** Append a string or bytes field, quoted if required */
+        void csv_bytes(std::string& out, const char* s, uint32_t len, char delim) {
+            bool quote = false;
+            for (uint32_t i = 0; i < len && !quote; ++i) {
+                quote = s[i] == delim || s[i] == '"' || s[i] == '\n' || s[i] == '\r';
+            }
+
+            if (!quote) {
+                out.append(s, len);
+                return;
+            }
+
+            out.push_back('"');
+            for (uint32_t i = 0; i < len; ++i) {
+                if (s[i] == '"')
+                    out.push_back('"');
+
+                out.push_back(s[i]);
+            }
+            out.push_back('"');
+        }
+
+        /** Append a single field */
+        void csv_field(std::string& out, col* c, const row_value& v, char delim) {
+            char buf[FORMAT_MAX];
+            char* end = buf + sizeof(buf);
+            const bool u = c->is_unsigned();
+
+            switch (c->type()) {
+            case col_int8:
+                out.append(u ? format_uint(v.m_value.v_u8, end) : format_int(v.m_value.v_i8, end), end);
+                break;
+            case col_int16:
+                out.append(u ? format_uint(v.m_value.v_u16, end) : format_int(v.m_value.v_i16, end), end);
+                break;
+            case col_int32:
+                out.append(u ? format_uint(v.m_value.v_u32, end) : format_int(v.m_value.v_i32, end), end);
+                break;
+            case col_int64:
+                out.append(u ? format_uint(v.m_value.v_u64, end) : format_int(v.m_value.v_i64, end), end);
+                break;
+            case col_bool:
+                out.append(v.m_value.v_bool ? "true" : "false");
+                break;
+            case col_float:
+                out.append(buf, format_double(v.m_value.v_float, true, buf));
+                break;
+            case col_double:
+                out.append(buf, format_double(v.m_value.v_double, false, buf));
+                break;
+            case col_string:
+            case col_bytes:
+                csv_bytes(out, v.m_value.v_bytes, value_size(v), delim);
+                break;
+            }
+        }
+    }
+
+    bool export_csv(table& t, const char* path, const export_options& o, export_stats* stats) {
+        FILE* fp = fopen(path, "w");
+        if (!fp) {
+            perror("Unable to open export file");
+            return false;
+        }
+
+        resolver r(t, o.m_threads);
+        r.summarize();
+
+        const uint32_t cols = r.m_cols.size();
+        export_stats s = {r.m_rows, r.m_blocks.size(), 0};
+        bool ok = true;
+
+        if (o.m_header) {
+            std::string line;
+            for (uint32_t c = 0; c < cols; ++c) {
+                if (c)
+                    line.push_back(o.m_delimiter);
+
+                csv_bytes(line, r.m_cols[c]->m_name, strlen(r.m_cols[c]->m_name), o.m_delimiter);
+            }
+
+            line.push_back('\n');
+            ok = fwrite(line.data(), 1, line.size(), fp) == line.size();
+            s.m_bytes += line.size();
+        }
+
+        // format a window of blocks in parallel, then write them in order
+        const uint32_t n = r.m_blocks.size();
+        const uint32_t window = std::max<uint32_t>(1, r.m_threads * EXPORT_WINDOW);
+        std::vector<std::string> out(window);
+
+        for (uint32_t base = 0; base < n && ok; base += window) {
+            const uint32_t end = std::min(n, base + window);
+
+            parallel_for(r.m_threads, base, end, [&](uint32_t i, arena& a) {
+                std::string& buf = out[i - base];
+                buf.clear();
+                buf.reserve(block_used(r.m_blocks[i]) * 3);
+
+                r.resolve(i, a, [&](const row_value* state, const bitfield& known) {
+                    for (uint32_t c = 0; c < cols; ++c) {
+                        if (c)
+                            buf.push_back(o.m_delimiter);
+
+                        if (known.at(c))
+                            csv_field(buf, r.m_cols[c], state[c], o.m_delimiter);
+                    }
+
+                    buf.push_back('\n');
+                });
+            });
+
+            for (uint32_t i = base; i < end && ok; ++i) {
+                const std::string& buf = out[i - base];
+                ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+                s.m_bytes += buf.size();
+            }
+        }
+
+        if (fclose(fp) != 0)
+            ok = false;
+
+        if (!ok) {
+            perror("Unable to write export file");
+            return false;
+        }
+
+        if (stats)
+            *stats = s;
+
+        return true;
+    }
+
+    bool export_columnar(table& t, const char* path, const export_options& o, export_stats* stats) {
+        const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror("Unable to open export file");
+            return false;
+        }
+
+        resolver r(t, o.m_threads);
+        r.summarize();
+
+        const uint32_t n = r.m_blocks.size();
+        const uint32_t cols = r.m_cols.size();
+        const uint64_t rows = r.m_rows;
+
+        auto align = [](uint64_t off) {
+            return (off + EXPORT_COLUMNAR_ALIGN - 1) & ~(uint64_t)(EXPORT_COLUMNAR_ALIGN - 1);
+        };
+
+        // lay out all arrays, strings and bytes need every block's resolved size
+        columnar_header h = {EXPORT_COLUMNAR_MAGIC, EXPORT_COLUMNAR_VERSION, rows, cols, 0};
+        std::vector<columnar_column> dir(cols);
+        std::vector<std::vector<uint64_t>> var(cols); // start of each block's data
+
+        uint64_t off = sizeof(columnar_header) + cols * sizeof(columnar_column);
+
+        for (uint32_t c = 0; c < cols; ++c) {
+            columnar_column& d = dir[c];
+            memset(&d, 0, sizeof(d));
+            memcpy(d.m_name, r.m_cols[c]->m_name, sizeof(d.m_name));
+            d.m_name[sizeof(d.m_name) - 1] = '\0';
+            d.m_type = r.m_cols[c]->m_data;
+            d.m_width = col_width(r.m_cols[c]->type());
+
+            d.m_validity = align(off);
+            off = d.m_validity + (rows + 7) / 8;
+
+            if (is_variable(r.m_cols[c]->type())) {
+                d.m_offsets = align(off);
+                off = d.m_offsets + (rows + 1) * 8;
+
+                var[c].resize(n);
+                for (uint32_t i = 0; i < n; ++i) {
+                    var[c][i] = d.m_values_size;
+                    d.m_values_size += r.resolved_size(i, c);
+                }
+            } else {
+                d.m_values_size = rows * d.m_width;
+            }
+
+            d.m_values = align(off);
+            off = d.m_values + d.m_values_size;
+        }
+
+        std::atomic<bool> ok(ftruncate(fd, off) == 0);
+        ok = ok && write_at(fd, &h, sizeof(h), 0);
+        ok = ok && write_at(fd, dir.data(), cols * sizeof(columnar_column), sizeof(h));
+
+        // every block's slice of a column has a fixed position, so blocks are written as they finish
+        parallel_for(r.m_threads, 0, n, [&](uint32_t i, arena& a) {
+            const uint64_t count = r.m_summary[i].m_rows;
+            std::vector<std::vector<char>> values(cols);
+            std::vector<std::vector<int64_t>> offsets(cols);
+
+            for (uint32_t c = 0; c < cols; ++c) {
+                if (dir[c].m_offsets) {
+                    offsets[c].reserve(count);
+                    values[c].reserve(r.resolved_size(i, c));
+                } else {
+                    values[c].resize(count * dir[c].m_width);
+                }
+            }
+
+            uint64_t row = 0;
+            r.resolve(i, a, [&](const row_value* state, const bitfield& known) {
+                for (uint32_t c = 0; c < cols; ++c) {
+                    const bool set = known.at(c);
+
+                    if (dir[c].m_offsets) {
+                        offsets[c].push_back(var[c][i] + values[c].size());
+                        if (set)
+                            values[c].insert(values[c].end(), state[c].m_value.v_bytes,
+                                state[c].m_value.v_bytes + value_size(state[c]));
+                    } else if (set) {
+                        memcpy(&values[c][row * dir[c].m_width], &state[c].m_value, dir[c].m_width);
+                    }
+                }
+
+                ++row;
+            });
+
+            assert(row == count);
+            for (uint32_t c = 0; c < cols && ok; ++c) {
+                if (dir[c].m_offsets) {
+                    ok = ok && write_at(fd, offsets[c].data(), count * 8, dir[c].m_offsets + r.m_start[i] * 8);
+                    ok = ok && write_at(fd, values[c].data(), values[c].size(), dir[c].m_values + var[c][i]);
+                } else {
+                    ok = ok && write_at(fd, values[c].data(), values[c].size(),
+                        dir[c].m_values + r.m_start[i] * dir[c].m_width);
+                }
+            }
+        });
+
+        // a field stays valid once set, so validity is zero up to the first set and one after
+        for (uint32_t c = 0; c < cols && ok; ++c) {
+            uint64_t first = rows;
+            for (uint32_t i = 0; i < n; ++i) {
+                if (r.m_summary[i].m_set.at(c)) {
+                    first = r.m_start[i] + r.m_summary[i].m_first[c];
+                    break;
+                }
+            }
+
+            std::vector<uint8_t> bits((rows + 7) / 8, 0xFF);
+            std::fill(bits.begin(), bits.begin() + first / 8, 0);
+
+            if (first % 8)
+                bits[first / 8] = (uint8_t)(0xFF << (first % 8));
+
+            if (rows % 8)
+                bits.back() &= 0xFF >> (8 - rows % 8);
+
+            ok = ok && write_at(fd, bits.data(), bits.size(), dir[c].m_validity);
+
+            if (dir[c].m_offsets) {
+                const int64_t total = dir[c].m_values_size;
+                ok = ok && write_at(fd, &total, 8, dir[c].m_offsets + rows * 8);
+            }
+        }
+
+        if (close(fd) != 0)
+            ok = false;
+
+        if (!ok) {
+            perror("Unable to write export file");
+            return false;
+        }
+
+        if (stats) {
+            stats->m_rows = rows;
+            stats->m_blocks = n;
+            stats->m_bytes = off;
+        }
+
+        return true;
+    }
+} /* deltadb */
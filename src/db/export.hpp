@@ -0,0 +1,143 @@
+/**
+ * @file export.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_EXPORT_HPP
+#define DELTADB_DB_EXPORT_HPP
+
+#include <cstdint>
+
+/** "DCOL", first word of a columnar file */
+#define EXPORT_COLUMNAR_MAGIC 0x4C4F4344
+
+/** Columnar format version */
+#define EXPORT_COLUMNAR_VERSION 1
+
+/** Alignment of every array in a columnar file */
+#define EXPORT_COLUMNAR_ALIGN 64
+
+/** Blocks formatted ahead of the writer per thread in CSV exports */
+#define EXPORT_WINDOW 4
+
+namespace deltadb {
+    // forward decl
+    class table;
+
+    /** Export settings */
+    struct export_options {
+        /** Field delimiter, ',' for CSV and '\t' for TSV */
+        char m_delimiter;
+        /** Write a header line with the column names */
+        bool m_header;
+        /** Worker threads, 0 uses all cores */
+        uint32_t m_threads;
+
+        /** Constructor */
+        export_options() : m_delimiter(','), m_header(true), m_threads(0) {}
+    };
+
+    /** Export results */
+    struct export_stats {
+        /** Rows written */
+        uint64_t m_rows;
+        /** Blocks read */
+        uint64_t m_blocks;
+        /** Output size */
+        uint64_t m_bytes;
+    };
+
+    /**
+     * Columnar file header.
+     *
+     * A columnar file starts with this header, followed by one columnar_column per column.
+     * Every array is aligned to EXPORT_COLUMNAR_ALIGN and stored in native byte order so it
+     * can be mapped as is, e.g. with numpy.memmap or as Arrow buffers.
+     */
+    struct columnar_header {
+        /** EXPORT_COLUMNAR_MAGIC */
+        uint32_t m_magic;
+        /** EXPORT_COLUMNAR_VERSION */
+        uint32_t m_version;
+        /** Number of rows */
+        uint64_t m_rows;
+        /** Number of columns */
+        uint32_t m_columns;
+        /** Padding */
+        uint32_t m_reserved;
+    };
+
+    /**
+     * Columnar file column.
+     *
+     * Fixed width columns store rows values of m_width bytes, booleans take one byte.
+     * Strings and bytes store rows + 1 int64 offsets into the value data, the value of
+     * row i is [offsets[i], offsets[i + 1]), strings are not NUL terminated.
+     *
+     * Validity is a bitmap of (rows + 7) / 8 bytes, least significant bit first. A row is
+     * invalid until its field is set for the first time, these rows hold 0 or an empty
+     * string.
+     */
+    struct columnar_column {
+        /** Name, NUL terminated */
+        char m_name[32];
+        /** Column type and flags as in col::m_data */
+        uint8_t m_type;
+        /** Bytes per value, 0 for strings and bytes */
+        uint8_t m_width;
+        /** Padding */
+        uint8_t m_reserved[6];
+        /** Offset of the values */
+        uint64_t m_values;
+        /** Size of the values */
+        uint64_t m_values_size;
+        /** Offset of the int64 offsets for strings and bytes, 0 otherwise */
+        uint64_t m_offsets;
+        /** Offset of the validity bitmap */
+        uint64_t m_validity;
+    };
+
+    static_assert(sizeof(columnar_header) == 24, "columnar_header is part of the file format");
+    static_assert(sizeof(columnar_column) == 72, "columnar_column is part of the file format");
+
+    /**
+     * Write all rows of a table as CSV or TSV.
+     *
+     * Blocks are resolved in parallel: a first pass records the last value of every field
+     * per block, which gives each block the state it inherits. The second pass formats
+     * blocks into buffers independently, which are written in order. Fields never set
+     * are left empty, strings and bytes are quoted if they contain the delimiter, quotes
+     * or line breaks.
+     *
+     * Returns false if the output can not be written.
+     */
+    bool export_csv(table& t, const char* path, const export_options& o, export_stats* stats = nullptr);
+
+    /**
+     * Write all rows of a table as a columnar file, see columnar_header.
+     *
+     * Uses the same two passes as export_csv, the first one also sizes every array so the
+     * second can write each block's slice of every column at its final offset.
+     *
+     * Returns false if the output can not be written.
+     */
+    bool export_columnar(table& t, const char* path, const export_options& o, export_stats* stats = nullptr);
+} /* deltadb */
+
+#endif /* DELTADB_DB_EXPORT_HPP */
@@ -0,0 +1,541 @@
+/**
+ * @file import.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../internal/bitstream.hpp"
+#include "block.hpp"
+#include "block_codec.hpp"
+#include "block_pool.hpp"
+#include "import.hpp"
+#include "table.hpp"
+#include "table_col.hpp"
+#include "table_row.hpp"
+
+namespace deltadb {
+    namespace {
+        /** Returns the first delimiter, line break or quote in [p, end), or end */
+        inline const char* scan(const char* p, const char* end, char delim) {
+#ifdef __SSE2__
+            const __m128i d = _mm_set1_epi8(delim);
+            const __m128i n = _mm_set1_epi8('\n');
+            const __m128i q = _mm_set1_epi8('"');
+
+            while (p + 16 <= end) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                const int m = _mm_movemask_epi8(_mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, d), _mm_cmpeq_epi8(v, n)), _mm_cmpeq_epi8(v, q)
+                ));
+
+                if (m)
+                    return p + __builtin_ctz(m);
+
+                p += 16;
+            }
+#endif
+            while (p < end && *p != delim && *p != '\n' && *p != '"') {
+                ++p;
+            }
+
+            return p;
+        }
+
+        /** Returns the first line break in [p, end), or end */
+        inline const char* scan_line(const char* p, const char* end) {
+            const void* nl = memchr(p, '\n', end - p);
+            return nl ? static_cast<const char*>(nl) : end;
+        }
+
+        /** Last known value of a column */
+        struct cell {
+            /** Whether a value was seen */
+            bool m_known;
+            /** Value */
+            row_value m_value;
+            /** Storage for strings and bytes */
+            std::string m_bytes;
+
+            cell() : m_known(false) {}
+        };
+
+        /** Parser state of one chunk */
+        class chunk_parser {
+        public:
+            chunk_parser(const std::vector<col*>& cols, uint8_t flags, const std::vector<int32_t>& map, char delim,
+                blob_file& blobs)
+                : m_rows(0), m_errors(0), m_cols(cols), m_map(map), m_delim(delim), m_cells(cols.size()),
+                  m_block(nullptr), m_codec(cols, flags), m_blobs(blobs) {}
+
+            /** Parse lines in [p, end) */
+            void parse(const char* p, const char* end) {
+                m_block = block_alloc();
+
+                while (p < end) {
+                    const char* eol = line(p, end);
+                    p = eol < end ? eol + 1 : end;
+                }
+
+                if (m_block->rows) {
+                    m_blocks.push_back(m_block);
+                } else {
+                    block_free(m_block);
+                }
+            }
+
+            /** Encoded blocks */
+            std::vector<block*> m_blocks;
+            /** Rows parsed */
+            uint64_t m_rows;
+            /** Fields skipped */
+            uint64_t m_errors;
+        private:
+            const std::vector<col*>& m_cols;
+            /** Column for each field, -1 to ignore it */
+            const std::vector<int32_t>& m_map;
+            /** Delimiter */
+            char m_delim;
+            /** Previous values */
+            std::vector<cell> m_cells;
+            /** Block being filled */
+            block* m_block;
+            /** Codec state of m_block */
+            block_codec m_codec;
+            /** Blob file of the table */
+            blob_file& m_blobs;
+            /** Row being built */
+            row m_row;
+            /** Unquoted field */
+            std::string m_quoted;
+
+            /** Parse a single line, returns its end */
+            const char* line(const char* p, const char* end) {
+                m_row.m_fields.reset();
+                m_row.m_data.clear();
+
+                const char* start = p;
+                bool sorted = true;
+                int32_t last = -1;
+                uint32_t field = 0;
+
+                for (;;) {
+                    const char* f = p;
+                    const char* fend;
+
+                    if (p < end && *p == '"') {
+                        // quoted, slow path
+                        m_quoted.clear();
+                        ++p;
+
+                        while (p < end && *p != '\n') {
+                            if (*p == '"') {
+                                if (p + 1 < end && p[1] == '"') {
+                                    m_quoted.push_back('"');
+                                    p += 2;
+                                    continue;
+                                }
+
+                                ++p;
+                                break;
+                            }
+
+                            m_quoted.push_back(*p++);
+                        }
+
+                        f = m_quoted.data();
+                        fend = f + m_quoted.size();
+
+                        while (p < end && *p != m_delim && *p != '\n') {
+                            ++p;
+                        }
+                    } else {
+                        // quotes inside an unquoted field are literal
+                        p = scan(p, end, m_delim);
+                        while (p < end && *p == '"') {
+                            p = scan(p + 1, end, m_delim);
+                        }
+
+                        fend = p;
+                        if (fend > f && fend[-1] == '\r' && (p == end || *p == '\n'))
+                            --fend;
+                    }
+
+                    if (field < m_map.size() && m_map[field] >= 0 && fend != f) {
+                        const int32_t c = m_map[field];
+                        if (value(c, f, fend - f)) {
+                            sorted &= c > last;
+                            last = c;
+                        }
+                    }
+
+                    ++field;
+                    if (p >= end || *p == '\n')
+                        break;
+
+                    ++p;
+                }
+
+                // skip blank lines
+                if (p == start || (p == start + 1 && *start == '\r'))
+                    return p;
+
+                if (!sorted)
+                    m_row.sort();
+
+                write();
+                return p;
+            }
+
+            /** Parse field into column c and add it to the row if it changed */
+            bool value(int32_t c, const char* f, size_t len) {
+                row_value v;
+                v.m_type = m_cols[c]->type();
+                v.m_size = 0;
+                v.m_value.v_u64 = 0;
+
+                if (!parse(m_cols[c], f, len, v)) {
+                    if (++m_errors <= IMPORT_MAX_ERRORS)
+                        fprintf(stderr, "Unable to parse '%.*s' as %s\n", (int)std::min<size_t>(len, 64), f, m_cols[c]->m_name);
+
+                    return false;
+                }
+
+                cell& prev = m_cells[c];
+                const bool bytes = v.m_type == col_string || v.m_type == col_bytes;
+
+                if (prev.m_known) {
+                    if (bytes ? (prev.m_bytes.size() == len && memcmp(prev.m_bytes.data(), f, len) == 0)
+                              : prev.m_value.m_value.v_u64 == v.m_value.v_u64)
+                        return false;
+                }
+
+                if (bytes) {
+                    prev.m_bytes.assign(f, len);
+                    v.m_value.v_bytes = &prev.m_bytes[0];
+
+                    // stored once, rows repeating it at the start of a block keep the reference
+                    if (v.m_type == col_bytes && len > BLOB_INLINE && col_is_blob(m_cols[c])) {
+                        v.m_type = BLOB_REF;
+                        v.m_value.v_u64 = m_blobs.append(f, len);
+                    }
+                }
+
+                prev.m_known = true;
+                prev.m_value = v;
+                m_row.set(c, v);
+                return true;
+            }
+
+            /** Encode m_row into the active block, skips it if it does not fit into a block */
+            void write() {
+                uint32_t size = m_row.size() + m_codec.overhead(m_row.m_fields);
+
+                if (m_block->pos + size > BLOCK_USABLE) {
+                    // the block is empty after a line that did not fit
+                    if (m_block->rows) {
+                        m_blocks.push_back(m_block);
+                        m_block = block_alloc();
+                    }
+
+                    m_codec.reset();
+
+                    // every block starts with all known values
+                    m_row.m_fields.reset();
+                    m_row.m_data.clear();
+
+                    for (uint32_t i = 0; i < m_cells.size(); ++i) {
+                        if (!m_cells[i].m_known)
+                            continue;
+
+                        row_value v = m_cells[i].m_value;
+                        if (v.m_type == col_string || v.m_type == col_bytes)
+                            v.m_value.v_bytes = &m_cells[i].m_bytes[0];
+
+                        m_row.set(i, v);
+                    }
+
+                    size = m_row.size() + m_codec.overhead(m_row.m_fields);
+
+                    // wide tables of strings and bytes can have rows larger than a block
+                    if (size > BLOCK_USABLE) {
+                        if (++m_errors <= IMPORT_MAX_ERRORS)
+                            fprintf(stderr, "Skipping a line of %u bytes, it does not fit into a block\n", size);
+
+                        // nothing of it was written, the next line sets all of its fields
+                        for (auto &c : m_cells) {
+                            c.m_known = false;
+                        }
+
+                        return;
+                    }
+                }
+
+                bitstream b(
+                    (bitstream::word_t*)(m_block->data + m_block->pos),
+                    BLOCK_DSIZE - m_block->pos, bitstream::mode::io_writer
+                );
+
+                row_write(b, &m_row, &m_codec);
+                m_block->pos += b.position() / 8;
+                m_block->rows += 1;
+                ++m_rows;
+            }
+
+            /** Parse signed or unsigned integer */
+            static bool parse_int(const char* f, size_t len, bool sign, uint64_t& out) {
+                bool neg = false;
+                if (len && (*f == '-' || *f == '+')) {
+                    if (*f == '-' && !sign)
+                        return false;
+
+                    neg = *f == '-';
+                    ++f;
+                    --len;
+                }
+
+                if (len == 0 || len > 20)
+                    return false;
+
+                uint64_t v = 0;
+                for (size_t i = 0; i < len; ++i) {
+                    const uint32_t d = f[i] - '0';
+                    if (d > 9)
+                        return false;
+
+                    v = v * 10 + d;
+                }
+
+                out = neg ? 0 - v : v;
+                return true;
+            }
+
+            /** Parse field according to the column type */
+            static bool parse(col* c, const char* f, size_t len, row_value& v) {
+                switch (v.m_type) {
+                case col_int8:
+                case col_int16:
+                case col_int32:
+                case col_int64: {
+                    uint64_t i;
+                    if (!parse_int(f, len, !c->is_unsigned(), i))
+                        return false;
+
+                    switch (v.m_type) {
+                    case col_int8:  v.m_value.v_u8 = i; break;
+                    case col_int16: v.m_value.v_u16 = i; break;
+                    case col_int32: v.m_value.v_u32 = i; break;
+                    default:        v.m_value.v_u64 = i; break;
+                    }
+                } return true;
+                case col_bool:
+                    if ((len == 1 && (*f == '1' || *f == 't')) || (len == 4 && memcmp(f, "true", 4) == 0)) {
+                        v.m_value.v_bool = true;
+                    } else if ((len == 1 && (*f == '0' || *f == 'f')) || (len == 5 && memcmp(f, "false", 5) == 0)) {
+                        v.m_value.v_bool = false;
+                    } else {
+                        return false;
+                    }
+                    return true;
+                case col_float:
+                case col_double: {
+                    char buf[64];
+                    if (len >= sizeof(buf))
+                        return false;
+
+                    memcpy(buf, f, len);
+                    buf[len] = '\0';
+
+                    char* e;
+                    if (v.m_type == col_float) {
+                        v.m_value.v_float = strtof(buf, &e);
+                    } else {
+                        v.m_value.v_double = strtod(buf, &e);
+                    }
+
+                    return e == buf + len;
+                }
+                case col_string:
+                    return len <= 255 && !memchr(f, '\0', len);
+                case col_bytes:
+                    v.m_size = len;
+                    return len <= 0xFFFF;
+                default:
+                    return false;
+                }
+            }
+        };
+
+        /** Map field index to column */
+        bool header(const std::vector<col*>& cols, const char* p, const char* end, char delim, std::vector<int32_t>& map) {
+            while (p <= end) {
+                const char* f = p;
+                while (p < end && *p != delim) {
+                    ++p;
+                }
+
+                std::string name(f, p);
+                if (!name.empty() && name.back() == '\r')
+                    name.pop_back();
+
+                if (name.size() >= 2 && name.front() == '"' && name.back() == '"')
+                    name = name.substr(1, name.size() - 2);
+
+                int32_t idx = -1;
+                for (uint32_t i = 0; i < cols.size(); ++i) {
+                    if (name == cols[i]->m_name)
+                        idx = i;
+                }
+
+                if (idx < 0) {
+                    fprintf(stderr, "Unknown column %s\n", name.c_str());
+                    return false;
+                }
+
+                map.push_back(idx);
+                ++p;
+            }
+
+            return true;
+        }
+    }
+
+    bool import_csv(table& t, const char* path, const import_options& o, import_stats* stats) {
+        const std::vector<col*>& cols = t.columns();
+        if (cols.empty())
+            return false;
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror("Unable to open import file");
+            return false;
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        const size_t size = st.st_size;
+
+        const char* data = nullptr;
+        if (size) {
+            void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m == MAP_FAILED) {
+                perror("Unable to map import file");
+                close(fd);
+                return false;
+            }
+
+#ifdef MADV_SEQUENTIAL
+            madvise(m, size, MADV_SEQUENTIAL);
+#endif
+            data = static_cast<const char*>(m);
+        }
+
+        close(fd);
+
+        const char* p = data;
+        const char* end = data + size;
+        std::vector<int32_t> map;
+
+        if (o.m_header && p < end) {
+            const char* eol = scan_line(p, end);
+            if (!header(cols, p, eol, o.m_delimiter, map)) {
+                munmap(const_cast<char*>(data), size);
+                return false;
+            }
+
+            p = eol < end ? eol + 1 : end;
+        } else {
+            for (uint32_t i = 0; i < cols.size(); ++i) {
+                map.push_back(i);
+            }
+        }
+
+        // split at line boundaries
+        std::vector<const char*> bounds = {p};
+        while (bounds.back() < end) {
+            const char* next = bounds.back() + IMPORT_CHUNK_SIZE;
+            if (next >= end) {
+                bounds.push_back(end);
+            } else {
+                const char* eol = scan_line(next, end);
+                bounds.push_back(eol < end ? eol + 1 : end);
+            }
+        }
+
+        const uint32_t chunks = bounds.size() - 1;
+        std::vector<chunk_parser*> parsers(chunks, nullptr);
+        std::atomic<uint32_t> next(0);
+
+        uint32_t threads = o.m_threads ? o.m_threads : std::thread::hardware_concurrency();
+        threads = std::max<uint32_t>(1, std::min(threads, chunks));
+
+        std::vector<std::thread> workers;
+        for (uint32_t i = 0; i < threads; ++i) {
+            workers.push_back(std::thread([&]() {
+                for (uint32_t c = next++; c < chunks; c = next++) {
+                    parsers[c] = new chunk_parser(cols, t.flags(), map, o.m_delimiter, t.blobs());
+                    parsers[c]->parse(bounds[c], bounds[c + 1]);
+                }
+            }));
+        }
+
+        for (auto &w : workers) {
+            w.join();
+        }
+
+        munmap(const_cast<char*>(data), size);
+
+        // append in input order
+        std::vector<block*> blocks;
+        import_stats s = {0, 0, 0, size};
+
+        for (auto c : parsers) {
+            blocks.insert(blocks.end(), c->m_blocks.begin(), c->m_blocks.end());
+            s.m_rows += c->m_rows;
+            s.m_errors += c->m_errors;
+            delete c;
+        }
+
+        s.m_blocks = blocks.size();
+        t.append(blocks);
+
+        if (stats)
+            *stats = s;
+
+        return true;
+    }
+} /* deltadb */
@@ -0,0 +1,80 @@
+/**
+ * @file import.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_IMPORT_HPP
+#define DELTADB_DB_IMPORT_HPP
+
+#include <cstdint>
+
+/** Target size of the chunks input is split into */
+#define IMPORT_CHUNK_SIZE (16 * 1024 * 1024)
+
+/** Number of parse errors printed before going quiet */
+#define IMPORT_MAX_ERRORS 16
+
+namespace deltadb {
+    // forward decl
+    class table;
+
+    /** Import settings */
+    struct import_options {
+        /** Field delimiter, ',' for CSV and '\t' for TSV */
+        char m_delimiter;
+        /** First line names the columns, otherwise fields map to columns by position */
+        bool m_header;
+        /** Parser threads, 0 uses all cores */
+        uint32_t m_threads;
+
+        /** Constructor */
+        import_options() : m_delimiter(','), m_header(false), m_threads(0) {}
+    };
+
+    /** Import results */
+    struct import_stats {
+        /** Rows imported */
+        uint64_t m_rows;
+        /** Blocks appended */
+        uint64_t m_blocks;
+        /** Fields that failed to parse and lines that did not fit into a block, both skipped */
+        uint64_t m_errors;
+        /** Input size */
+        uint64_t m_bytes;
+    };
+
+    /**
+     * Append a CSV or TSV file to a table.
+     *
+     * The file is mapped and split into chunks at line boundaries, which are parsed in
+     * parallel. Each line becomes one row that only sets the fields whose value differs
+     * from the previous line, empty fields keep the previous value. Chunks encode their
+     * rows straight into blocks which are then appended in order with table::append,
+     * bypassing the per row write path.
+     *
+     * The first row of every block sets all fields known at that point, so chunks do not
+     * depend on each other. Quoted fields may contain delimiters and "" escapes, but
+     * no line breaks.
+     *
+     * Returns false if the file can not be read or the header does not match the table.
+     */
+    bool import_csv(table& t, const char* path, const import_options& o, import_stats* stats = nullptr);
+} /* deltadb */
+
+#endif /* DELTADB_DB_IMPORT_HPP */
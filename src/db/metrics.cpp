@@ -0,0 +1,219 @@
+/**
+ * @file metrics.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstring>
+
+#include "metrics.hpp"
+
+namespace deltadb {
+    thread_local metrics_shard* t_metrics = nullptr;
+
+    namespace {
+        typedef std::chrono::steady_clock clock;
+
+        /** State shared by all threads */
+        struct registry {
+            /** Guards everything below */
+            std::mutex m_lock;
+            /** Shards of running threads */
+            std::vector<metrics_shard*> m_shards;
+            /** Values of exited threads */
+            metrics_shard m_retired;
+            /** Reference point for tick calibration */
+            uint64_t m_ticks;
+            clock::time_point m_time;
+
+            registry() : m_retired(), m_ticks(metrics_ticks()), m_time(clock::now()) {}
+        };
+
+        /** Never destroyed, threads may exit after static destructors ran */
+        registry& global() {
+            static registry* r = new registry();
+            return *r;
+        }
+
+        /** Adds all values of src to dst */
+        void shard_fold(metrics_shard& dst, const metrics_shard& src) {
+            auto add = [](std::atomic<uint64_t>& d, const std::atomic<uint64_t>& s) {
+                d.store(d.load(std::memory_order_relaxed) + s.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            };
+
+            for (uint32_t i = 0; i < metric_counter_max; ++i) {
+                add(dst.m_counters[i], src.m_counters[i]);
+            }
+
+            for (uint32_t h = 0; h < hist_histogram_max; ++h) {
+                for (uint32_t i = 0; i < METRICS_BUCKETS; ++i) {
+                    add(dst.m_buckets[h][i], src.m_buckets[h][i]);
+                }
+
+                add(dst.m_sums[h], src.m_sums[h]);
+            }
+        }
+
+        /** Owns the calling thread's shard and retires it on exit */
+        struct shard_owner {
+            metrics_shard* m_shard;
+
+            shard_owner() : m_shard(new metrics_shard()) {
+                registry& r = global();
+                std::lock_guard<std::mutex> l(r.m_lock);
+                r.m_shards.push_back(m_shard);
+            }
+
+            ~shard_owner() {
+                registry& r = global();
+                std::lock_guard<std::mutex> l(r.m_lock);
+
+                shard_fold(r.m_retired, *m_shard);
+                for (auto it = r.m_shards.begin(); it != r.m_shards.end(); ++it) {
+                    if (*it == m_shard) {
+                        r.m_shards.erase(it);
+                        break;
+                    }
+                }
+
+                // late events of this thread go to the shared retired shard
+                t_metrics = &r.m_retired;
+                delete m_shard;
+            }
+        };
+
+        thread_local shard_owner t_owner;
+    }
+
+    metrics_shard* metrics_attach() {
+        t_metrics = t_owner.m_shard;
+        return t_metrics;
+    }
+
+    uint64_t metrics_histogram::percentile(double p) const {
+        if (m_count == 0)
+            return 0;
+
+        uint64_t rank = p * m_count;
+        if (rank >= m_count)
+            rank = m_count - 1;
+
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < METRICS_BUCKETS; ++i) {
+            seen += m_buckets[i];
+            if (seen > rank)
+                return (i + 1 < METRICS_BUCKETS) ? metrics_bucket_floor(i + 1) - 1 : UINT64_MAX;
+        }
+
+        return UINT64_MAX;
+    }
+
+    void metrics_collect(metrics_snapshot& s) {
+        registry& r = global();
+        memset(&s, 0, sizeof(s));
+
+        {
+            std::lock_guard<std::mutex> l(r.m_lock);
+
+            std::vector<const metrics_shard*> shards(r.m_shards.begin(), r.m_shards.end());
+            shards.push_back(&r.m_retired);
+
+            for (auto sh : shards) {
+                for (uint32_t i = 0; i < metric_counter_max; ++i) {
+                    s.m_counters[i] += sh->m_counters[i].load(std::memory_order_relaxed);
+                }
+
+                for (uint32_t h = 0; h < hist_histogram_max; ++h) {
+                    metrics_histogram& hist = s.m_histograms[h];
+
+                    for (uint32_t i = 0; i < METRICS_BUCKETS; ++i) {
+                        const uint64_t n = sh->m_buckets[h][i].load(std::memory_order_relaxed);
+                        hist.m_buckets[i] += n;
+                        hist.m_count += n;
+                    }
+
+                    hist.m_sum += sh->m_sums[h].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        s.m_tick_ns = metrics_tick_ns();
+    }
+
+    double metrics_tick_ns() {
+#if defined(__x86_64__) || defined(__i386__)
+        registry& r = global();
+
+        // calibrate against the steady clock, give it a few ms to be accurate
+        auto elapsed = clock::now() - r.m_time;
+        if (elapsed < std::chrono::milliseconds(10)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+        }
+
+        const uint64_t ticks = metrics_ticks() - r.m_ticks;
+        elapsed = clock::now() - r.m_time;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / ticks;
+#else
+        return 1.0;
+#endif
+    }
+
+    void metrics_dump(FILE* fp, const metrics_snapshot& s) {
+        for (uint32_t i = 0; i < metric_counter_max; ++i) {
+            fprintf(fp, "%s %lu\n", metrics_name((metric_counter)i), s.m_counters[i]);
+        }
+
+        for (uint32_t h = 0; h < hist_histogram_max; ++h) {
+            const metrics_histogram& hist = s.m_histograms[h];
+            const char* name = metrics_name((metric_histogram)h);
+
+            fprintf(fp, "%s_count %lu\n", name, hist.m_count);
+            if (hist.m_count == 0)
+                continue;
+
+            fprintf(fp, "%s_mean_ns %.0f\n", name, (double)hist.m_sum / hist.m_count * s.m_tick_ns);
+            fprintf(fp, "%s_p50_ns %.0f\n", name, hist.percentile(0.5) * s.m_tick_ns);
+            fprintf(fp, "%s_p99_ns %.0f\n", name, hist.percentile(0.99) * s.m_tick_ns);
+            fprintf(fp, "%s_p999_ns %.0f\n", name, hist.percentile(0.999) * s.m_tick_ns);
+            fprintf(fp, "%s_max_ns %.0f\n", name, hist.percentile(1.0) * s.m_tick_ns);
+        }
+    }
+
+    const char* metrics_name(metric_counter c) {
+        static const char* names[] = {
+            "rows_written", "row_bytes", "blocks_sealed", "blocks_flushed", "blocks_read",
+            "bytes_written", "bytes_read", "rows_decoded", "tables_opened", "pool_hits", "pool_misses",
+            "pax_fallbacks", "rows_rejected"
+        };
+
+        static_assert(sizeof(names) / sizeof(names[0]) == metric_counter_max, "Missing counter name");
+        return names[c];
+    }
+
+    const char* metrics_name(metric_histogram h) {
+        static const char* names[] = {
+            "table_write", "block_read", "block_write", "block_decode", "database_open"
+        };
+
+        static_assert(sizeof(names) / sizeof(names[0]) == hist_histogram_max, "Missing histogram name");
+        return names[h];
+    }
+} /* deltadb */
@@ -0,0 +1,203 @@
+/**
+ * @file metrics.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_METRICS_HPP
+#define DELTADB_DB_METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <boost/noncopyable.hpp>
+
+/** Sub-buckets per power of two, as bits. 3 keeps the bucket error below 12.5% */
+#define METRICS_SUB_BITS 3
+
+/** Number of histogram buckets, covers the full 64 bit range */
+#define METRICS_BUCKETS ((64 - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+
+namespace deltadb {
+    /** Counters */
+    enum metric_counter {
+        metric_rows_written = 0,  /// Rows appended
+        metric_row_bytes,         /// Encoded size of appended rows
+        metric_blocks_sealed,     /// Full blocks written out
+        metric_blocks_flushed,    /// Partial blocks written out
+        metric_blocks_read,       /// Blocks loaded from disk
+        metric_bytes_written,     /// Bytes written to block files
+        metric_bytes_read,        /// Bytes read from block files
+        metric_rows_decoded,      /// Rows decoded by scans
+        metric_tables_opened,     /// Tables loaded by database::open
+        metric_pool_hits,         /// Block allocations served by the thread cache
+        metric_pool_misses,       /// Block allocations refilled from the shared pool
+        metric_pax_fallbacks,     /// Sealed blocks of PAX tables left in rows because the PAX layout did not fit
+        metric_rows_rejected,     /// Rows not written because they do not fit into a block
+        metric_counter_max
+    };
+
+    /** Latency histograms */
+    enum metric_histogram {
+        hist_table_write = 0,     /// table::write
+        hist_block_read,          /// block_read
+        hist_block_write,         /// block_write
+        hist_block_decode,        /// Decoding all rows of one block during a scan
+        hist_database_open,       /// database::open
+        hist_histogram_max
+    };
+
+    /** Per thread metric storage, only written by its owning thread, value-initialize to zero it */
+    struct metrics_shard {
+        /** Counter values */
+        std::atomic<uint64_t> m_counters[metric_counter_max];
+        /** Bucket counts */
+        std::atomic<uint64_t> m_buckets[hist_histogram_max][METRICS_BUCKETS];
+        /** Sum of recorded ticks */
+        std::atomic<uint64_t> m_sums[hist_histogram_max];
+    };
+
+    /** Calling thread's shard, set on first use */
+    extern thread_local metrics_shard* t_metrics;
+
+    /** Register a shard for the calling thread */
+    metrics_shard* metrics_attach();
+
+    /** Returns the calling thread's shard */
+    inline metrics_shard& metrics_local() {
+        metrics_shard* s = t_metrics;
+        if (!s)
+            s = metrics_attach();
+
+        return *s;
+    }
+
+    /** Returns histogram bucket for value */
+    inline uint32_t metrics_bucket(uint64_t v) {
+        if (v < (1u << METRICS_SUB_BITS))
+            return v;
+
+        const uint32_t msb = 63 - __builtin_clzll(v);
+        return ((msb - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+            + ((v >> (msb - METRICS_SUB_BITS)) & ((1u << METRICS_SUB_BITS) - 1));
+    }
+
+    /** Returns smallest value falling into bucket */
+    inline uint64_t metrics_bucket_floor(uint32_t b) {
+        if (b < (1u << METRICS_SUB_BITS))
+            return b;
+
+        const uint32_t msb = (b >> METRICS_SUB_BITS) + METRICS_SUB_BITS - 1;
+        const uint64_t sub = b & ((1u << METRICS_SUB_BITS) - 1);
+        return ((1ull << METRICS_SUB_BITS) + sub) << (msb - METRICS_SUB_BITS);
+    }
+
+    /** Returns a cheap timestamp, convert differences with metrics_snapshot::m_tick_ns */
+    inline uint64_t metrics_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+#endif
+    }
+
+    /**
+     * Add to counter.
+     *
+     * Shards have a single writer, so this is a plain load and store without a locked
+     * instruction. Readers may see a slightly stale value.
+     */
+    inline void metrics_add(metric_counter c, uint64_t n = 1) {
+        std::atomic<uint64_t>& v = metrics_local().m_counters[c];
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /** Record a duration in ticks */
+    inline void metrics_record(metric_histogram h, uint64_t ticks) {
+        metrics_shard& s = metrics_local();
+
+        std::atomic<uint64_t>& b = s.m_buckets[h][metrics_bucket(ticks)];
+        b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        s.m_sums[h].store(s.m_sums[h].load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+    }
+
+    /** Records the lifetime of the object into a histogram */
+    class metrics_timer : private boost::noncopyable {
+    public:
+        /** Constructor, starts timing */
+        metrics_timer(metric_histogram h) : m_hist(h), m_start(metrics_ticks()) {}
+
+        /** Destructor, records the elapsed time */
+        ~metrics_timer() {
+            metrics_record(m_hist, metrics_ticks() - m_start);
+        }
+    private:
+        /** Target histogram */
+        metric_histogram m_hist;
+        /** Start time */
+        uint64_t m_start;
+    };
+
+    /** Merged histogram */
+    struct metrics_histogram {
+        /** Bucket counts */
+        uint64_t m_buckets[METRICS_BUCKETS];
+        /** Number of samples */
+        uint64_t m_count;
+        /** Sum of all samples in ticks */
+        uint64_t m_sum;
+
+        /** Returns the value below which p (0..1) of all samples fall, in ticks */
+        uint64_t percentile(double p) const;
+    };
+
+    /** Merged view of all shards */
+    struct metrics_snapshot {
+        /** Counter values */
+        uint64_t m_counters[metric_counter_max];
+        /** Histograms */
+        metrics_histogram m_histograms[hist_histogram_max];
+        /** Nanoseconds per tick */
+        double m_tick_ns;
+    };
+
+    /** Returns nanoseconds per tick, blocks for up to 10ms on first use to calibrate */
+    double metrics_tick_ns();
+
+    /** Merge the current values of all threads, including ones that already exited */
+    void metrics_collect(metrics_snapshot& s);
+
+    /** Write snapshot as text, one "name value" pair per line */
+    void metrics_dump(FILE* fp, const metrics_snapshot& s);
+
+    /** Returns counter name */
+    const char* metrics_name(metric_counter c);
+
+    /** Returns histogram name */
+    const char* metrics_name(metric_histogram h);
+} /* deltadb */
+
+#endif /* DELTADB_DB_METRICS_HPP */
@@ -0,0 +1,109 @@
+/**
+ * @file profile.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_PROFILE_HPP
+#define DELTADB_DB_PROFILE_HPP
+
+#include <cstdint>
+#include <cstdio>
+
+#include <boost/noncopyable.hpp>
+
+#include "metrics.hpp"
+
+namespace deltadb {
+    /** Stages of a read */
+    enum query_stage {
+        stage_io = 0,     /// Waiting for block reads
+        stage_decode,     /// Decoding rows
+        stage_filter,     /// Evaluating predicates
+        stage_aggregate,  /// Accumulating results
+        stage_max
+    };
+
+    /**
+     * Time spent per stage of a single read, similar to EXPLAIN ANALYZE.
+     *
+     * Pass one to a read to have it filled in, callers attribute time spent in their own
+     * callbacks with query_timer.
+     */
+    struct query_profile {
+        /** Ticks per stage */
+        uint64_t m_ticks[stage_max];
+        /** Blocks visited */
+        uint64_t m_blocks;
+        /** Rows decoded */
+        uint64_t m_rows;
+        /** Block bytes read, from disk or memory */
+        uint64_t m_bytes;
+
+        /** Constructor */
+        query_profile() : m_ticks(), m_blocks(0), m_rows(0), m_bytes(0) {}
+
+        /** Returns time spent in stage in nanoseconds */
+        double ns(query_stage s) const {
+            return m_ticks[s] * metrics_tick_ns();
+        }
+
+        /** Print breakdown */
+        void print(FILE* fp) const {
+            static const char* names[] = {"io", "decode", "filter", "aggregate"};
+
+            uint64_t total = 0;
+            for (uint32_t i = 0; i < stage_max; ++i) {
+                total += m_ticks[i];
+            }
+
+            fprintf(fp, "blocks=%lu rows=%lu bytes=%lu time=%.3fms\n",
+                m_blocks, m_rows, m_bytes, total * metrics_tick_ns() / 1e6
+            );
+
+            for (uint32_t i = 0; i < stage_max; ++i) {
+                fprintf(fp, "  %-9s %10.3fms %5.1f%%\n",
+                    names[i], ns((query_stage)i) / 1e6, total ? 100.0 * m_ticks[i] / total : 0.0
+                );
+            }
+        }
+    };
+
+    /** Adds the lifetime of the object to a stage, does nothing without a profile */
+    class query_timer : private boost::noncopyable {
+    public:
+        /** Constructor */
+        query_timer(query_profile* p, query_stage s)
+            : m_profile(p), m_stage(s), m_start(p ? metrics_ticks() : 0) {}
+
+        /** Destructor */
+        ~query_timer() {
+            if (m_profile)
+                m_profile->m_ticks[m_stage] += metrics_ticks() - m_start;
+        }
+    private:
+        /** Target profile */
+        query_profile* m_profile;
+        /** Stage */
+        query_stage m_stage;
+        /** Start time */
+        uint64_t m_start;
+    };
+} /* deltadb */
+
+#endif /* DELTADB_DB_PROFILE_HPP */
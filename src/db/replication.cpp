@@ -0,0 +1,656 @@
+/**
+ * @file replication.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "block.hpp"
+#include "block_pool.hpp"
+#include "replication.hpp"
+#include "table_col.hpp"
+
+namespace deltadb {
+    namespace {
+        /** Open a socket for the given address, either listening or connected */
+        int repl_socket(const std::string& address, bool listening) {
+            if (address.compare(0, 5, "unix:") == 0) {
+                sockaddr_un addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sun_family = AF_UNIX;
+                strncpy(addr.sun_path, address.c_str()+5, sizeof(addr.sun_path)-1);
+
+                int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+                if (fd < 0)
+                    return -1;
+
+                int r;
+                if (listening) {
+                    unlink(addr.sun_path);
+                    r = bind(fd, (sockaddr*)&addr, sizeof(addr));
+                    if (r == 0)
+                        r = listen(fd, 8);
+                } else {
+                    r = connect(fd, (sockaddr*)&addr, sizeof(addr));
+                }
+
+                if (r != 0) {
+                    close(fd);
+                    return -1;
+                }
+
+                return fd;
+            }
+
+            auto colon = address.rfind(':');
+            if (colon == std::string::npos)
+                return -1;
+
+            std::string host = address.substr(0, colon);
+            std::string port = address.substr(colon+1);
+
+            addrinfo hints, *res;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+            if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0)
+                return -1;
+
+            int fd = -1;
+            for (addrinfo* a = res; a; a = a->ai_next) {
+                fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                if (fd < 0)
+                    continue;
+
+                int r;
+                if (listening) {
+                    int one = 1;
+                    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                    r = bind(fd, a->ai_addr, a->ai_addrlen);
+                    if (r == 0)
+                        r = listen(fd, 8);
+                } else {
+                    r = connect(fd, a->ai_addr, a->ai_addrlen);
+                }
+
+                if (r == 0)
+                    break;
+
+                close(fd);
+                fd = -1;
+            }
+
+            freeaddrinfo(res);
+            return fd;
+        }
+
+        /** Send all bytes */
+        bool send_all(int fd, const void* data, size_t size) {
+            const char* p = static_cast<const char*>(data);
+
+            while (size) {
+                ssize_t r = send(fd, p, size, MSG_NOSIGNAL);
+                if (r <= 0)
+                    return false;
+
+                p += r;
+                size -= r;
+            }
+
+            return true;
+        }
+
+        /** Receive exactly size bytes */
+        bool recv_all(int fd, void* data, size_t size) {
+            char* p = static_cast<char*>(data);
+
+            while (size) {
+                ssize_t r = recv(fd, p, size, 0);
+                if (r <= 0)
+                    return false;
+
+                p += r;
+                size -= r;
+            }
+
+            return true;
+        }
+
+        /** Send a message */
+        bool send_msg(int fd, repl_header& h, const std::string& name, const void* payload) {
+            h.m_name = name.size();
+            h.m_pad = 0;
+
+            return send_all(fd, &h, sizeof(h))
+                && send_all(fd, name.c_str(), name.size())
+                && send_all(fd, payload, h.m_length);
+        }
+
+        /** Largest payload a message of the given type carries, lengths above are rejected before reading */
+        size_t max_length(uint8_t type) {
+            switch (type) {
+            case repl_hello:
+                return REPL_MAX_TABLES * sizeof(repl_state);
+            case repl_file:
+                return TABLE_MAX_DEFINITION;
+            case repl_blocks:
+                return REPL_BATCH * sizeof(block);
+            case repl_delta:
+                return sizeof(block);
+            case repl_append:
+                return sizeof(uint64_t) + REPL_BATCH * sizeof(block);
+            default:
+                return 0;
+            }
+        }
+
+        /** Read bytes from file at offset */
+        bool read_at(const std::string& file, void* dest, size_t size, off_t off) {
+            int fd = open(file.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            const ssize_t r = pread(fd, dest, size, off);
+            close(fd);
+
+            return r == (ssize_t)size;
+        }
+
+        /** Write bytes to file at offset, creating it if required */
+        bool write_at(const std::string& file, const void* src, size_t size, off_t off) {
+            int fd = open(file.c_str(), O_WRONLY|O_CREAT, 0644);
+            if (fd < 0)
+                return false;
+
+            const ssize_t r = pwrite(fd, src, size, off);
+            close(fd);
+
+            return r == (ssize_t)size;
+        }
+
+        /** List tables in working directory */
+        std::vector<std::string> list_tables() {
+            std::vector<std::string> ret;
+
+            DIR *dp = opendir("./");
+            if (!dp)
+                return ret;
+
+            struct dirent *file;
+            while((file=readdir(dp)) != NULL) {
+                const size_t len = strlen(file->d_name);
+                if (len > 4 && strcmp(file->d_name+(len-4), ".tbl") == 0)
+                    ret.push_back(std::string(file->d_name, len-4));
+            }
+
+            closedir(dp);
+            return ret;
+        }
+    }
+
+    bool repl_primary::start() {
+        m_fd = repl_socket(m_address, true);
+        if (m_fd < 0) {
+            perror("Unable to listen for followers");
+            return false;
+        }
+
+        m_stop = false;
+        m_accept = std::thread(&repl_primary::accept, this);
+        return true;
+    }
+
+    void repl_primary::stop() {
+        if (m_fd < 0)
+            return;
+
+        m_stop = true;
+        shutdown(m_fd, SHUT_RDWR);
+        m_accept.join();
+        close(m_fd);
+        m_fd = -1;
+
+        std::unique_lock<std::mutex> l(m_lock);
+        for (auto &f : m_followers) {
+            if (!f.m_done)
+                shutdown(f.m_fd, SHUT_RDWR);
+        }
+
+        // accept is done, the list no longer changes
+        l.unlock();
+        for (auto &f : m_followers) {
+            f.m_thread.join();
+        }
+
+        m_followers.clear();
+    }
+
+    void repl_primary::accept() {
+        while (!m_stop) {
+            int fd = ::accept(m_fd, nullptr, nullptr);
+            if (fd < 0)
+                break;
+
+            std::lock_guard<std::mutex> l(m_lock);
+
+            // reap followers that disconnected
+            for (auto it = m_followers.begin(); it != m_followers.end();) {
+                if (it->m_done) {
+                    it->m_thread.join();
+                    it = m_followers.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            m_followers.push_back({std::thread(), fd, false});
+            m_followers.back().m_thread = std::thread(&repl_primary::serve, this, &m_followers.back());
+        }
+    }
+
+    void repl_primary::serve(follower* f) {
+        ship(f->m_fd);
+
+        std::lock_guard<std::mutex> l(m_lock);
+        close(f->m_fd);
+        f->m_done = true;
+    }
+
+    void repl_primary::ship(int fd) {
+        /** What has been shipped for a table */
+        struct shipped {
+            uint64_t frm;      // size of the table definition
+            time_t frm_mtime;  // mtime of the table definition
+            uint32_t blocks;   // number of blocks
+            uint32_t pos;      // data position in the last block
+            uint32_t counted;  // sealed blocks included in rows / bytes
+            uint64_t rows;     // rows in sealed blocks
+            uint64_t bytes;    // bytes in sealed blocks
+            uint64_t blob;     // size of the blob file
+        };
+
+        std::unordered_map<std::string, shipped> state;
+
+        // read follower state
+        repl_header h;
+        if (!recv_all(fd, &h, sizeof(h)) || h.m_type != repl_hello || h.m_length % sizeof(repl_state)
+            || h.m_length > max_length(repl_hello))
+        {
+            return;
+        }
+
+        std::vector<repl_state> hello(h.m_length / sizeof(repl_state));
+        if (!recv_all(fd, hello.data(), h.m_length))
+            return;
+
+        for (auto &s : hello) {
+            s.m_name[33] = '\0';
+            state[s.m_name] = {s.m_frm, 0, s.m_blocks, s.m_pos, 0, 0, 0, s.m_blob};
+        }
+
+        std::vector<char> buffer;
+        bool ok = true;
+
+        while (ok && !m_stop) {
+            uint64_t rows = 0;
+            uint64_t bytes = 0;
+
+            for (auto &name : list_tables()) {
+                auto it = state.find(name);
+                if (it == state.end())
+                    it = state.insert({name, {0, 0, 0, 0, 0, 0, 0, 0}}).first;
+
+                shipped& s = it->second;
+                const std::string frm = name+".tbl";
+                const std::string blk = name+".blk";
+
+                // schema
+                struct stat st;
+                if (stat(frm.c_str(), &st) != 0)
+                    continue;
+
+                if ((uint64_t)st.st_size != s.frm || st.st_mtime != s.frm_mtime) {
+                    buffer.resize(st.st_size);
+                    if (!read_at(frm, buffer.data(), st.st_size, 0))
+                        continue;
+
+                    memset(&h, 0, sizeof(h));
+                    h.m_type = repl_file;
+                    h.m_length = st.st_size;
+                    ok = ok && send_msg(fd, h, frm, buffer.data());
+
+                    s.frm = st.st_size;
+                    s.frm_mtime = st.st_mtime;
+                }
+
+                // blob values ahead of the rows referencing them, from the start if the table was recreated
+                const std::string blob = name+".blob";
+                if (stat(blob.c_str(), &st) == 0) {
+                    if ((uint64_t)st.st_size < s.blob)
+                        s.blob = 0;
+
+                    while (ok && s.blob < (uint64_t)st.st_size) {
+                        const size_t n = std::min<uint64_t>(st.st_size - s.blob, REPL_BATCH * sizeof(block));
+                        buffer.resize(sizeof(uint64_t) + n);
+                        memcpy(buffer.data(), &s.blob, sizeof(uint64_t));
+
+                        if (!read_at(blob, buffer.data() + sizeof(uint64_t), n, s.blob))
+                            break;
+
+                        memset(&h, 0, sizeof(h));
+                        h.m_type = repl_append;
+                        h.m_length = buffer.size();
+                        ok = send_msg(fd, h, blob, buffer.data());
+                        s.blob += n;
+                    }
+                }
+
+                const uint32_t blocks = block_num(blk.c_str());
+                block_header bh;
+
+                // the followers tail block grew or got sealed, a transposed block is sent in full
+                if (ok && s.blocks != 0 && s.blocks <= blocks && block_read_header(blk.c_str(), s.blocks, &bh)
+                    && bh.pos > s.pos)
+                {
+                    const uint32_t from = block_is_pax(&bh) ? 0 : s.pos;
+                    buffer.resize(sizeof(bh) + block_used(&bh) - from);
+                    memcpy(buffer.data(), &bh, sizeof(bh));
+
+                    // decompressed, followers store blocks as they are in memory
+                    block* b = block_read(blk.c_str(), s.blocks);
+                    if (b) {
+                        memcpy(buffer.data()+sizeof(bh), b->data + from, block_used(&bh) - from);
+                        block_free(b);
+
+                        memset(&h, 0, sizeof(h));
+                        h.m_type = repl_delta;
+                        h.m_block = s.blocks;
+                        h.m_offset = from;
+                        h.m_length = buffer.size();
+                        ok = send_msg(fd, h, blk, buffer.data());
+                        s.pos = bh.pos;
+                    }
+                }
+
+                // bulk copy of new blocks
+                while (ok && s.blocks < blocks) {
+                    const uint32_t n = std::min<uint32_t>(blocks - s.blocks, REPL_BATCH);
+                    buffer.resize(n * sizeof(block));
+
+                    uint32_t i = 0;
+                    for (; i < n; ++i) {
+                        block* b = block_read(blk.c_str(), s.blocks + i + 1);
+                        if (!b)
+                            break;
+
+                        memcpy(buffer.data() + i * sizeof(block), b, sizeof(block));
+                        block_free(b);
+                    }
+
+                    if (i != n)
+                        break;
+
+                    memset(&h, 0, sizeof(h));
+                    h.m_type = repl_blocks;
+                    h.m_block = s.blocks + 1;
+                    h.m_length = buffer.size();
+                    ok = send_msg(fd, h, blk, buffer.data());
+
+                    const block_header* last = reinterpret_cast<block_header*>(
+                        buffer.data() + (n-1) * sizeof(block)
+                    );
+
+                    s.blocks += n;
+                    s.pos = last->pos;
+                }
+
+                // totals, sealed blocks never change once counted
+                while (s.counted + 1 < blocks && block_read_header(blk.c_str(), s.counted+1, &bh)) {
+                    s.rows += bh.rows;
+                    s.bytes += block_used(&bh);
+                    ++s.counted;
+                }
+
+                rows += s.rows;
+                bytes += s.bytes;
+
+                if (blocks != 0 && block_read_header(blk.c_str(), blocks, &bh)) {
+                    rows += bh.rows;
+                    bytes += block_used(&bh);
+                }
+            }
+
+            memset(&h, 0, sizeof(h));
+            h.m_type = repl_status;
+            h.m_rows = rows;
+            h.m_bytes = bytes;
+            ok = ok && send_msg(fd, h, "", nullptr);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(REPL_POLL_MS));
+        }
+    }
+
+    repl_follower::~repl_follower() {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    bool repl_follower::connect() {
+        std::vector<repl_state> hello;
+
+        for (auto &name : list_tables()) {
+            repl_state s;
+            memset(&s, 0, sizeof(s));
+            strncpy(s.m_name, name.c_str(), sizeof(s.m_name)-1);
+
+            struct stat st;
+            const std::string frm = name+".tbl";
+            const std::string blk = name+".blk";
+
+            if (stat(frm.c_str(), &st) == 0)
+                s.m_frm = st.st_size;
+
+            if (stat((name+".blob").c_str(), &st) == 0)
+                s.m_blob = st.st_size;
+
+            s.m_blocks = block_num(blk.c_str());
+
+            for (uint32_t i = 1; i <= s.m_blocks; ++i) {
+                block_header bh;
+                if (!block_read_header(blk.c_str(), i, &bh))
+                    break;
+
+                account(blk, i, bh.rows, block_used(&bh));
+                s.m_pos = bh.pos;
+            }
+
+            hello.push_back(s);
+        }
+
+        m_fd = repl_socket(m_address, false);
+        if (m_fd < 0) {
+            perror("Unable to connect to primary");
+            return false;
+        }
+
+        repl_header h;
+        memset(&h, 0, sizeof(h));
+        h.m_type = repl_hello;
+        h.m_length = hello.size() * sizeof(repl_state);
+
+        return send_msg(m_fd, h, "", hello.data());
+    }
+
+    bool repl_follower::apply() {
+        repl_header h;
+        if (m_fd < 0 || !recv_all(m_fd, &h, sizeof(h)))
+            return false;
+
+        if (h.m_length > max_length(h.m_type))
+            return false;
+
+        char name[256];
+        std::vector<char> payload(h.m_length);
+
+        if (!recv_all(m_fd, name, h.m_name) || !recv_all(m_fd, payload.data(), h.m_length))
+            return false;
+
+        name[h.m_name] = '\0';
+        const std::string file(name);
+
+        // no dots in front or slashes, files stay in the data directory
+        if (h.m_type != repl_status && (file.empty() || file[0] == '.' || file.find('/') != std::string::npos))
+            return false;
+
+        switch (h.m_type) {
+        case repl_file: {
+            const std::string tmp = file+".repl";
+            FILE* fp = fopen(tmp.c_str(), "wb");
+            if (!fp)
+                return false;
+
+            fwrite(payload.data(), 1, payload.size(), fp);
+            fclose(fp);
+            rename(tmp.c_str(), file.c_str());
+
+            // tables always come with a block file
+            if (file.size() > 4 && file.compare(file.size()-4, 4, ".tbl") == 0) {
+                const std::string blk = file.substr(0, file.size()-4)+".blk";
+                close(open(blk.c_str(), O_WRONLY|O_CREAT, 0644));
+            }
+        } break;
+        case repl_blocks: {
+            if (h.m_block == 0 || h.m_length % sizeof(block))
+                return false;
+
+            if (!write_at(file, payload.data(), payload.size(), (off_t)sizeof(block) * (h.m_block-1)))
+                return false;
+
+            for (uint32_t i = 0; i < h.m_length / sizeof(block); ++i) {
+                const block_header* bh = reinterpret_cast<block_header*>(payload.data() + i * sizeof(block));
+                account(file, h.m_block + i, bh->rows, block_used(bh));
+            }
+        } break;
+        case repl_delta: {
+            if (h.m_block == 0 || h.m_length < sizeof(block_header)
+                || h.m_offset > BLOCK_DSIZE - (h.m_length - sizeof(block_header)))
+                return false;
+
+            const block_header* bh = reinterpret_cast<block_header*>(payload.data());
+            const off_t off = (off_t)sizeof(block) * (h.m_block-1);
+
+            // same order as block_write, data first
+            if (!write_at(file, payload.data() + sizeof(block_header), h.m_length - sizeof(block_header),
+                off + sizeof(block_header) + h.m_offset))
+                return false;
+
+            // a transposed block is shipped in full, clear the row data it replaced like the primary did
+            if (block_is_pax(bh) && h.m_offset == 0 && block_used(bh) < BLOCK_DSIZE) {
+                const std::vector<char> zero(BLOCK_DSIZE - block_used(bh), 0);
+                if (!write_at(file, zero.data(), zero.size(), off + sizeof(block_header) + block_used(bh)))
+                    return false;
+            }
+
+            if (!write_at(file, bh, sizeof(block_header), off))
+                return false;
+
+            account(file, h.m_block, bh->rows, block_used(bh));
+        } break;
+        case repl_append: {
+            if (h.m_length < sizeof(uint64_t))
+                return false;
+
+            uint64_t off;
+            memcpy(&off, payload.data(), sizeof(off));
+
+            // appends continue the file or rewrite it from the start, never leave a hole
+            struct stat st;
+            const uint64_t size = stat(file.c_str(), &st) == 0 ? st.st_size : 0;
+            if (off > size)
+                return false;
+
+            if (!write_at(file, payload.data() + sizeof(off), h.m_length - sizeof(off), off))
+                return false;
+        } break;
+        case repl_status:
+            m_primary_rows = h.m_rows;
+            m_primary_bytes = h.m_bytes;
+            break;
+        default:
+            return false;
+        }
+
+        return true;
+    }
+
+    repl_lag repl_follower::lag() {
+        const uint64_t rows = m_rows;
+        const uint64_t bytes = m_bytes;
+        const uint64_t primary_rows = m_primary_rows;
+        const uint64_t primary_bytes = m_primary_bytes;
+
+        return {
+            primary_rows > rows ? primary_rows - rows : 0,
+            primary_bytes > bytes ? primary_bytes - bytes : 0
+        };
+    }
+
+    void repl_follower::account(const std::string& file, uint32_t num, uint32_t rows, uint32_t bytes) {
+        auto it = m_tails.find(file);
+        if (it == m_tails.end())
+            it = m_tails.insert({file, {0, 0, 0, 0, 0}}).first;
+
+        tail& t = it->second;
+        if (num < t.m_block)
+            return;
+
+        const uint64_t rows_before = t.m_rows + t.m_tail_rows;
+        const uint64_t bytes_before = t.m_bytes + t.m_tail_bytes;
+
+        if (num > t.m_block) {
+            // previous tail got sealed
+            t.m_rows += t.m_tail_rows;
+            t.m_bytes += t.m_tail_bytes;
+            t.m_block = num;
+        }
+
+        t.m_tail_rows = rows;
+        t.m_tail_bytes = bytes;
+
+        m_rows += (t.m_rows + t.m_tail_rows) - rows_before;
+        m_bytes += (t.m_bytes + t.m_tail_bytes) - bytes_before;
+    }
+} /* deltadb */
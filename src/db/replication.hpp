@@ -0,0 +1,214 @@
+/**
+ * @file replication.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_REPLICATION_HPP
+#define DELTADB_DB_REPLICATION_HPP
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+
+#include "../internal/platform.hpp"
+
+/** Milliseconds between two scans of the data directory */
+#define REPL_POLL_MS 50
+
+/** Maximum number of blocks shipped in a single message */
+#define REPL_BATCH 32
+
+/** Maximum number of tables a follower announces in its hello */
+#define REPL_MAX_TABLES 65536
+
+namespace deltadb {
+    /** Replication message types */
+    enum repl_type {
+        repl_hello  = 0, /// Follower state, list of repl_state
+        repl_file   = 1, /// Whole file, replaces the followers copy (schema)
+        repl_blocks = 2, /// One or more complete blocks, decompressed, written verbatim
+        repl_delta  = 3, /// Tail block header followed by the bytes appended since the last delta
+        repl_status = 4, /// Primary totals
+        repl_append = 5  /// 64 bit file offset followed by the bytes written there (blob files)
+    };
+
+    /** Message header, followed by the file name and length bytes of payload */
+    struct repl_header {
+        /** Message type */
+        uint8_t m_type;
+        /** Length of the file name */
+        uint8_t m_name;
+        /** Unused */
+        uint16_t m_pad;
+        /** Block number, starts at 1 */
+        uint32_t m_block;
+        /** Offset into block data for repl_delta */
+        uint32_t m_offset;
+        /** Payload size */
+        uint32_t m_length;
+        /** Rows written on the primary */
+        uint64_t m_rows;
+        /** Row bytes written on the primary */
+        uint64_t m_bytes;
+    } packed;
+
+    /** Per table replication state as send with repl_hello */
+    struct repl_state {
+        /** Table name */
+        char m_name[34];
+        /** Number of blocks */
+        uint32_t m_blocks;
+        /** Data position in the last block */
+        uint32_t m_pos;
+        /** Size of the table definition */
+        uint64_t m_frm;
+        /** Size of the blob file */
+        uint64_t m_blob;
+    } packed;
+
+    /** Replication lag of a follower */
+    struct repl_lag {
+        /** Rows not yet applied */
+        uint64_t m_rows;
+        /** Row bytes not yet applied */
+        uint64_t m_bytes;
+    };
+
+    /**
+     * Ships the data directory to connected followers.
+     *
+     * Runs alongside the database and only looks at the files in the working directory:
+     * new tables and schema changes are send as whole files, sealed blocks are copied in
+     * bulk and the tail block is followed by shipping what was appended after each flush.
+     * Blob files are followed the same way, ahead of the blocks that reference them.
+     * Lag is therefore relative to the flushed state of the primary.
+     *
+     * Addresses are either "unix:<path>" or "<host>:<port>".
+     */
+    class repl_primary : private boost::noncopyable {
+    public:
+        /** Constructor */
+        repl_primary(const char* address) : m_address(address), m_fd(-1), m_stop(false) {}
+
+        /** Destructor */
+        ~repl_primary() {
+            stop();
+        }
+
+        /** Start listening for followers */
+        bool start();
+
+        /** Disconnect all followers */
+        void stop();
+    private:
+        /** Connected follower */
+        struct follower {
+            /** Thread serving it */
+            std::thread m_thread;
+            /** Socket, closed once done */
+            int m_fd;
+            /** Whether the thread is done and can be joined */
+            bool m_done;
+        };
+
+        /** Listening address */
+        std::string m_address;
+        /** Listening socket */
+        int m_fd;
+        /** Stop flag */
+        std::atomic<bool> m_stop;
+        /** Accept thread */
+        std::thread m_accept;
+        /** Followers, finished ones are reaped on the next accept */
+        std::list<follower> m_followers;
+        /** Guards m_followers */
+        std::mutex m_lock;
+
+        /** Accept followers */
+        void accept();
+
+        /** Serve a follower and mark it done */
+        void serve(follower* f);
+
+        /** Ship changes to a single follower until it disconnects */
+        void ship(int fd);
+    };
+
+    /** Applies a replication stream to the working directory */
+    class repl_follower : private boost::noncopyable {
+    public:
+        /** Constructor */
+        repl_follower(const char* address)
+            : m_address(address), m_fd(-1), m_rows(0), m_bytes(0), m_primary_rows(0), m_primary_bytes(0) {}
+
+        /** Destructor */
+        ~repl_follower();
+
+        /** Connect to primary and send our current state */
+        bool connect();
+
+        /** Apply a single message, returns false once the connection is gone */
+        bool apply();
+
+        /** Apply messages until the connection is gone */
+        void run() {
+            while (apply()) {}
+        }
+
+        /** Returns how far this follower is behind the primary */
+        repl_lag lag();
+    private:
+        /** Per table state */
+        struct tail {
+            /** Rows and bytes in sealed blocks */
+            uint64_t m_rows;
+            uint64_t m_bytes;
+            /** Current tail block */
+            uint32_t m_block;
+            uint32_t m_tail_rows;
+            uint32_t m_tail_bytes;
+        };
+
+        /** Primary address */
+        std::string m_address;
+        /** Connection */
+        int m_fd;
+        /** Applied state per block file */
+        std::unordered_map<std::string, tail> m_tails;
+        /** Applied rows and bytes */
+        std::atomic<uint64_t> m_rows;
+        std::atomic<uint64_t> m_bytes;
+        /** Last known primary totals */
+        std::atomic<uint64_t> m_primary_rows;
+        std::atomic<uint64_t> m_primary_bytes;
+
+        /** Account for a block header being applied */
+        void account(const std::string& file, uint32_t num, uint32_t rows, uint32_t bytes);
+    };
+} /* deltadb */
+
+#endif /* DELTADB_DB_REPLICATION_HPP */
@@ -0,0 +1,270 @@
+/**
+ * @file shard.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <string>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "table.hpp"
+#include "table_col.hpp"
+#include "table_row.hpp"
+#include "shard.hpp"
+
+namespace deltadb {
+    shard::shard(uint32_t id, uint32_t producers) : m_id(id), m_stop(false) {
+        for (uint32_t i = 0; i < producers; ++i) {
+            m_queues.push_back(new queue_t());
+        }
+
+        m_thread = std::thread(&shard::run, this);
+    }
+
+    shard::~shard() {
+        m_stop.store(true, std::memory_order_release);
+        m_thread.join();
+
+        for (auto q : m_queues) {
+            delete q;
+        }
+    }
+
+    void shard::submit(uint32_t producer, const shard_op& op) {
+        assert(producer < m_queues.size());
+
+        while (!m_queues[producer]->push(op)) {
+            std::this_thread::yield();
+        }
+    }
+
+    void shard::run() {
+#ifdef __linux__
+        // pin to core
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_id % std::thread::hardware_concurrency(), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+
+        auto last_flush = std::chrono::steady_clock::now();
+        shard_op op;
+
+        for (;;) {
+            // read stop flag before draining so nothing queued in front of it gets lost
+            const bool stop = m_stop.load(std::memory_order_acquire);
+            bool idle = true;
+
+            for (auto q : m_queues) {
+                while (q->pop(op)) {
+                    execute(op);
+                    idle = false;
+                }
+            }
+
+            if (stop)
+                break;
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_flush > std::chrono::milliseconds(SHARD_FLUSH_MS)) {
+                for (auto &t : m_tables) {
+                    t.second->flush();
+                }
+
+                last_flush = now;
+            }
+
+            if (idle)
+                std::this_thread::yield();
+        }
+
+        // destructors flush the active blocks
+        for (auto &t : m_tables) {
+            delete t.second;
+        }
+
+        m_tables.clear();
+    }
+
+    void shard::execute(shard_op& op) {
+        switch (op.m_kind) {
+        case shard_op::op_open:
+            m_tables[op.m_table] = new table(partition(op.m_table));
+            break;
+        case shard_op::op_create: {
+            if (m_tables.find(op.m_table) == m_tables.end()) {
+                table* t = new table(partition(op.m_table));
+                t->set_columns(op.m_data.p_cols, op.m_len, op.m_flags);
+                m_tables[op.m_table] = t;
+            } else {
+                for (uint32_t i = 0; i < op.m_len; ++i) {
+                    delete op.m_data.p_cols[i];
+                }
+            }
+
+            delete[] op.m_data.p_cols;
+        } break;
+        case shard_op::op_write: {
+            auto tbl = m_tables.find(op.m_table);
+            assert(tbl != m_tables.end());
+
+            tbl->second->write(op.m_data.p_row);
+            delete op.m_data.p_row;
+        } break;
+        case shard_op::op_barrier:
+            op.m_data.p_barrier->fetch_sub(1, std::memory_order_release);
+            break;
+        }
+    }
+
+    std::string shard::partition(const char* table) {
+        return std::string(table)+"."+std::to_string(m_id);
+    }
+
+    bool shard_pool::open(const char* path) {
+        assert(m_shards > 0 && m_producers > 0);
+
+        // Set cwd to data directory
+        if (chdir(path) != 0) {
+            perror("Unable to set cwd");
+            return false;
+        }
+
+        // Aquire db lock
+        if (!m_lock.aquire()) {
+            perror("Unable to aquire database lock");
+            return false;
+        }
+
+        for (uint32_t i = 0; i < m_shards; ++i) {
+            m_workers.push_back(new shard(i, m_producers));
+        }
+
+        // Hand each partition to the shard owning it, so it is loaded on that core
+        DIR *dp;
+        struct dirent *file;
+
+        if((dp = opendir("./")) == NULL) {
+            perror("Unable to list directory");
+            return false;
+        }
+
+        while((file=readdir(dp)) != NULL) {
+            const size_t len = strlen(file->d_name);
+            if (len < 4 || strcmp(file->d_name+(len-3), "tbl") != 0)
+                continue;
+
+            // <table>.<shard>.tbl
+            auto name = std::string(file->d_name, len-4);
+            auto dot = name.rfind('.');
+            if (dot == std::string::npos || dot > 32)
+                continue;
+
+            // the shard has to be all digits, anything else is not a partition
+            const char* suffix = name.c_str()+dot+1;
+            char* end;
+            const unsigned long id = strtoul(suffix, &end, 10);
+            if (!isdigit((unsigned char)*suffix) || *end != '\0')
+                continue;
+
+            if (id >= m_shards) {
+                fprintf(stderr, "Ignoring partition %s, only %u shards\n", name.c_str(), m_shards);
+                continue;
+            }
+
+            shard_op op;
+            op.m_kind = shard_op::op_open;
+            op.m_len = 0;
+            memcpy(op.m_table, name.c_str(), dot);
+            op.m_table[dot] = '\0';
+            m_workers[id]->submit(0, op);
+        }
+
+        closedir(dp);
+        return true;
+    }
+
+    void shard_pool::close() {
+        for (auto w : m_workers) {
+            delete w;
+        }
+
+        m_workers.clear();
+        m_lock.release();
+    }
+
+    void shard_pool::create(uint32_t producer, const char* name, col** t, uint32_t len, uint8_t flags) {
+        // leave room for the ".<shard>" suffix
+        assert(strlen(name) <= 28);
+
+        for (uint32_t i = 0; i < m_workers.size(); ++i) {
+            shard_op op;
+            op.m_kind = shard_op::op_create;
+            op.m_len = len;
+            op.m_flags = flags;
+            strcpy(op.m_table, name);
+
+            op.m_data.p_cols = new col*[len];
+            for (uint32_t j = 0; j < len; ++j) {
+                op.m_data.p_cols[j] = new col(*t[j]);
+            }
+
+            m_workers[i]->submit(producer, op);
+        }
+    }
+
+    void shard_pool::write_row(uint32_t producer, const char* table, uint64_t key, row* r) {
+        assert(strlen(table) <= 28);
+
+        shard_op op;
+        op.m_kind = shard_op::op_write;
+        op.m_len = 0;
+        op.m_data.p_row = r;
+        strcpy(op.m_table, table);
+
+        m_workers[key % m_workers.size()]->submit(producer, op);
+    }
+
+    void shard_pool::sync(uint32_t producer) {
+        std::atomic<uint32_t> pending(m_workers.size());
+
+        shard_op op;
+        op.m_kind = shard_op::op_barrier;
+        op.m_len = 0;
+        op.m_table[0] = '\0';
+        op.m_data.p_barrier = &pending;
+
+        for (auto w : m_workers) {
+            w->submit(producer, op);
+        }
+
+        while (pending.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+} /* deltadb */
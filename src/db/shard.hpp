@@ -0,0 +1,161 @@
+/**
+ * @file shard.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_SHARD_HPP
+#define DELTADB_DB_SHARD_HPP
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "../config.hpp"
+#include "../internal/filesystem.hpp"
+#include "../internal/spsc_queue.hpp"
+#include "table_col.hpp"
+
+/** Number of pending operations per producer and shard */
+#define SHARD_QUEUE_SIZE 4096
+
+/** Milliseconds between two flushes of an idle shard */
+#define SHARD_FLUSH_MS 100
+
+namespace deltadb {
+    // forward decl
+    class table;
+    struct row;
+
+    /** Operation routed to a shard */
+    struct shard_op {
+        /** Operation kinds */
+        enum kind {
+            op_open    = 0, /// Open existing partition
+            op_create  = 1, /// Create partition
+            op_write   = 2, /// Append row
+            op_barrier = 3  /// Signal once all previous operations are done
+        };
+
+        /** Operation kind */
+        uint8_t m_kind;
+        /** Table name */
+        char m_table[33];
+        /** Number of columns for op_create */
+        uint32_t m_len;
+        /** Table flags for op_create */
+        uint8_t m_flags;
+        /** Payload */
+        union {
+            row* p_row;
+            col** p_cols;
+            std::atomic<uint32_t>* p_barrier;
+        } m_data;
+    };
+
+    /** A single worker thread owning a set of table partitions */
+    class shard : private boost::noncopyable {
+    public:
+        /** Constructor, spawns the worker thread */
+        shard(uint32_t id, uint32_t producers);
+
+        /** Destructor, drains all queues and flushes the owned tables */
+        ~shard();
+
+        /** Queue operation, spins while the queue is full */
+        void submit(uint32_t producer, const shard_op& op);
+    private:
+        typedef spsc_queue<shard_op, SHARD_QUEUE_SIZE> queue_t;
+
+        /** Shard id */
+        uint32_t m_id;
+        /** One queue per producer */
+        std::vector<queue_t*> m_queues;
+        /** Owned partitions, only touched by the worker */
+        std::unordered_map<std::string, table*> m_tables;
+        /** Stop flag */
+        std::atomic<bool> m_stop;
+        /** Worker */
+        std::thread m_thread;
+
+        /** Worker loop */
+        void run();
+
+        /** Execute a single operation */
+        void execute(shard_op& op);
+
+        /** Partition name for table */
+        std::string partition(const char* table);
+    };
+
+    /**
+     * Shared-nothing database mode.
+     *
+     * Every table is split into one partition per shard, named "<table>.<shard>".
+     * Rows are routed to the shard owning their entity key and only that shard's thread
+     * ever touches the partition, its block cache or its files. Each producer thread
+     * submits through its own set of queues, identified by a producer id in
+     * [0, producers).
+     */
+    class shard_pool : private boost::noncopyable {
+    public:
+        /** Constructor */
+        shard_pool(uint32_t shards, uint32_t producers)
+            : m_lock("db.lock"), m_shards(shards), m_producers(producers) {}
+
+        /** Destructor */
+        ~shard_pool() {
+            close();
+        }
+
+        /**
+         * Open the database in the given data directory and start the shards.
+         *
+         * Existing partitions are opened through the queue of producer 0, open has to
+         * return before any producer submits.
+         */
+        bool open(const char* path = DELTADB_PATH_DATA);
+
+        /** Stop all shards */
+        void close();
+
+        /** Create a new table with the given table_flags on all shards, columns are copied */
+        void create(uint32_t producer, const char* name, col** t, uint32_t len, uint8_t flags = table_compact_masks);
+
+        /** Append a row to the partition owning key, the pool takes ownership of r */
+        void write_row(uint32_t producer, const char* table, uint64_t key, row* r);
+
+        /** Wait until all operations submitted by producer have been executed */
+        void sync(uint32_t producer);
+    private:
+        /** Database lock */
+        filelock m_lock;
+        /** Number of shards */
+        uint32_t m_shards;
+        /** Number of producers */
+        uint32_t m_producers;
+        /** Running shards */
+        std::vector<shard*> m_workers;
+    };
+} /* deltadb */
+
+#endif /* DELTADB_DB_SHARD_HPP */
@@ -19,16 +19,29 @@
  *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <string>
 #include <iostream>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cerrno>
 #include <cstdio>
 #include <cstdint>
 #include <cstring>
 
 #include "../internal/bitfield.hpp"
 #include "../internal/bitstream.hpp"
+#include "../internal/trace.hpp"
+#include "block_pax.hpp"
+#include "block_pool.hpp"
+#include "metrics.hpp"
+#include "table_blob.hpp"
 #include "table_col.hpp"
 #include "table_row.hpp"
+#include "table_version.hpp"
 #include "table.hpp"
 
 namespace deltadb {
@@ -38,10 +51,15 @@ namespace deltadb {
         }
 
         // write last block
-        if (m_tainted) {
-            std::string blk = m_name+".blk";
-            block_write(blk.c_str(), m_block, true);
+        flush();
+
+        if (table_version* v = m_versions.current()) {
+            for (auto b : v->m_sealed) {
+                block_free(b);
+            }
         }
+
+        block_free(m_block);
     }
 
     void table::from_file() {
@@ -74,37 +92,56 @@ namespace deltadb {
         }
 
         // read fields
-        uint32_t size = b.read(8);
+        uint32_t size = table_header_read(b, &m_flags);
         m_types.resize(size);
-        for (uint8_t i = 0; i < size; ++i) {
+        for (uint32_t i = 0; i < size; ++i) {
             m_types[i] = col_read(b);
         }
 
         // read blocks
         std::string blk = m_name+".blk";
+        if (!(m_flags & table_row_counts) || file_exists((blk+".legacy").c_str())) {
+            convert();
+            return;
+        }
 
+        std::vector<block*> sealed;
         uint32_t blocks = block_num(blk.c_str());
         for (uint32_t i = 1; i < blocks; ++i) {
-            m_cache.push_back(block_read(blk.c_str(), i));
+            sealed.push_back(block_read(blk.c_str(), i));
         }
 
-        m_tainted = true;
+        m_tainted = (blocks != 0);
         if (blocks != 0) {
             m_block = block_read(blk.c_str(), blocks);
         } else {
-            m_block = new block();
+            m_block = block_alloc();
+        }
+
+        // a transposed block is sealed, even if it is the last one
+        if (block_is_pax(m_block)) {
+            sealed.push_back(m_block);
+            m_block = block_alloc();
+            m_tainted = false;
         }
+
+        m_codec.init(m_types, m_flags);
+        m_plan.init(m_types);
+        load_codec();
+        open_blobs(false);
+        publish(std::move(sealed));
     }
 
     void table::create() {
         std::string frm = m_name+".tbl";
+        m_flags |= table_row_counts;
 
-        bitstream b(m_name.size() + 2 + m_types.size() * 161);
+        bitstream b(m_name.size() + 5 + m_types.size() * 161);
         b.write_bytes(&m_name[0], m_name.size());
         b.write(8, 0);
-        b.write(8, m_types.size());
+        table_header_write(b, m_types.size(), m_flags);
 
-        for (int i = 0; i < m_types.size(); ++i) {
+        for (uint32_t i = 0; i < m_types.size(); ++i) {
             col_write(b, m_types[i]);
         }
 
@@ -119,39 +156,250 @@ namespace deltadb {
 
         // create an empty block file
         std::string blk = m_name+".blk";
-        FILE* fp2 = fopen(blk.c_str(), "wb");
-        fclose(fp2);
+        // transposed blocks are smaller than a block, the index lets them be stored as such
+        if (!block_create(blk.c_str(), m_flags & (table_compressed | table_pax)))
+            perror("Unable to create block file");
 
         // set active block
-        m_block = new block();
+        block* dropped = m_block;
+        m_block = block_alloc();
         m_tainted = false;
+        m_dirty = false;
+        m_codec.init(m_types, m_flags);
+        m_plan.init(m_types);
+        open_blobs(true);
+        publish(std::vector<block*>(), dropped);
+    }
+
+    void table::convert() {
+        std::string blk = m_name+".blk";
+        std::string legacy = blk+".legacy";
+        const uint8_t flags = m_flags;
+
+        // an interrupted conversion starts over from the blocks kept aside
+        if (!file_exists(legacy.c_str()) && rename(blk.c_str(), legacy.c_str()) != 0 && errno != ENOENT) {
+            perror("Unable to convert table");
+            return;
+        }
+
+        std::cerr << "Converting " << m_name << " to blocks with row counts" << std::endl;
+        create();
+
+        int fd = open(legacy.c_str(), O_RDONLY);
+        if (fd != -1) {
+            // rows are read a word at a time, the buffer has room past the data
+            std::vector<char> buf(sizeof(block_legacy) + 16);
+            block_legacy* l = (block_legacy*)buf.data();
+            block_codec codec(m_types, flags);
+            arena a;
+
+            for (off_t off = 0; pread(fd, l, sizeof(block_legacy), off) == sizeof(block_legacy); off += sizeof(block_legacy)) {
+                assert(l->pos <= BLOCK_LEGACY_DSIZE);
+
+                bitstream b((bitstream::word_t*)l->data, BLOCK_LEGACY_DSIZE + 16);
+                while (b.position() < l->pos * 8) {
+                    write(row_read(m_plan, b, &a, &codec));
+                }
+
+                a.reset();
+            }
+
+            close(fd);
+        }
+
+        flush();
+        unlink(legacy.c_str());
+    }
+
+    void table::open_blobs(bool truncate) {
+        for (auto c : m_types) {
+            if (!col_is_blob(c))
+                continue;
+
+            if (!m_blobs.open(m_name+".blob", truncate))
+                perror("Unable to open blob file");
+
+            return;
+        }
+    }
+
+    void table::load_codec() {
+        m_codec.reset();
+        if (!m_codec.stateful())
+            return;
+
+        arena a;
+        bitstream b((bitstream::word_t*)m_block->data, BLOCK_DSIZE);
+
+        while (b.position() < m_block->pos * 8) {
+            row_read(m_plan, b, &a, &m_codec);
+        }
+    }
+
+    bool table::write(row *r) {
+        // large blob values are written first, the row keeps references
+        row copy;
+        if (m_blobs.is_open())
+            r = m_blobs.store(m_types, r, copy);
+
+        return write_encoded(r->m_fields, r->size(), [r](bitstream& b, block_codec& d) {
+            row_write(b, r, &d);
+        });
     }
 
-    void table::write(row *r) {
+    bool table::reserve(uint32_t size) {
         // @todo: this code is retarded
 
-        auto rem = r->size() + m_block->pos;
-        if (rem > BLOCK_DSIZE) {
+        // a row that does not fit into an empty block would overrun the next one
+        if (size > BLOCK_USABLE) {
+            std::cerr << "Row of " << size << " bytes does not fit into a block of " << m_name << std::endl;
+            metrics_add(metric_rows_rejected);
+            return false;
+        }
+
+        auto rem = size + m_block->pos;
+        if (rem > BLOCK_USABLE) {
+            assert(m_block->rows);
+
             // @todo compute crc
-            std::string blk = m_name+".blk";
+            std::vector<block*> sealed(m_versions.current()->m_sealed);
+            sealed.push_back(seal(m_block));
+
+            block* dropped = sealed.back() != m_block ? m_block : nullptr;
+            m_block = block_alloc();
+            m_tainted = false;
+            m_dirty = false;
+            m_codec.reset();
+            publish(std::move(sealed), dropped);
+
+            metrics_add(metric_blocks_sealed);
+        }
+
+        return true;
+    }
+
+    block* table::seal(block* b) {
+        std::string blk = m_name+".blk";
+
+        if (m_flags & table_pax) {
+            block* copy = block_alloc();
+            memcpy(copy, b, sizeof(block_header) + b->pos);
 
-            if (m_tainted) {
-                block_write(blk.c_str(), m_block, true);
+            if (pax_transpose(m_types, m_flags, copy)) {
+                b = copy;
             } else {
-                block_write(blk.c_str(), m_block);
+                block_free(copy);
+                metrics_add(metric_pax_fallbacks);
             }
+        }
 
-            m_cache.push_back(m_block);
-            m_block = new block();
-            m_tainted = false;
+        block_seal(blk.c_str(), b, m_tainted, m_flags & table_compressed);
+        return b;
+    }
+
+    void table::publish(std::vector<block*> sealed, block* dropped) {
+        m_versions.publish(new table_version(std::move(sealed), m_block), dropped);
+    }
+
+    void table::commit(uint32_t size) {
+        m_block->pos += size;
+        m_block->rows += 1;
+        m_dirty = true;
+        m_versions.commit(m_block);
+
+        metrics_add(metric_rows_written);
+        metrics_add(metric_row_bytes, size);
+    }
+
+    void table::append(const std::vector<block*>& blocks) {
+        if (blocks.empty())
+            return;
+
+        std::string blk = m_name+".blk";
+        std::vector<block*> sealed(m_versions.current()->m_sealed);
+        block* dropped = m_block; // unless it is sealed as is
+
+        if (m_block->rows) {
+            sealed.push_back(seal(m_block));
+            if (sealed.back() == m_block)
+                dropped = nullptr;
+        }
+
+        for (auto b : blocks) {
+            if (b == blocks.back()) {
+                block_write(blk.c_str(), b);
+                break;
+            }
+
+            if ((m_flags & table_pax) && !block_is_pax(b) && !pax_transpose(m_types, m_flags, b))
+                metrics_add(metric_pax_fallbacks);
+
+            block_seal(blk.c_str(), b, false, m_flags & table_compressed);
         }
 
-        bitstream b(
-            (bitstream::word_t*)(m_block->data + m_block->pos),
-            BLOCK_DSIZE - rem, bitstream::mode::io_writer
-        );
+        sealed.insert(sealed.end(), blocks.begin(), blocks.end() - 1);
+        m_block = blocks.back();
+        m_tainted = true;
+        m_dirty = false;
+        load_codec();
+        publish(std::move(sealed), dropped);
+
+        metrics_add(metric_blocks_sealed, blocks.size());
+    }
+
+    void table::flush() {
+        // blocks a snapshot held on to may be free by now
+        m_versions.reclaim();
+
+        if (!m_dirty)
+            return;
+
+        DELTADB_TRACE2(flush_start, m_name.c_str(), m_block->rows);
+
+        std::string blk = m_name+".blk";
+        block_write(blk.c_str(), m_block, m_tainted);
+
+        m_tainted = true;
+        m_dirty = false;
+
+        metrics_add(metric_blocks_flushed);
+        DELTADB_TRACE1(flush_done, m_name.c_str());
+    }
+
+    uint64_t table::count_column(uint16_t field, uint64_t lo, uint64_t hi, arena& a) {
+        assert(field < m_types.size() && m_types[field]->type() <= col_int64);
+
+        col* c = m_types[field];
+        const bool is_signed = !c->is_unsigned();
+        const uint32_t width = col_width(c->type());
+        const uint32_t shift = 64 - width * 8;
+        std::vector<uint64_t> match;
+        uint64_t ret = 0;
+
+        auto rows = [&](row* r) {
+            if (!r->has(field))
+                return;
+
+            uint64_t v = 0;
+            memcpy(&v, &r->get(field)->m_value, width);
+
+            if (is_signed) {
+                const int64_t sv = (int64_t)(v << shift) >> shift;
+                ret += sv >= (int64_t)lo && sv <= (int64_t)hi;
+            } else {
+                ret += v >= lo && v <= hi;
+            }
+        };
+
+        table_snapshot s = snapshot();
+        for (uint32_t i = 0; i < s.size(); ++i) {
+            if (block_is_pax(s.at(i))) {
+                ret += pax_select_column(m_types, s.at(i), field, lo, hi, match);
+            } else {
+                scan_block(s.at(i), rows, a);
+            }
+        }
 
-        row_write(b, r);
-        m_block->pos += r->size();
+        return ret;
     }
 }
@@ -22,21 +22,44 @@
 #ifndef DELTADB_DB_TABLE_HPP
 #define DELTADB_DB_TABLE_HPP
 
+#include <algorithm>
 #include <string>
+#include <vector>
 #include <cassert>
+#include <cstring>
 
+#include <boost/noncopyable.hpp>
+
+#include "../internal/arena.hpp"
+#include "../internal/bitstream.hpp"
 #include "../internal/filesystem.hpp"
+#include "../internal/trace.hpp"
 #include "block.hpp"
+#include "block_codec.hpp"
+#include "block_pax.hpp"
+#include "block_pool.hpp"
+#include "metrics.hpp"
+#include "profile.hpp"
+#include "table_blob.hpp"
 #include "table_col.hpp"
+#include "table_row.hpp"
+#include "table_version.hpp"
 
 namespace deltadb {
     // forward decl
-    struct row;
+    class table_snapshot;
 
+    /**
+     * Table with a single writer.
+     *
+     * Any number of threads may read it through snapshot, scan, scan_column and
+     * count_column while the writer appends, see table_snapshot. Blocks returned by blocks
+     * are only safe to read on the writer's thread or while nothing is written.
+     */
     class table {
     public:
         /** Constructor */
-        table(std::string name) : m_name(name) {
+        table(std::string name) : m_name(name), m_flags(table_compact_masks), m_block(nullptr), m_tainted(false), m_dirty(false) {
             assert(name.size() <= 32);
             auto frm = m_name+".tbl";
 
@@ -55,36 +78,358 @@ namespace deltadb {
             return !m_types.empty();
         }
 
-        /** Set columns for newly created table */
-        void set_columns(col** cols, uint8_t size) {
+        /**
+         * Set columns and table_flags for newly created table.
+         *
+         * Wide tables of strings and bytes can have rows that do not fit into a block,
+         * write rejects those.
+         */
+        void set_columns(col** cols, uint32_t size, uint8_t flags = table_compact_masks) {
             if (m_types.empty()) {
                 for (uint32_t i = 0; i < size; ++i) {
                     m_types.push_back(cols[i]);
                 }
+                m_flags = flags;
                 create();
             }
         }
 
-        /** Write row */
-        void write(row* r);
+        /**
+         * Write row.
+         *
+         * Returns false and writes nothing if the row does not fit into an empty block,
+         * large bytes values only fit if their column stores them in the blob file.
+         */
+        bool write(row* r);
+
+        /**
+         * Write a row encoded by fn(bitstream&, block_codec&), see typed_table.
+         *
+         * size is what row::size() would return for the row, the codec overhead of fields
+         * is added. fn has to encode the row as row_write does, with the codec given.
+         * Returns false as write does.
+         */
+        template <typename F>
+        bool write_encoded(const bitfield& fields, uint32_t size, F&& fn) {
+            metrics_timer timer(hist_table_write);
+            if (!reserve(size + m_codec.overhead(fields)))
+                return false;
+
+            bitstream b(
+                (bitstream::word_t*)(m_block->data + m_block->pos),
+                BLOCK_DSIZE - m_block->pos, bitstream::mode::io_writer
+            );
+
+            fn(b, m_codec);
+            commit(b.position() / 8);
+            return true;
+        }
+
+        /** Write the active block to disk if it has unflushed rows */
+        void flush();
+
+        /**
+         * Append encoded blocks, the table takes ownership.
+         *
+         * The active block is written out as is, even if not full, and the last appended
+         * block becomes the new active block.
+         */
+        void append(const std::vector<block*>& blocks);
+
+        /** Returns column types */
+        const std::vector<col*>& columns() {
+            return m_types;
+        }
+
+        /** Returns table_flags, pass them to block_codec to decode blocks of this table */
+        uint8_t flags() const {
+            return m_flags;
+        }
+
+        /**
+         * Returns a consistent view of the table, see table_snapshot.
+         *
+         * Safe to call from any thread while the writer appends.
+         */
+        table_snapshot snapshot();
+
+        /**
+         * Calls fn(row*) for every row in order.
+         *
+         * Rows are decoded into the arena, which is reset after each block. Rows are only
+         * valid for the duration of the callback, copy what has to outlive it. Large values
+         * of blob columns are left as BLOB_REF, fetch the ones that are used.
+         *
+         * If a profile is passed, decode time is added to it. Time spent inside fn is left
+         * out, the callback can attribute it to filter or aggregate with query_timer.
+         *
+         * Scans a snapshot taken on entry, rows written meanwhile are not seen.
+         */
+        template <typename F>
+        void scan(F&& fn, arena& a, query_profile* profile = nullptr);
+
+        /** Returns all blocks in order, including the active one, valid until the next write */
+        std::vector<block*> blocks() {
+            std::vector<block*> ret(m_versions.current()->m_sealed);
+            ret.push_back(m_block);
+            return ret;
+        }
+
+        /**
+         * Calls fn(row*) for every row of a single block, see scan.
+         *
+         * Blocks can be decoded concurrently as long as nothing is written, each thread
+         * needs its own arena.
+         */
+        template <typename F>
+        void scan_block(const block* blk, F& fn, arena& a, query_profile* profile = nullptr) {
+            DELTADB_TRACE2(block_decode_start, m_name.c_str(), blk->rows);
+
+            const uint64_t start = metrics_ticks();
+            uint64_t rows = 0;
+            uint64_t inner = 0;
+
+            auto call = [&](row* r) {
+                ++rows;
+
+                if (profile) {
+                    const uint64_t t = metrics_ticks();
+                    fn(r);
+                    inner += metrics_ticks() - t;
+                } else {
+                    fn(r);
+                }
+            };
+
+            if (block_is_pax(blk)) {
+                pax_reader reader(m_types, m_flags, blk);
+
+                while (row* r = reader.next(&a)) {
+                    call(r);
+                }
+            } else {
+                bitstream b((bitstream::word_t*)blk->data, BLOCK_DSIZE);
+                block_codec codec(m_types, m_flags);
+                const uint32_t end = blk->pos * 8;
+
+                while (b.position() < end) {
+                    call(row_read(m_plan, b, &a, &codec));
+                }
+            }
+
+            a.reset();
+
+            const uint64_t total = metrics_ticks() - start;
+            metrics_add(metric_rows_decoded, rows);
+            metrics_record(hist_block_decode, total);
+
+            if (profile) {
+                profile->m_ticks[stage_decode] += total - inner;
+                profile->m_blocks += 1;
+                profile->m_rows += rows;
+                profile->m_bytes += block_used(blk);
+            }
+
+            DELTADB_TRACE2(block_decode_done, m_name.c_str(), rows);
+        }
+
+        /** Returns the blob file, open if the table has blob columns */
+        blob_file& blobs() {
+            return m_blobs;
+        }
+
+        /**
+         * Replaces a BLOB_REF value read from this table by its bytes, allocated from the arena.
+         *
+         * Other values are left as they are. Returns false if the blob file can't be read.
+         */
+        bool fetch(row_value& v, arena& a) const {
+            return m_blobs.fetch(v, &a);
+        }
+
+        /**
+         * Calls fn(const row_value&) for every row that sets field, in order.
+         *
+         * Blocks in the PAX layout only read the values of field, all others are decoded
+         * in full. Values are valid for the duration of the callback, large values of a
+         * blob column are fetched, they stay BLOB_REF if that fails. Scans a snapshot, as
+         * scan does.
+         */
+        template <typename F>
+        void scan_column(uint16_t field, F&& fn, arena& a);
+
+        /**
+         * Counts the rows whose integer field is within [lo, hi].
+         *
+         * Values compare signed unless the column is unsigned, signed bounds are passed sign
+         * extended. PAX blocks evaluate the range on the encoded values of the column.
+         * Counts a snapshot, as scan does.
+         */
+        uint64_t count_column(uint16_t field, uint64_t lo, uint64_t hi, arena& a);
     private:
+        friend class table_snapshot;
+
         /** Table name */
         std::string m_name;
         /** Array of column types */
         std::vector<col*> m_types;
-        /** Array of cached blocks */
-        std::vector<block*> m_cache;
+        /** Table flags */
+        uint8_t m_flags;
         /** Last active block */
         block* m_block;
-        /** Modified block? */
+        /** Active block exists on disk? */
         bool m_tainted;
+        /** Active block has unflushed rows? */
+        bool m_dirty;
+        /** Codec state of the active block */
+        block_codec m_codec;
+        /** Row decoder compiled for the columns */
+        row_plan m_plan;
+        /** Large values of blob columns, open if the table has any */
+        blob_file m_blobs;
+        /** Sealed blocks and the active block as seen by snapshots */
+        table_versions m_versions;
 
         /** Read column data from file */
         void from_file();
 
         /** Create a table */
         void create();
+
+        /** Rewrite a table without table_row_counts, the old blocks are kept as <name>.blk.legacy until done */
+        void convert();
+
+        /** Rebuild m_codec from the rows already in the active block */
+        void load_codec();
+
+        /** Seal the active block if a row of size bytes does not fit, returns false if no block fits it */
+        bool reserve(uint32_t size);
+
+        /** Account a row of size bytes written to the active block */
+        void commit(uint32_t size);
+
+        /** Open the blob file if the table has blob columns */
+        void open_blobs(bool truncate);
+
+        /** Publish the sealed blocks and m_block, dropped is a block snapshots may still read */
+        void publish(std::vector<block*> sealed, block* dropped = nullptr);
+
+        /** Seal the active block, PAX tables transpose a copy as snapshots may read it */
+        block* seal(block* b);
     };
+
+    /**
+     * Consistent view of a table.
+     *
+     * A snapshot sees the blocks sealed when it was taken, plus the rows committed to the
+     * active block by then. It is read without locks while the writer keeps appending, and
+     * no block it references is recycled before it is released. The committed part of the
+     * active block is copied, the writer goes on filling the rest of it.
+     *
+     * A table has TABLE_SNAPSHOTS slots, taking a snapshot spins while all of them are
+     * held. Release snapshots when done, and before the table is destroyed.
+     */
+    class table_snapshot : private boost::noncopyable {
+    public:
+        /** Move constructor */
+        table_snapshot(table_snapshot&& s)
+            : m_table(s.m_table), m_version(s.m_version), m_slot(s.m_slot), m_active(s.m_active)
+        {
+            s.m_table = nullptr;
+            s.m_active = nullptr;
+        }
+
+        /** Destructor, releases the snapshot */
+        ~table_snapshot() {
+            block_free(m_active);
+            if (m_table)
+                m_table->m_versions.release(m_slot);
+        }
+
+        /** Returns the number of blocks, the last one is the active block */
+        uint32_t size() const {
+            return m_version->m_sealed.size() + 1;
+        }
+
+        /** Returns block i */
+        const block* at(uint32_t i) const {
+            return i < m_version->m_sealed.size() ? m_version->m_sealed[i] : m_active;
+        }
+
+        /** Returns the number of rows visible */
+        uint64_t rows() const {
+            uint64_t ret = m_active->rows;
+            for (auto b : m_version->m_sealed) {
+                ret += b->rows;
+            }
+
+            return ret;
+        }
+
+        /** Calls fn(row*) for every row visible, see table::scan */
+        template <typename F>
+        void scan(F&& fn, arena& a, query_profile* profile = nullptr) {
+            for (uint32_t i = 0; i < size(); ++i) {
+                m_table->scan_block(at(i), fn, a, profile);
+            }
+        }
+    private:
+        friend class table;
+
+        /** Table */
+        table* m_table;
+        /** Pinned version */
+        const table_version* m_version;
+        /** Slot to release */
+        uint32_t m_slot;
+        /** Copy of the committed part of the active block */
+        block* m_active;
+
+        /** Constructor, pins the current version of t */
+        table_snapshot(table* t) : m_table(t), m_version(t->m_versions.pin(m_slot)), m_active(block_alloc()) {
+            const uint64_t c = m_version->m_committed.load(std::memory_order_acquire);
+            m_active->pos = (uint32_t)c;
+            m_active->rows = c >> 32;
+
+            // rows are read a word at a time, past their end is zero as in blocks read from disk
+            memcpy(m_active->data, m_version->m_active->data, m_active->pos);
+            memset(m_active->data + m_active->pos, 0, std::min<uint32_t>(BLOCK_DSIZE - m_active->pos, 16));
+        }
+    };
+
+    inline table_snapshot table::snapshot() {
+        return table_snapshot(this);
+    }
+
+    template <typename F>
+    void table::scan(F&& fn, arena& a, query_profile* profile) {
+        snapshot().scan(fn, a, profile);
+    }
+
+    template <typename F>
+    void table::scan_column(uint16_t field, F&& fn, arena& a) {
+        assert(field < m_types.size());
+
+        auto values = [&](row_value v) {
+            fetch(v, a);
+            fn(v);
+        };
+
+        auto rows = [&](row* r) {
+            if (r->has(field))
+                values(*r->get(field));
+        };
+
+        table_snapshot s = snapshot();
+        for (uint32_t i = 0; i < s.size(); ++i) {
+            if (block_is_pax(s.at(i))) {
+                pax_scan_column(m_types, m_flags, s.at(i), field, &a, values);
+                a.reset();
+            } else {
+                scan_block(s.at(i), rows, a);
+            }
+        }
+    }
 } /* deltadb */
 
  #endif /* DELTADB_DB_TABLE_HPP */
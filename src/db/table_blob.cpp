@@ -0,0 +1,104 @@
+/**
+ * @file table_blob.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+
+#include "table_blob.hpp"
+
+namespace deltadb {
+    blob_file::~blob_file() {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    bool blob_file::open(const std::string& path, bool truncate) {
+        if (m_fd >= 0)
+            close(m_fd);
+
+        m_fd = ::open(path.c_str(), O_RDWR|O_CREAT|(truncate ? O_TRUNC : 0), 0644);
+        if (m_fd < 0)
+            return false;
+
+        struct stat st;
+        fstat(m_fd, &st);
+        m_end = st.st_size;
+        return true;
+    }
+
+    uint64_t blob_file::append(const char* data, uint32_t size) {
+        assert(m_fd >= 0);
+
+        // reserve first, concurrent appends write to their own range
+        const uint64_t off = m_end.fetch_add(size);
+        const ssize_t w = pwrite(m_fd, data, size, off);
+        assert(w == (ssize_t)size);
+        (void)w;
+
+        return off;
+    }
+
+    row* blob_file::store(const std::vector<col*>& cols, row* r, row& copy) {
+        row* ret = r;
+
+        for (uint32_t i = 0; i < r->m_data.size(); ++i) {
+            const row_value& v = r->m_data[i];
+            if (v.m_type != col_bytes || v.m_size <= BLOB_INLINE || !col_is_blob(cols[v.m_pos]))
+                continue;
+
+            if (ret == r) {
+                copy.m_fields = r->m_fields;
+                copy.m_data.assign(r->m_data.begin(), r->m_data.end());
+                ret = &copy;
+            }
+
+            row_value& ref = copy.m_data[i];
+            ref.m_type = BLOB_REF;
+            ref.m_value.v_u64 = append(v.m_value.v_bytes, v.m_size);
+        }
+
+        return ret;
+    }
+
+    bool blob_file::fetch(row_value& v, arena* a) const {
+        if (v.m_type != BLOB_REF)
+            return true;
+
+        if (m_fd < 0)
+            return false;
+
+        char* data = a ? static_cast<char*>(a->allocate(v.m_size, 1)) : new char[v.m_size];
+        if (pread(m_fd, data, v.m_size, v.m_value.v_u64) != v.m_size) {
+            if (!a)
+                delete[] data;
+
+            return false;
+        }
+
+        v.m_type = col_bytes;
+        v.m_value.v_bytes = data;
+        return true;
+    }
+} /* deltadb */
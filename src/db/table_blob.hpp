@@ -0,0 +1,80 @@
+/**
+ * @file table_blob.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_TABLE_BLOB_HPP
+#define DELTADB_DB_TABLE_BLOB_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+
+#include "../internal/arena.hpp"
+#include "table_col.hpp"
+#include "table_row.hpp"
+
+namespace deltadb {
+    /**
+     * Append-only file of the large values of a tables blob columns, <name>.blob.
+     *
+     * Rows keep the length and the offset of the value, it is written once and read back
+     * with fetch when the column is actually used. Appends are safe to run concurrently.
+     */
+    class blob_file : private boost::noncopyable {
+    public:
+        /** Constructor */
+        blob_file() : m_fd(-1), m_end(0) {}
+
+        /** Destructor */
+        ~blob_file();
+
+        /** Open the blob file at path, creating it if needed, truncate clears it */
+        bool open(const std::string& path, bool truncate = false);
+
+        /** Whether the file is open */
+        bool is_open() const {
+            return m_fd >= 0;
+        }
+
+        /** Appends size bytes, returns their offset */
+        uint64_t append(const char* data, uint32_t size);
+
+        /**
+         * Moves the values of blob columns larger than BLOB_INLINE into the file.
+         *
+         * r is left untouched. If a value is moved, copy is set to r with BLOB_REF values
+         * in their place and returned, otherwise r.
+         */
+        row* store(const std::vector<col*>& cols, row* r, row& copy);
+
+        /** Replaces a BLOB_REF value by its bytes allocated as in row_read, returns false if they can't be read */
+        bool fetch(row_value& v, arena* a = nullptr) const;
+    private:
+        /** File descriptor */
+        int m_fd;
+        /** End of the file, the offset of the next append */
+        std::atomic<uint64_t> m_end;
+    };
+} /* deltadb */
+
+#endif /* DELTADB_DB_TABLE_BLOB_HPP */
@@ -56,7 +56,30 @@ namespace deltadb {
             b.write(1, 1);
             b.write_bytes(c->m_comment, strlen(c->m_comment)+1);
         } else {
-            b.write(0, 0);
+            b.write(1, 0);
+        }
+    }
+
+    uint32_t table_header_read(bitstream& b, uint8_t* flags) {
+        const uint32_t size = b.read(8);
+
+        if (size == TABLE_EXTENDED) {
+            *flags = b.read(8);
+            return b.read(16);
+        }
+
+        *flags = size & table_compact_masks;
+        return size & ~table_compact_masks;
+    }
+
+    void table_header_write(bitstream& b, uint32_t columns, uint8_t flags) {
+        // 127 with the flag would read as TABLE_EXTENDED
+        if ((flags & ~table_compact_masks) == 0 && columns < 127) {
+            b.write(8, columns | flags);
+        } else {
+            b.write(8, TABLE_EXTENDED);
+            b.write(8, flags);
+            b.write(16, columns);
         }
     }
 }
@@ -22,8 +22,20 @@
 #ifndef DELTADB_DB_TABLE_COL_HPP
 #define DELTADB_DB_TABLE_COL_HPP
 
+#include <cstdint>
+
+#include "../internal/bitfield.hpp"
 #include "../internal/platform.hpp"
 
+/** Column count announcing an extended table header, see table_header_write */
+#define TABLE_EXTENDED 0xFF
+
+/** Most columns a table can have, one bit each in a row's bitfield */
+#define TABLE_MAX_COLUMNS (BITFIELD_WORDS * 64)
+
+/** Largest table definition, name, extended header and all columns with the longest name and comment */
+#define TABLE_MAX_DEFINITION (37 + TABLE_MAX_COLUMNS * 161)
+
 namespace deltadb {
     // forward decl
     class bitstream;
@@ -43,11 +55,21 @@ namespace deltadb {
 
     /** Type / Column flags */
     enum col_flags {
+        col_encoded  = (1 << 4), /// Per block encoding, dictionary for strings and XOR for floats, see block_codec,
+                                 /// bytes above BLOB_INLINE go to the blob file, see table_blob
         col_unsigned = (1 << 5), /// Encode as unsigned
         col_indexed  = (1 << 6), /// Keep column indexed
         col_sparse   = (1 << 7)  /// Encode as list of types, not the types themself
     };
 
+    /** Table flags, stored in the table header */
+    enum table_flags {
+        table_row_counts    = (1 << 4), /// Block headers carry a row count, tables without it are converted on open
+        table_compressed    = (1 << 5), /// Sealed blocks are stored compressed, see block_lz
+        table_pax           = (1 << 6), /// Sealed blocks are stored column by column, see block_pax
+        table_compact_masks = (1 << 7)  /// Row masks sized to the columns and coded per block, see block_codec
+    };
+
     /** Single table column */
     struct col {
         /** Returns type kind */
@@ -61,6 +83,11 @@ namespace deltadb {
             return m_data & col_unsigned;
         }
 
+        /** Whether values use the per block encoding of their type */
+        bool is_encoded() {
+            return m_data & col_encoded;
+        }
+
         /** Whether type is indexed */
         bool is_indexed() {
             return m_data & col_indexed;
@@ -79,11 +106,48 @@ namespace deltadb {
         char m_comment[128];
     };
 
+    /** Returns the encoded size in bytes of fixed width types, 0 for strings and bytes */
+    inline uint8_t col_width(uint8_t type) {
+        switch (type) {
+        case col_int8:
+        case col_bool:
+            return 1;
+        case col_int16:
+            return 2;
+        case col_int32:
+        case col_float:
+            return 4;
+        case col_int64:
+        case col_double:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+
+    /** Whether c is a blob column, bytes flagged col_encoded */
+    inline bool col_is_blob(col* c) {
+        return c->type() == col_bytes && c->is_encoded();
+    }
+
     /** Read column from bitstream */
     col* col_read(bitstream& b);
 
     /** Write column from bitstream */
     void col_write(bitstream& b, col* c);
+
+    /** Read column count and table_flags of a table definition, returns the count */
+    uint32_t table_header_read(bitstream& b, uint8_t* flags);
+
+    /**
+     * Write column count and table_flags of a table definition.
+     *
+     * Tables with less than 127 columns and no flags besides table_compact_masks use a
+     * single byte, the count with the flag in the upper bit. Others write TABLE_EXTENDED,
+     * the flags and a 16 bit count. Tables are created with table_row_counts, a single
+     * byte is only found in tables written before it.
+     */
+    void table_header_write(bitstream& b, uint32_t columns, uint8_t flags);
 } /* deltadb */
 
 #endif /* DELTADB_DB_TABLE_COL_HPP */
@@ -19,94 +19,618 @@
  *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 #include "../internal/bitstream.hpp"
+#include "../internal/trace.hpp"
+#include "block_codec.hpp"
 #include "table_col.hpp"
 #include "table_row.hpp"
 
 namespace deltadb {
-    row* row_read(std::vector<col*> c, bitstream& b) {
-        row* ret = new row();
-        ret->m_fields = ((uint64_t)b.read(32) << 32) | b.read(32);
-        uint64_t fields = ret->m_fields;
+    namespace {
+        /** Read the field mask of a row, plain masks without a codec cover 64 columns */
+        inline void read_fields(bitstream& b, bitfield& fields, block_codec* d) {
+            if (d) {
+                d->read_mask(b, fields);
+                return;
+            }
 
-        for (uint8_t i = 0; i < c.size(); ++i) {
-            if (!(fields & bit_at(i)))
-                continue;
+            fields.reset();
+            fields.set_word(0, ((uint64_t)b.read(32) << 32) | b.read(32));
+        }
+    }
 
-            row_value v;
-            v.m_size = 0;
-            v.m_type = c[i]->type();
+    row_value row_value_read(bitstream& b, col* c, uint16_t field, arena* a, block_codec* d) {
+        row_value v;
+        v.m_size = 0;
+        v.m_pos = field;
+        v.m_code = DICT_NONE;
+        v.m_type = c->type();
 
-            switch (v.m_type) {
-            case col_int8:
-                v.m_value.v_u8 = b.read(8);
+        switch (v.m_type) {
+        case col_int8:
+            v.m_value.v_u8 = b.read(8);
+            break;
+        case col_int16:
+            v.m_value.v_u16 = b.read(16);
+            break;
+        case col_int32:
+        case col_float:
+            if (c->is_encoded() && v.m_type == col_float) {
+                assert(d);
+                v.m_value.v_u64 = d->read_xor(b, field, 32);
                 break;
-            case col_int16:
-                v.m_value.v_u16 = b.read(16);
+            }
+
+            v.m_value.v_u32 = b.read(32);
+            break;
+        case col_int64:
+        case col_double:
+            if (c->is_encoded() && v.m_type == col_double) {
+                assert(d);
+                v.m_value.v_u64 = d->read_xor(b, field, 64);
                 break;
-            case col_int32:
-            case col_float:
-                v.m_value.v_u32 = b.read(32);
+            }
+
+            v.m_value.v_u64 = ((uint64_t)b.read(32) << 32) | b.read(32);
+            break;
+        case col_bool:
+            v.m_value.v_bool = b.read(8);
+            break;
+        case col_string: {
+            if (c->is_encoded()) {
+                assert(d);
+                v.m_value.v_bytes = const_cast<char*>(d->read_string(b, field, &v.m_code));
                 break;
-            case col_int64:
-            case col_double:
+            }
+
+            char str[256];
+            b.read_string(256, str);
+
+            const size_t len = strlen(str) + 1;
+            v.m_value.v_bytes = a ? static_cast<char*>(a->allocate(len, 1)) : new char[len];
+            memcpy(v.m_value.v_bytes, str, len);
+        } break;
+        case col_bytes:
+            v.m_size = b.read(16);
+
+            // large values of blob columns are stored as their offset into the blob file
+            if (c->is_encoded() && v.m_size > BLOB_INLINE) {
+                v.m_type = BLOB_REF;
                 v.m_value.v_u64 = ((uint64_t)b.read(32) << 32) | b.read(32);
                 break;
-            case col_bool:
-                v.m_value.v_bool = b.read(8);
+            }
+
+            v.m_value.v_bytes = a ? static_cast<char*>(a->allocate(v.m_size, 1)) : new char[v.m_size];
+            b.read_bytes(v.m_size, v.m_value.v_bytes);
+            break;
+        }
+
+        return v;
+    }
+
+    void row_value_write(bitstream& b, const row_value& v, block_codec* d) {
+        switch (v.m_type) {
+        case col_int8:
+            b.write(8, v.m_value.v_u8);
+            break;
+        case col_int16:
+            b.write(16, v.m_value.v_u16);
+            break;
+        case col_int32:
+        case col_float:
+            if (d && d->is_xor(v.m_pos)) {
+                d->write_xor(b, v.m_pos, v.m_value.v_u32, 32);
                 break;
-            case col_string:
-                v.m_value.v_bytes = new char[256];
-                b.read_string(255, v.m_value.v_bytes);
+            }
+
+            b.write(32, v.m_value.v_u32);
+            break;
+        case col_int64:
+        case col_double:
+            if (d && d->is_xor(v.m_pos)) {
+                d->write_xor(b, v.m_pos, v.m_value.v_u64, 64);
                 break;
-            case col_bytes:
-                v.m_size = b.read(16);
-                v.m_value.v_bytes = new char[v.m_size];
-                b.read_bytes(v.m_size, v.m_value.v_bytes);
+            }
+
+            b.write(32, (uint32_t)(v.m_value.v_u64 >> 32));
+            b.write(32, (uint32_t)(v.m_value.v_u64));
+            break;
+        case col_bool:
+            b.write(8, v.m_value.v_bool);
+            break;
+        case col_string:
+            if (d && d->encoded(v.m_pos)) {
+                d->write_string(b, v.m_pos, v.m_value.v_bytes, strlen(v.m_value.v_bytes));
+            } else {
+                b.write_bytes(v.m_value.v_bytes, strlen(v.m_value.v_bytes)+1);
+            }
+            break;
+        case col_bytes:
+            b.write(16, v.m_size);
+            b.write_bytes(v.m_value.v_bytes, v.m_size);
+            break;
+        case BLOB_REF:
+            assert(v.m_size > BLOB_INLINE);
+            b.write(16, v.m_size);
+            b.write(32, (uint32_t)(v.m_value.v_u64 >> 32));
+            b.write(32, (uint32_t)(v.m_value.v_u64));
+            break;
+        }
+    }
+
+    row* row_read(const std::vector<col*>& c, bitstream& b, arena* a, uint32_t* bits, block_codec* d) {
+        DELTADB_TRACE1(row_decode_start, b.position());
+
+        row* ret = a ? a->create<row>(a) : new row();
+        read_fields(b, ret->m_fields, d);
+        ret->m_data.reserve(ret->m_fields.count());
+
+        for (uint32_t i = 0; i < c.size(); ++i) {
+            if (!ret->m_fields.at(i))
+                continue;
+
+            const uint32_t start = b.position();
+
+            // XOR deltas are bit packed, everything else starts on a byte
+            if (!d || !d->is_xor(i))
+                block_codec::read_padding(b);
+
+            ret->m_data.push_back(row_value_read(b, c[i], i, a, d));
+
+            if (bits)
+                bits[i] = b.position() - start;
+        }
+
+        block_codec::read_padding(b);
+
+        DELTADB_TRACE2(row_decode_done, b.position(), ret->m_fields.word(0));
+        return ret;
+    }
+
+    namespace {
+        /** Loads a fixed width value of type Type, as row_value_read */
+        template <uint8_t Type>
+        void load_fixed(const char* p, row_value& v) {
+            switch (Type) {
+            case col_int8:
+                v.m_value.v_u64 = (uint8_t)*p;
+                break;
+            case col_bool:
+                v.m_value.v_u64 = 0;
+                v.m_value.v_bool = *p != 0;
                 break;
+            case col_int16: {
+                uint16_t x;
+                memcpy(&x, p, 2);
+                v.m_value.v_u64 = x;
+            } break;
+            case col_int32:
+            case col_float: {
+                uint32_t x;
+                memcpy(&x, p, 4);
+                v.m_value.v_u64 = x;
+            } break;
+            default: {
+                // high word first, see row_value_write
+                uint32_t hi, lo;
+                memcpy(&hi, p, 4);
+                memcpy(&lo, p + 4, 4);
+                v.m_value.v_u64 = ((uint64_t)hi << 32) | lo;
+            } break;
+            }
+        }
+
+        /** Rounds a bit position up to the next byte */
+        inline uint32_t align(uint32_t pos) {
+            return (pos + 7) & ~7u;
+        }
+    }
+
+    struct row_plan::cursor {
+        /** Stream being read */
+        bitstream& m_stream;
+        /** First byte of the stream */
+        const char* m_base;
+        /** Bits in the stream */
+        uint32_t m_end;
+        /** Arena for strings and bytes */
+        arena* m_arena;
+        /** Codec state of the block */
+        block_codec* m_codec;
+    };
+
+    void row_plan::init(const std::vector<col*>& c) {
+        static void (*const loads[])(const char*, row_value&) = {
+            load_fixed<col_int8>, load_fixed<col_int16>, load_fixed<col_int32>, load_fixed<col_int64>,
+            load_fixed<col_bool>, load_fixed<col_float>, load_fixed<col_double>
+        };
+
+        m_steps.resize(c.size());
+
+        for (uint32_t i = 0; i < c.size(); ++i) {
+            step& s = m_steps[i];
+            s.m_col = c[i];
+            s.m_type = c[i]->type();
+            s.m_width = col_width(s.m_type);
+            s.m_field = i;
+            s.m_xor = c[i]->is_encoded() && (s.m_type == col_float || s.m_type == col_double);
+
+            if (s.m_width && !s.m_xor) {
+                s.m_decode = decode_fixed;
+                s.m_load = loads[s.m_type];
+            } else {
+                s.m_width = 0;
+                s.m_decode = decode_value;
+                s.m_load = nullptr;
+            }
+        }
+
+        // runs, walked backwards to know where each one ends, they end with a word of the mask
+        uint64_t run = 0;
+        uint16_t bytes = 0;
+
+        for (uint32_t i = c.size(); i-- > 0;) {
+            step& s = m_steps[i];
+
+            if (!s.m_width || (i & 63) == 63) {
+                run = 0;
+                bytes = 0;
+            }
+
+            if (s.m_width) {
+                run = bit_set(i & 63, run);
+                bytes += s.m_width;
+            }
+
+            s.m_run = run;
+            s.m_run_bytes = bytes;
+        }
+
+        for (uint32_t i = 0; i < c.size(); ++i) {
+            step& s = m_steps[i];
+            const bool cont = s.m_width && (i & 63) != 0 && m_steps[i-1].m_width;
+            s.m_offset = cont ? m_steps[i-1].m_offset + m_steps[i-1].m_width : 0;
+        }
+    }
+
+    void row_plan::decode_fixed(const step& s, cursor& c, row_value& v) {
+        const uint32_t pos = align(c.m_stream.position());
+        assert(pos + s.m_width * 8 <= c.m_end);
+
+        s.m_load(c.m_base + pos / 8, v);
+        c.m_stream.seek(pos + s.m_width * 8);
+    }
+
+    void row_plan::decode_value(const step& s, cursor& c, row_value& v) {
+        if (!s.m_xor)
+            block_codec::read_padding(c.m_stream);
+
+        v = row_value_read(c.m_stream, s.m_col, s.m_field, c.m_arena, c.m_codec);
+    }
+
+    row* row_plan::read(bitstream& b, arena* a, block_codec* d) const {
+        DELTADB_TRACE1(row_decode_start, b.position());
+
+        row* ret = a ? a->create<row>(a) : new row();
+        read_fields(b, ret->m_fields, d);
+
+        // bits past the last column are ignored, as in row_read
+        const bitfield& mask = ret->m_fields;
+        const uint32_t columns = (m_steps.size() + 63) / 64;
+        const uint32_t words = std::min<uint32_t>(mask.words(), columns);
+        const uint64_t last = (m_steps.size() & 63) ? bit_at(m_steps.size() & 63) - 1 : ~0ull;
+
+        uint32_t count = 0;
+        for (uint32_t w = 0; w < words; ++w) {
+            count += __builtin_popcountll(mask.word(w) & (w + 1 == columns ? last : ~0ull));
+        }
+
+        // a single field costs more to set up for than to decode, read it as row_read does
+        if (count == 1) {
+            uint32_t w = 0;
+            while (!(mask.word(w) & (w + 1 == columns ? last : ~0ull))) {
+                ++w;
             }
 
-            ret->m_data.push_back(v);
+            const step& s = m_steps[w * 64 + __builtin_ctzll(mask.word(w))];
+
+            if (s.m_width) {
+                const uint32_t pos = align(b.position());
+                assert(pos + s.m_width * 8 <= b.position() + b.left());
+
+                row_value v;
+                v.m_type = s.m_type;
+                v.m_pos = s.m_field;
+                v.m_size = 0;
+                v.m_code = DICT_NONE;
+                s.m_load(reinterpret_cast<const char*>(b.buffer()) + pos / 8, v);
+
+                ret->m_data.push_back(v);
+                b.seek(pos + s.m_width * 8);
+            } else {
+                if (!s.m_xor)
+                    block_codec::read_padding(b);
+
+                ret->m_data.push_back(row_value_read(b, s.m_col, s.m_field, a, d));
+            }
+
+            block_codec::read_padding(b);
+
+            DELTADB_TRACE2(row_decode_done, b.position(), ret->m_fields.word(0));
+            return ret;
+        }
+
+        ret->m_data.resize(count);
+        row_value* out = ret->m_data.data();
+
+        cursor c = {b, reinterpret_cast<const char*>(b.buffer()), b.position() + b.left(), a, d};
+
+        for (uint32_t w = 0; w < words; ++w) {
+            const step* steps = m_steps.data() + w * 64;
+            uint64_t fields = mask.word(w) & (w + 1 == columns ? last : ~0ull);
+
+            // only the fields set are visited, lowest first
+            while (fields) {
+                const step& s = steps[__builtin_ctzll(fields)];
+
+                // the rest of a run is a single block of bytes, nothing pads the values
+                if (s.m_run && (fields & s.m_run) == s.m_run) {
+                    const uint32_t pos = align(b.position());
+                    assert(pos + s.m_run_bytes * 8 <= c.m_end);
+
+                    const char* p = c.m_base + pos / 8 - s.m_offset;
+                    for (uint64_t run = s.m_run; run; run &= run - 1) {
+                        const step& r = steps[__builtin_ctzll(run)];
+                        out->m_type = r.m_type;
+                        out->m_pos = r.m_field;
+                        out->m_size = 0;
+                        out->m_code = DICT_NONE;
+                        r.m_load(p + r.m_offset, *out++);
+                    }
+
+                    fields &= ~s.m_run;
+                    b.seek(pos + s.m_run_bytes * 8);
+                    continue;
+                }
+
+                out->m_type = s.m_type;
+                out->m_pos = s.m_field;
+                out->m_size = 0;
+                out->m_code = DICT_NONE;
+                s.m_decode(s, c, *out++);
+
+                fields &= fields - 1;
+            }
         }
 
+        block_codec::read_padding(b);
+
+        DELTADB_TRACE2(row_decode_done, b.position(), ret->m_fields.word(0));
         return ret;
     }
 
-    void row_write(bitstream& b, row* r) {
-        b.write(32, (uint32_t)(r->m_fields >> 32));
-        b.write(32, (uint32_t)(r->m_fields));
+    void row_release(row* r) {
+        for (auto &v : r->m_data) {
+            if ((v.m_type == col_string && v.m_code == DICT_NONE) || v.m_type == col_bytes)
+                delete[] v.m_value.v_bytes;
+        }
+
+        delete r;
+    }
+
+    void row_write(bitstream& b, row* r, block_codec* d) {
+        if (d) {
+            d->write_mask(b, r->m_fields);
+        } else {
+            assert(r->m_fields.words() <= 1);
+            b.write(32, (uint32_t)(r->m_fields.word(0) >> 32));
+            b.write(32, (uint32_t)(r->m_fields.word(0)));
+        }
 
         for (auto &v : r->m_data) {
-            switch (v.m_type) {
+            if (!d || !d->is_xor(v.m_pos))
+                block_codec::write_padding(b);
+
+            row_value_write(b, v, d);
+        }
+
+        block_codec::write_padding(b);
+    }
+
+    compact_layout::compact_layout(const std::vector<col*>& c) {
+        assert(c.size() <= 64);
+        m_widths[0] = m_widths[1] = m_widths[2] = m_widths[3] = 0;
+        memset(m_width, 0, sizeof(m_width));
+
+        for (uint8_t i = 0; i < c.size(); ++i) {
+            // strings and bytes keep a 4 byte tail offset
+            const uint8_t w = col_width(c[i]->type());
+            m_width[i] = w ? w : 4;
+            m_widths[__builtin_ctz(m_width[i])] |= bit_at(i);
+        }
+    }
+
+    compact_row* compact_row_create(const compact_layout& l, uint32_t tail, arena* a) {
+        const uint32_t slots = l.size(~0ull);
+        const uint32_t size = sizeof(compact_row) + slots + tail;
+
+        char* mem = a ? static_cast<char*>(a->allocate(size, alignof(compact_row))) : new char[size];
+        compact_row* ret = reinterpret_cast<compact_row*>(mem);
+
+        ret->m_fields = 0;
+        ret->m_layout = &l;
+        ret->m_tail_size = tail;
+        ret->m_tail_used = 0;
+        ret->m_size = slots;
+        ret->m_used = 0;
+        return ret;
+    }
+
+    compact_row* compact_row_read(const std::vector<col*>& c, const compact_layout& l, bitstream& b, arena* a,
+        block_codec* d)
+    {
+        // decode into scratch space first, the tail size is only known afterwards
+        static thread_local std::vector<uint64_t> scratch;
+        assert(c.size() <= 64);
+
+        const uint64_t fields = d ? d->read_mask(b) : ((uint64_t)b.read(32) << 32) | b.read(32);
+        const uint32_t slots = l.size(fields);
+        const uint32_t tail = b.left() / 8 + __builtin_popcountll(fields) * 5;
+        const uint32_t size = sizeof(compact_row) + slots + tail;
+
+        scratch.resize(size / 8 + 1);
+        compact_row* r = reinterpret_cast<compact_row*>(scratch.data());
+        r->m_fields = 0;
+        r->m_layout = &l;
+        r->m_tail_size = tail;
+        r->m_tail_used = 0;
+        r->m_size = slots;
+        r->m_used = 0;
+
+        for (uint8_t i = 0; i < c.size(); ++i) {
+            if (!(fields & bit_at(i)))
+                continue;
+
+            const uint8_t type = c[i]->type();
+            assert(!col_is_blob(c[i]));
+
+            if (c[i]->is_encoded() && (type == col_float || type == col_double)) {
+                assert(d);
+                if (type == col_float) {
+                    r->set<uint32_t>(i, d->read_xor(b, i, 32));
+                } else {
+                    r->set<uint64_t>(i, d->read_xor(b, i, 64));
+                }
+
+                continue;
+            }
+
+            block_codec::read_padding(b);
+
+            switch (type) {
             case col_int8:
-                b.write(8, v.m_value.v_u8);
+            case col_bool:
+                r->set<uint8_t>(i, b.read(8));
                 break;
             case col_int16:
-                b.write(16, v.m_value.v_u16);
+                r->set<uint16_t>(i, b.read(16));
                 break;
             case col_int32:
             case col_float:
-                b.write(32, v.m_value.v_u32);
+                r->set<uint32_t>(i, b.read(32));
                 break;
             case col_int64:
             case col_double:
-                b.write(32, (uint32_t)(v.m_value.v_u64 >> 32));
-                b.write(32, (uint32_t)(v.m_value.v_u64));
+                r->set<uint64_t>(i, ((uint64_t)b.read(32) << 32) | b.read(32));
                 break;
+            case col_string: {
+                if (c[i]->is_encoded()) {
+                    assert(d);
+                    uint16_t code;
+                    const char* str = d->read_string(b, i, &code);
+                    r->set_bytes(i, str, strlen(str));
+                    break;
+                }
+
+                char str[256];
+                b.read_string(256, str);
+                r->set_bytes(i, str, strlen(str));
+            } break;
+            case col_bytes: {
+                const uint32_t len = b.read(16);
+                char* p = r->tail() + r->m_tail_used;
+
+                // read in place, set_bytes copies onto itself
+                b.read_bytes(len, p + 4);
+                r->set_bytes(i, p + 4, len);
+            } break;
+            }
+        }
+
+        block_codec::read_padding(b);
+
+        // shrink tail to what is used
+        r->m_tail_size = r->m_tail_used;
+        const uint32_t used = r->allocated();
+
+        char* mem = a ? static_cast<char*>(a->allocate(used, alignof(compact_row))) : new char[used];
+        memcpy(mem, r, used);
+        return reinterpret_cast<compact_row*>(mem);
+    }
+
+    void compact_row_write(bitstream& b, const std::vector<col*>& c, compact_row* r, block_codec* d) {
+        if (d) {
+            d->write_mask(b, r->m_fields);
+        } else {
+            b.write(32, (uint32_t)(r->m_fields >> 32));
+            b.write(32, (uint32_t)(r->m_fields));
+        }
+
+        for (uint8_t i = 0; i < c.size(); ++i) {
+            if (!r->has(i))
+                continue;
+
+            const uint8_t type = c[i]->type();
+            assert(!col_is_blob(c[i]));
+
+            if (c[i]->is_encoded() && (type == col_float || type == col_double)) {
+                assert(d);
+                if (type == col_float) {
+                    d->write_xor(b, i, r->get<uint32_t>(i), 32);
+                } else {
+                    d->write_xor(b, i, r->get<uint64_t>(i), 64);
+                }
+
+                continue;
+            }
+
+            block_codec::write_padding(b);
+
+            switch (type) {
+            case col_int8:
             case col_bool:
-                b.write(8, v.m_value.v_bool);
+                b.write(8, r->get<uint8_t>(i));
                 break;
-            case col_string:
-                b.write_bytes(v.m_value.v_bytes, strlen(v.m_value.v_bytes)+1);
+            case col_int16:
+                b.write(16, r->get<uint16_t>(i));
                 break;
-            case col_bytes:
-                b.write(16, v.m_size);
-                b.write_bytes(v.m_value.v_bytes, v.m_size);
+            case col_int32:
+            case col_float:
+                b.write(32, r->get<uint32_t>(i));
                 break;
+            case col_int64:
+            case col_double: {
+                const uint64_t v = r->get<uint64_t>(i);
+                b.write(32, (uint32_t)(v >> 32));
+                b.write(32, (uint32_t)(v));
+            } break;
+            case col_string: {
+                uint32_t len;
+                const char* str = r->get_bytes(i, &len);
+
+                if (c[i]->is_encoded()) {
+                    assert(d);
+                    d->write_string(b, i, str, len);
+                } else {
+                    b.write_bytes(str, len+1);
+                }
+            } break;
+            case col_bytes: {
+                uint32_t len;
+                const char* data = r->get_bytes(i, &len);
+                b.write(16, len);
+                b.write_bytes(data, len);
+            } break;
             }
         }
+
+        block_codec::write_padding(b);
     }
 } /* deltadb */
@@ -22,14 +22,23 @@
 #ifndef DELTADB_DB_TABLE_ROW_HPP
 #define DELTADB_DB_TABLE_ROW_HPP
 
+#include <algorithm>
 #include <vector>
 #include <cstdint>
 
+#include "../internal/arena.hpp"
 #include "../internal/bitstream.hpp"
+#include "table_col.hpp"
+
+/** Largest value of a blob column stored in its row, larger ones go to the blob file */
+#define BLOB_INLINE 1024
+
+/** row_value::m_type of a reference to a value in the blob file, m_value.v_u64 is its offset */
+#define BLOB_REF (col_bytes | col_encoded)
 
 namespace deltadb {
     // forward decl
-    struct col;
+    class block_codec;
 
     /** Single value */
     struct row_value {
@@ -37,11 +46,17 @@ namespace deltadb {
         uint8_t m_type;
 
         /** Position */
-        uint8_t m_pos;
+        uint16_t m_pos;
 
         /** String size if applicable */
         uint16_t m_size;
 
+        /**
+         * Dictionary code of encoded strings set by row_read, DICT_NONE otherwise. The value
+         * which added the code to the dictionary is flagged DICT_ADDED.
+         */
+        uint16_t m_code;
+
         /** Actual value */
         union {
             int8_t   v_i8;
@@ -62,27 +77,27 @@ namespace deltadb {
     /** Row data */
     struct row {
         /** Fields set */
-        uint64_t m_fields;
+        bitfield m_fields;
         /** Data */
-        std::vector<row_value> m_data;
+        std::vector<row_value, arena_allocator<row_value>> m_data;
 
-        row() : m_fields(0) {}
+        /** Constructor, optionally placing the values in an arena */
+        row(arena* a = nullptr) : m_fields(), m_data(arena_allocator<row_value>(a)) {}
 
         /** Check if row has given field */
-        bool has(uint8_t field) {
-            return m_fields & bit_at(field);
+        bool has(uint16_t field) {
+            return m_fields.at(field);
         }
 
         /** Returns row_value for field */
-        row_value* get(uint8_t field) {
+        row_value* get(uint16_t field) {
             assert(has(field));
-            const uint8_t pos = __builtin_popcountll((m_fields & bits_until(field+1)));
-            return &m_data[pos - 1];
+            return &m_data[m_fields.rank(field)];
         }
 
         /** Set field to given value, requires sort if used out of order */
-        void set(uint8_t field, row_value v) {
-            m_fields = bit_set(field, m_fields);
+        void set(uint16_t field, row_value v) {
+            m_fields.set(field);
             v.m_pos = field;
             m_data.push_back(std::move(v));
         }
@@ -90,7 +105,7 @@ namespace deltadb {
         /** Sort m_data */
         void sort() {
             std::sort(m_data.begin(), m_data.end(), [](const row_value& a, const row_value& b) {
-                return a.m_pos > b.m_pos;
+                return a.m_pos < b.m_pos;
             });
         }
 
@@ -121,6 +136,9 @@ namespace deltadb {
                 case col_bytes:
                     ret += 2 + v.m_size;
                     break;
+                case BLOB_REF:
+                    ret += 2 + 8;
+                    break;
                 }
             }
 
@@ -128,11 +146,272 @@ namespace deltadb {
         }
     };
 
-    /** Read row from bitstream */
-    row* row_read(std::vector<col*> c, bitstream& b);
+    /**
+     * Slot widths of a schema, see compact_row.
+     *
+     * Columns are grouped by the width of their slot, 1, 2, 4 or 8 bytes. The slots of a
+     * set of fields take the sum of one popcount per group, scaled by its width.
+     */
+    struct compact_layout {
+        /** Columns with a slot of 1, 2, 4 and 8 bytes */
+        uint64_t m_widths[4];
+        /** Slot width per column */
+        uint8_t m_width[64];
+
+        /** Constructor, only tables of up to 64 columns are supported */
+        compact_layout(const std::vector<col*>& c);
+
+        /** Returns the slot bytes of the given fields */
+        uint32_t size(uint64_t fields) const {
+            return __builtin_popcountll(fields & m_widths[0])
+                + 2 * __builtin_popcountll(fields & m_widths[1])
+                + 4 * __builtin_popcountll(fields & m_widths[2])
+                + 8 * __builtin_popcountll(fields & m_widths[3]);
+        }
+
+        /** Returns the slot width of field */
+        uint32_t width(uint8_t field) const {
+            return m_width[field];
+        }
+
+        /** Returns the offset of field's slot in a row with the given fields */
+        uint32_t offset(uint64_t fields, uint8_t field) const {
+            return size(fields & bits_until(field));
+        }
+    };
+
+    /**
+     * Row stored in a single allocation.
+     *
+     * The header is followed by one slot per set field, in field order, and a tail for
+     * strings and bytes. Slots are as wide as the type of their field, a field's slot is
+     * found by summing the widths of the fields set before it, see compact_layout. Strings
+     * and bytes keep their 4 byte tail offset in the slot, the tail stores a 4 byte length,
+     * the data and a NUL byte.
+     *
+     * Fields have to be set in ascending order, rows must not outlive their layout.
+     */
+    struct compact_row {
+        /** Fields set */
+        uint64_t m_fields;
+        /** Slot widths of the schema */
+        const compact_layout* m_layout;
+        /** Tail capacity */
+        uint32_t m_tail_size;
+        /** Tail bytes in use */
+        uint32_t m_tail_used;
+        /** Slot capacity in bytes */
+        uint16_t m_size;
+        /** Slot bytes in use */
+        uint16_t m_used;
+
+        /** Check if row has given field */
+        bool has(uint8_t field) {
+            return m_fields & bit_at(field);
+        }
+
+        /** Returns slot of field */
+        char* slot(uint8_t field) {
+            assert(has(field));
+            return slots() + m_layout->offset(m_fields, field);
+        }
+
+        /** Returns fixed width value */
+        template <typename T>
+        T get(uint8_t field) {
+            assert(sizeof(T) <= m_layout->width(field));
+            T ret;
+            memcpy(&ret, slot(field), sizeof(T));
+            return ret;
+        }
+
+        /** Returns string or bytes value and its size */
+        const char* get_bytes(uint8_t field, uint32_t* size) {
+            const char* p = tail() + get<uint32_t>(field);
+
+            if (size)
+                memcpy(size, p, 4);
+
+            return p + 4;
+        }
+
+        /** Appends fixed width value */
+        template <typename T>
+        void set(uint8_t field, T v) {
+            assert(sizeof(T) <= m_layout->width(field));
+            memcpy(append(field), &v, sizeof(T));
+        }
+
+        /** Appends string or bytes value */
+        void set_bytes(uint8_t field, const char* data, uint32_t size) {
+            assert(m_tail_used + size + 5 <= m_tail_size);
+
+            const uint32_t off = m_tail_used;
+            set<uint32_t>(field, off);
+
+            char* p = tail() + off;
+            memcpy(p, &size, 4);
+            memmove(p + 4, data, size);
+            p[4 + size] = '\0';
+
+            m_tail_used += size + 5;
+        }
+
+        /** Returns slot array */
+        char* slots() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+
+        /** Returns tail */
+        char* tail() {
+            return slots() + m_size;
+        }
+
+        /** Returns size of the allocation */
+        uint32_t allocated() {
+            return sizeof(compact_row) + m_size + m_tail_size;
+        }
+    private:
+        /** Claim the next slot */
+        char* append(uint8_t field) {
+            const uint32_t width = m_layout->width(field);
+            assert(m_used + width <= m_size);
+            assert((m_fields & ~bits_until(field)) == 0); // ascending order
+
+            m_fields = bit_set(field, m_fields);
+            char* ret = slots() + m_used;
+            memset(ret, 0, width);
+
+            m_used += width;
+            return ret;
+        }
+    };
+
+    /** Create an empty compact row with room for all fields of the layout and tail bytes of strings and bytes */
+    compact_row* compact_row_create(const compact_layout& l, uint32_t tail, arena* a = nullptr);
+
+    /** Free a compact row created without an arena */
+    inline void compact_row_release(compact_row* r) {
+        delete[] reinterpret_cast<char*>(r);
+    }
+
+    /** Read compact row from bitstream, same encoding as row_read, blob columns are not supported */
+    compact_row* compact_row_read(const std::vector<col*>& c, const compact_layout& l, bitstream& b, arena* a = nullptr,
+        block_codec* d = nullptr);
+
+    /** Write compact row to bitstream, same encoding as row_write */
+    void compact_row_write(bitstream& b, const std::vector<col*>& c, compact_row* r, block_codec* d = nullptr);
+
+    /**
+     * Read a single value of column c, stored at index field.
+     *
+     * Values are read as they are, without the padding rows put in front of them. Strings
+     * and bytes are allocated as in row_read.
+     */
+    row_value row_value_read(bitstream& b, col* c, uint16_t field, arena* a = nullptr, block_codec* d = nullptr);
+
+    /** Write a single value, see row_value_read */
+    void row_value_write(bitstream& b, const row_value& v, block_codec* d = nullptr);
+
+    /**
+     * Read row from bitstream.
+     *
+     * If an arena is given, the row and all of its buffers are allocated from it and
+     * released with the arena. Otherwise free the row with row_release.
+     *
+     * If bits is given, the encoded size of every field present is stored at its index.
+     *
+     * Tables with encoded columns or compact masks require the codec state of the block
+     * being decoded, dictionary encoded strings point into the block instead of the arena.
+     * Large values of blob columns are returned as BLOB_REF, see blob_file::fetch.
+     */
+    row* row_read(const std::vector<col*>& c, bitstream& b, arena* a = nullptr, uint32_t* bits = nullptr,
+        block_codec* d = nullptr);
+
+    /**
+     * Decoder for rows of a schema, compiled once for row_read.
+     *
+     * Each column gets a step with its decode function and width resolved up front, so
+     * a row only visits the fields set in its mask. Fixed width values are loaded from
+     * the buffer directly. Runs of adjacent fixed width columns are decoded in one go
+     * when all of their fields are set, as nothing pads the values in between.
+     */
+    class row_plan {
+    public:
+        /** Constructor */
+        row_plan() {}
+
+        /** Constructor, see init */
+        row_plan(const std::vector<col*>& c) {
+            init(c);
+        }
+
+        /** Compile the steps for columns c, they have to outlive the plan */
+        void init(const std::vector<col*>& c);
+
+        /** Number of columns */
+        uint32_t size() const {
+            return m_steps.size();
+        }
+
+        /** Read row, see row_read */
+        row* read(bitstream& b, arena* a = nullptr, block_codec* d = nullptr) const;
+    private:
+        /** Read state of a single row */
+        struct cursor;
+
+        /** Single column */
+        struct step {
+            /** Decodes the value of the column */
+            void (*m_decode)(const step& s, cursor& c, row_value& v);
+            /** Loads a fixed width value from its first byte */
+            void (*m_load)(const char* p, row_value& v);
+            /** Column */
+            col* m_col;
+            /** Fixed width columns from this one to the end of its run, in its word of the mask, 0 if not fixed */
+            uint64_t m_run;
+            /** Bytes from this column to the end of its run */
+            uint16_t m_run_bytes;
+            /** Bytes from the start of the run to this column */
+            uint16_t m_offset;
+            /** Column type */
+            uint8_t m_type;
+            /** Encoded size of fixed width types */
+            uint8_t m_width;
+            /** Column index */
+            uint16_t m_field;
+            /** XOR encoded, not aligned to a byte */
+            bool m_xor;
+        };
+
+        /** Steps per column */
+        std::vector<step> m_steps;
+
+        /** Decode a fixed width value */
+        static void decode_fixed(const step& s, cursor& c, row_value& v);
+
+        /** Decode any other value with row_value_read */
+        static void decode_value(const step& s, cursor& c, row_value& v);
+    };
+
+    /** Read row using a plan compiled for its columns, see row_read */
+    inline row* row_read(const row_plan& p, bitstream& b, arena* a = nullptr, block_codec* d = nullptr) {
+        return p.read(b, a, d);
+    }
+
+    /** Free a row returned by row_read without an arena */
+    void row_release(row* r);
 
-    /** Write row to bitstream */
-    void row_write(bitstream& b, row* r);
+    /**
+     * Write row to bitstream.
+     *
+     * The mask and the columns encoded by d use its per block encoding and d is updated,
+     * the stream has to point into the block d belongs to. The row takes up to
+     * d->overhead(r->m_fields) bytes more than r->size(), use the stream position for the
+     * actual size. Values of blob columns above BLOB_INLINE have to be BLOB_REF, see
+     * blob_file::store. Rows of tables with more than 64 columns require d.
+     */
+    void row_write(bitstream& b, row* r, block_codec* d = nullptr);
 } /* deltadb */
 
 #endif /* DELTADB_DB_TABLE_ROW_HPP */
@@ -0,0 +1,97 @@
+/**
+ * @file table_version.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <thread>
+#include <cassert>
+
+#include "block_pool.hpp"
+#include "table_version.hpp"
+
+namespace deltadb {
+    table_versions::table_versions() : m_current(nullptr), m_epoch(1) {
+        for (auto &s : m_slots) {
+            s.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    table_versions::~table_versions() {
+        for (auto &s : m_slots) {
+            assert(s.load() == 0 && "table destroyed while a snapshot is held");
+            (void)s;
+        }
+
+        for (auto &r : m_retired) {
+            delete r.m_version;
+            block_free(r.m_block);
+        }
+
+        delete m_current.load();
+    }
+
+    void table_versions::publish(table_version* v, block* dropped) {
+        // readers pinning from here on load the new version
+        table_version* old = m_current.exchange(v);
+        const uint64_t epoch = m_epoch.fetch_add(1);
+
+        if (old || dropped)
+            m_retired.push_back({epoch, old, dropped});
+
+        reclaim();
+    }
+
+    void table_versions::reclaim() {
+        if (m_retired.empty())
+            return;
+
+        uint64_t oldest = UINT64_MAX;
+        for (auto &s : m_slots) {
+            const uint64_t e = s.load();
+            if (e && e < oldest)
+                oldest = e;
+        }
+
+        // a reader pinned at epoch e may see everything retired in e or later
+        uint32_t freed = 0;
+        for (; freed < m_retired.size() && m_retired[freed].m_epoch < oldest; ++freed) {
+            delete m_retired[freed].m_version;
+            block_free(m_retired[freed].m_block);
+        }
+
+        m_retired.erase(m_retired.begin(), m_retired.begin() + freed);
+    }
+
+    const table_version* table_versions::pin(uint32_t& slot) {
+        for (;;) {
+            // an older epoch only keeps more alive, the version is loaded after the slot is set
+            const uint64_t epoch = m_epoch.load();
+
+            for (uint32_t i = 0; i < TABLE_SNAPSHOTS; ++i) {
+                uint64_t free = 0;
+                if (m_slots[i].load(std::memory_order_relaxed) == 0 && m_slots[i].compare_exchange_strong(free, epoch)) {
+                    slot = i;
+                    return m_current.load();
+                }
+            }
+
+            std::this_thread::yield();
+        }
+    }
+} /* deltadb */
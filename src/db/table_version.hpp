@@ -0,0 +1,117 @@
+/**
+ * @file table_version.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_TABLE_VERSION_HPP
+#define DELTADB_DB_TABLE_VERSION_HPP
+
+#include <atomic>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+
+#include "block.hpp"
+
+/** Number of snapshots of a single table that can be held at once */
+#define TABLE_SNAPSHOTS 64
+
+namespace deltadb {
+    /** Blocks of a table as published to readers */
+    struct table_version {
+        /** Sealed blocks in order, they never change */
+        std::vector<block*> m_sealed;
+        /** Active block */
+        block* m_active;
+        /** Committed bytes of the active block, rows in the upper half */
+        std::atomic<uint64_t> m_committed;
+
+        /** Constructor */
+        table_version(std::vector<block*> sealed, block* active)
+            : m_sealed(std::move(sealed)), m_active(active), m_committed(((uint64_t)active->rows << 32) | active->pos) {}
+    };
+
+    /**
+     * Versions of a table, published by its writer and pinned by readers.
+     *
+     * The writer replaces the version whenever a block is sealed and counts rows added to
+     * the active block on the current one. What a new version no longer references, the
+     * old version and blocks it dropped, is retired with the epoch it was retired in.
+     *
+     * A reader pins the current version by storing the epoch in a free slot before loading
+     * it. Anything retired at or after the lowest pinned epoch may still be seen and stays
+     * allocated, the rest is freed the next time the writer publishes or calls reclaim.
+     * Neither side ever waits for the other.
+     */
+    class table_versions : private boost::noncopyable {
+    public:
+        /** Constructor */
+        table_versions();
+
+        /** Destructor, frees all versions and retired blocks, no version may be pinned */
+        ~table_versions();
+
+        /** Returns the current version, writer only */
+        table_version* current() const {
+            return m_current.load(std::memory_order_relaxed);
+        }
+
+        /** Publish a committed row of the active block, writer only */
+        void commit(const block* b) {
+            current()->m_committed.store(((uint64_t)b->rows << 32) | b->pos, std::memory_order_release);
+        }
+
+        /** Replace the current version, dropped is a block only the previous one referenced */
+        void publish(table_version* v, block* dropped = nullptr);
+
+        /** Free what no pinned version can see anymore, writer only */
+        void reclaim();
+
+        /** Pin the current version, slot is passed to release */
+        const table_version* pin(uint32_t& slot);
+
+        /** Release a pinned version */
+        void release(uint32_t slot) {
+            m_slots[slot].store(0, std::memory_order_release);
+        }
+    private:
+        /** Something no longer reachable from the current version */
+        struct retired {
+            /** Epoch it was retired in */
+            uint64_t m_epoch;
+            /** Version */
+            table_version* m_version;
+            /** Block */
+            block* m_block;
+        };
+
+        /** Published version */
+        std::atomic<table_version*> m_current;
+        /** Advanced on every publish */
+        std::atomic<uint64_t> m_epoch;
+        /** Epoch each reader pinned at, 0 if the slot is free */
+        std::atomic<uint64_t> m_slots[TABLE_SNAPSHOTS];
+        /** Retired in order of epoch */
+        std::vector<retired> m_retired;
+    };
+} /* deltadb */
+
+#endif /* DELTADB_DB_TABLE_VERSION_HPP */
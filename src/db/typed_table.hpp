@@ -0,0 +1,635 @@
+/**
+ * @file typed_table.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_DB_TYPED_TABLE_HPP
+#define DELTADB_DB_TYPED_TABLE_HPP
+
+#include <array>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <boost/noncopyable.hpp>
+
+#include "../internal/arena.hpp"
+#include "../internal/bitstream.hpp"
+#include "block.hpp"
+#include "block_codec.hpp"
+#include "block_pax.hpp"
+#include "metrics.hpp"
+#include "table.hpp"
+#include "table_blob.hpp"
+#include "table_col.hpp"
+#include "table_row.hpp"
+
+namespace deltadb {
+    /** Value of a bytes column, points into the block or arena it was read from */
+    struct typed_bytes {
+        /** Data, nullptr for a blob that couldn't be fetched */
+        const char* m_data;
+        /** Size */
+        uint16_t m_size;
+    };
+
+    namespace detail {
+        /** C++ type of the values of a column type */
+        template <uint8_t Type, bool Unsigned>
+        struct typed_value;
+
+        template <> struct typed_value<col_int8, false>   { typedef int8_t type; };
+        template <> struct typed_value<col_int8, true>    { typedef uint8_t type; };
+        template <> struct typed_value<col_int16, false>  { typedef int16_t type; };
+        template <> struct typed_value<col_int16, true>   { typedef uint16_t type; };
+        template <> struct typed_value<col_int32, false>  { typedef int32_t type; };
+        template <> struct typed_value<col_int32, true>   { typedef uint32_t type; };
+        template <> struct typed_value<col_int64, false>  { typedef int64_t type; };
+        template <> struct typed_value<col_int64, true>   { typedef uint64_t type; };
+        template <> struct typed_value<col_bool, false>   { typedef bool type; };
+        template <> struct typed_value<col_float, false>  { typedef float type; };
+        template <> struct typed_value<col_double, false> { typedef double type; };
+        template <> struct typed_value<col_string, false> { typedef const char* type; };
+        template <> struct typed_value<col_bytes, false>  { typedef typed_bytes type; };
+
+        /** Whether a T can be stored in a column of V without changing its kind */
+        template <typename V, typename T>
+        struct typed_accepts {
+            static constexpr bool value = std::is_convertible<T, V>::value
+                && std::is_floating_point<T>::value == std::is_floating_point<V>::value
+                && std::is_same<T, bool>::value == std::is_same<V, bool>::value;
+        };
+
+        /** Returns value as the bits row_value_write stores */
+        template <typename T>
+        uint64_t typed_bits(T v) {
+            uint64_t ret = 0;
+            memcpy(&ret, &v, sizeof(T));
+            return ret;
+        }
+
+        /** Sets v from the bits read by row_value_read */
+        template <typename T>
+        void typed_from_bits(uint64_t bits, T& v) {
+            v = static_cast<T>(bits);
+        }
+
+        inline void typed_from_bits(uint64_t bits, float& v) {
+            const uint32_t b = bits;
+            memcpy(&v, &b, sizeof(v));
+        }
+
+        inline void typed_from_bits(uint64_t bits, double& v) {
+            memcpy(&v, &bits, sizeof(v));
+        }
+
+        /**
+         * Encoding of the values of one column, the same as row_value_write and
+         * row_value_read for that column.
+         *
+         * size() is the value's share of row::size(), bit_packed values are written without
+         * padding in front of them.
+         */
+        template <uint8_t Type, bool Encoded>
+        struct typed_codec {
+            static constexpr bool bit_packed = false;
+
+            template <typename T>
+            static uint32_t size(const T&) {
+                return sizeof(T);
+            }
+
+            template <typename T>
+            static void write(bitstream& b, block_codec&, uint8_t, const T& v, blob_file*) {
+                const uint64_t bits = typed_bits(v);
+
+                if (sizeof(T) == 8) {
+                    b.write(32, (uint32_t)(bits >> 32));
+                    b.write(32, (uint32_t)(bits));
+                } else {
+                    b.write(sizeof(T) * 8, (uint32_t)bits);
+                }
+            }
+
+            template <typename T>
+            static void read(bitstream& b, block_codec&, uint8_t, T& v, arena*, const blob_file*) {
+                if (sizeof(T) == 8) {
+                    typed_from_bits(((uint64_t)b.read(32) << 32) | b.read(32), v);
+                } else {
+                    typed_from_bits(b.read(sizeof(T) * 8), v);
+                }
+            }
+
+            template <typename T>
+            static void convert(const row_value& rv, T& v, arena*, const blob_file*) {
+                typed_from_bits(rv.m_value.v_u64 & (~0ull >> (64 - sizeof(T) * 8)), v);
+            }
+        };
+
+        /** XOR encoded floats and doubles */
+        template <uint8_t Type>
+        struct typed_xor_codec {
+            static constexpr bool bit_packed = true;
+
+            template <typename T>
+            static uint32_t size(const T&) {
+                return sizeof(T);
+            }
+
+            template <typename T>
+            static void write(bitstream& b, block_codec& d, uint8_t field, const T& v, blob_file*) {
+                d.write_xor(b, field, typed_bits(v), sizeof(T) * 8);
+            }
+
+            template <typename T>
+            static void read(bitstream& b, block_codec& d, uint8_t field, T& v, arena*, const blob_file*) {
+                typed_from_bits(d.read_xor(b, field, sizeof(T) * 8), v);
+            }
+
+            template <typename T>
+            static void convert(const row_value& rv, T& v, arena* a, const blob_file* f) {
+                typed_codec<Type, false>::convert(rv, v, a, f);
+            }
+        };
+
+        template <> struct typed_codec<col_float, true> : typed_xor_codec<col_float> {};
+        template <> struct typed_codec<col_double, true> : typed_xor_codec<col_double> {};
+
+        /** Strings are read in place, they stay in the block */
+        template <>
+        struct typed_codec<col_string, false> {
+            static constexpr bool bit_packed = false;
+
+            static uint32_t size(const char* v) {
+                return strlen(v) + 1;
+            }
+
+            static void write(bitstream& b, block_codec&, uint8_t, const char* v, blob_file*) {
+                b.write_bytes(v, strlen(v) + 1);
+            }
+
+            static void read(bitstream& b, block_codec&, uint8_t, const char*& v, arena*, const blob_file*) {
+                assert((b.position() & 7) == 0);
+                v = reinterpret_cast<const char*>(b.buffer()) + b.position() / 8;
+                b.seek(b.position() + (strnlen(v, std::min<uint32_t>(256, b.left() / 8)) + 1) * 8);
+            }
+
+            static void convert(const row_value& rv, const char*& v, arena*, const blob_file*) {
+                v = rv.m_value.v_bytes;
+            }
+        };
+
+        /** Dictionary encoded strings */
+        template <>
+        struct typed_codec<col_string, true> : typed_codec<col_string, false> {
+            static void write(bitstream& b, block_codec& d, uint8_t field, const char* v, blob_file*) {
+                d.write_string(b, field, v, strlen(v));
+            }
+
+            static void read(bitstream& b, block_codec& d, uint8_t field, const char*& v, arena*, const blob_file*) {
+                uint16_t code;
+                v = d.read_string(b, field, &code);
+            }
+        };
+
+        /** Bytes are read in place, they stay in the block */
+        template <>
+        struct typed_codec<col_bytes, false> {
+            static constexpr bool bit_packed = false;
+
+            static uint32_t size(const typed_bytes& v) {
+                return 2 + v.m_size;
+            }
+
+            static void write(bitstream& b, block_codec&, uint8_t, const typed_bytes& v, blob_file*) {
+                b.write(16, v.m_size);
+                b.write_bytes(v.m_data, v.m_size);
+            }
+
+            static void read(bitstream& b, block_codec&, uint8_t, typed_bytes& v, arena*, const blob_file*) {
+                v.m_size = b.read(16);
+                v.m_data = reinterpret_cast<const char*>(b.buffer()) + b.position() / 8;
+                b.seek(b.position() + v.m_size * 8);
+            }
+
+            static void convert(const row_value& rv, typed_bytes& v, arena* a, const blob_file* f) {
+                row_value copy = rv;
+                if (copy.m_type == BLOB_REF && !(f && f->fetch(copy, a)))
+                    copy.m_value.v_bytes = nullptr;
+
+                v.m_data = copy.m_value.v_bytes;
+                v.m_size = copy.m_size;
+            }
+        };
+
+        /** Blob columns, values above BLOB_INLINE are moved to the blob file and fetched into the arena */
+        template <>
+        struct typed_codec<col_bytes, true> : typed_codec<col_bytes, false> {
+            static uint32_t size(const typed_bytes& v) {
+                return v.m_size > BLOB_INLINE ? 2 + 8 : 2 + v.m_size;
+            }
+
+            static void write(bitstream& b, block_codec& d, uint8_t field, const typed_bytes& v, blob_file* f) {
+                if (v.m_size <= BLOB_INLINE) {
+                    typed_codec<col_bytes, false>::write(b, d, field, v, f);
+                    return;
+                }
+
+                assert(f && f->is_open());
+                const uint64_t off = f->append(v.m_data, v.m_size);
+
+                b.write(16, v.m_size);
+                b.write(32, (uint32_t)(off >> 32));
+                b.write(32, (uint32_t)(off));
+            }
+
+            static void read(bitstream& b, block_codec&, uint8_t field, typed_bytes& v, arena* a, const blob_file* f) {
+                v.m_size = b.read(16);
+                if (v.m_size <= BLOB_INLINE) {
+                    v.m_data = reinterpret_cast<const char*>(b.buffer()) + b.position() / 8;
+                    b.seek(b.position() + v.m_size * 8);
+                    return;
+                }
+
+                row_value ref;
+                ref.m_type = BLOB_REF;
+                ref.m_pos = field;
+                ref.m_size = v.m_size;
+                ref.m_code = DICT_NONE;
+                ref.m_value.v_u64 = ((uint64_t)b.read(32) << 32) | b.read(32);
+                convert(ref, v, a, f);
+            }
+        };
+    } /* detail */
+    /**
+     * Column of a typed_table schema.
+     *
+     * Data is the col::m_data of the column, its col_type and col_flags. Values are plain
+     * C++ types: integers of the width and signedness of the column, bool, float, double,
+     * const char* for strings and typed_bytes for bytes.
+     */
+    template <uint8_t Data>
+    struct typed_col {
+        static_assert((Data & 15) <= col_bytes, "Unknown column type");
+        static_assert(!(Data & col_unsigned) || (Data & 15) <= col_int64, "Only integers can be unsigned");
+        static_assert(!(Data & col_encoded) || (Data & 15) >= col_float, "Integers have no encoding");
+        static_assert(!(Data & col_sparse), "Sparse columns are not supported");
+
+        /** col::m_data */
+        static constexpr uint8_t data = Data;
+
+        /** C++ type of values */
+        typedef typename detail::typed_value<Data & 15, (Data & col_unsigned) != 0>::type value_type;
+
+        /** Encoding of values */
+        typedef detail::typed_codec<Data & 15, (Data & col_encoded) != 0> codec;
+    };
+
+    /** A row of a typed_table, the set fields and a struct of all values */
+    template <typename... Schema>
+    struct typed_row {
+        static_assert(sizeof...(Schema) > 0 && sizeof...(Schema) <= 64, "Typed tables have 1 to 64 columns");
+
+        /** Column types */
+        typedef std::tuple<Schema...> schema;
+
+        /** Struct of all values */
+        typedef std::tuple<typename Schema::value_type...> values;
+
+        /** Column I of the schema */
+        template <size_t I>
+        using column = typename std::tuple_element<I, schema>::type;
+
+        /** Value type of column I */
+        template <size_t I>
+        using value_type = typename column<I>::value_type;
+
+        /** Fields set */
+        uint64_t m_fields;
+        /** Values, only those in m_fields are valid */
+        values m_values;
+
+        /** Constructor, no field set */
+        typed_row() : m_fields(0), m_values() {}
+
+        /** Constructor, all fields set */
+        typed_row(const values& v) : m_fields(all()), m_values(v) {}
+
+        /** Mask of all fields */
+        static constexpr uint64_t all() {
+            return sizeof...(Schema) == 64 ? ~0ull : bit_at(sizeof...(Schema)) - 1;
+        }
+
+        /** Check if row has field I */
+        template <size_t I>
+        bool has() const {
+            return m_fields & bit_at(I);
+        }
+
+        /** Returns value of field I */
+        template <size_t I>
+        const value_type<I>& get() const {
+            assert(has<I>());
+            return std::get<I>(m_values);
+        }
+
+        /** Sets field I, T has to be of the kind of the column: integer, floating point or bool */
+        template <size_t I, typename T>
+        void set(const T& v) {
+            static_assert(detail::typed_accepts<value_type<I>, T>::value, "Value does not match the column type");
+            m_fields = bit_set(I, m_fields);
+            std::get<I>(m_values) = v;
+        }
+
+        /** Unsets field I */
+        template <size_t I>
+        void clear() {
+            m_fields &= ~bit_at(I);
+        }
+    };
+
+    namespace detail {
+        /** Returns the size of field I if set, Known fields are set in every row */
+        template <uint64_t Known, size_t I, typename Row>
+        uint32_t typed_field_size(const Row& r) {
+            typedef typename Row::template column<I>::codec codec;
+
+            if (!(Known & bit_at(I)) && !(r.m_fields & bit_at(I)))
+                return 0;
+
+            return codec::size(std::get<I>(r.m_values));
+        }
+
+        template <uint64_t Known, typename Row, size_t... I>
+        uint32_t typed_fields_size(const Row& r, std::index_sequence<I...>) {
+            const uint32_t sizes[] = {0, typed_field_size<Known, I>(r)...};
+
+            uint32_t ret = 0;
+            for (auto s : sizes) {
+                ret += s;
+            }
+
+            return ret;
+        }
+
+        /** Writes field I if set, see typed_row_write */
+        template <uint64_t Known, size_t I, typename Row>
+        void typed_write_field(bitstream& b, const Row& r, block_codec& d, blob_file* f) {
+            typedef typename Row::template column<I>::codec codec;
+
+            if (!(Known & bit_at(I)) && !(r.m_fields & bit_at(I)))
+                return;
+
+            // XOR deltas are bit packed, everything else starts on a byte
+            if (!codec::bit_packed)
+                block_codec::write_padding(b);
+
+            codec::write(b, d, I, std::get<I>(r.m_values), f);
+        }
+
+        template <uint64_t Known, typename Row, size_t... I>
+        void typed_write_fields(bitstream& b, const Row& r, block_codec& d, blob_file* f, std::index_sequence<I...>) {
+            // braced initializers are evaluated in order
+            const int unroll[] = {0, (typed_write_field<Known, I>(b, r, d, f), 0)...};
+            (void)unroll;
+        }
+
+        /** Reads field I if set, see typed_row_read */
+        template <size_t I, typename Row>
+        void typed_read_field(bitstream& b, Row& r, block_codec& d, arena* a, const blob_file* f) {
+            typedef typename Row::template column<I>::codec codec;
+
+            if (!(r.m_fields & bit_at(I)))
+                return;
+
+            if (!codec::bit_packed)
+                block_codec::read_padding(b);
+
+            codec::read(b, d, I, std::get<I>(r.m_values), a, f);
+        }
+
+        template <typename Row, size_t... I>
+        void typed_read_fields(bitstream& b, Row& r, block_codec& d, arena* a, const blob_file* f, std::index_sequence<I...>) {
+            const int unroll[] = {0, (typed_read_field<I>(b, r, d, a, f), 0)...};
+            (void)unroll;
+        }
+
+        /** Converts field I of a dynamic row if set */
+        template <size_t I, typename Row>
+        void typed_convert_field(row& src, Row& r, arena* a, const blob_file* f) {
+            typedef typename Row::template column<I>::codec codec;
+
+            if (src.has(I))
+                codec::convert(*src.get(I), std::get<I>(r.m_values), a, f);
+        }
+
+        template <typename Row, size_t... I>
+        void typed_convert_fields(row& src, Row& r, arena* a, const blob_file* f, std::index_sequence<I...>) {
+            const int unroll[] = {0, (typed_convert_field<I>(src, r, a, f), 0)...};
+            (void)unroll;
+        }
+    } /* detail */
+
+    /** Returns size in bytes as row::size(), Known fields are set in every row */
+    template <uint64_t Known = 0, typename... Schema>
+    uint32_t typed_row_size(const typed_row<Schema...>& r) {
+        return 8 + detail::typed_fields_size<Known>(r, std::index_sequence_for<Schema...>());
+    }
+
+    /**
+     * Write row to bitstream, same encoding as row_write.
+     *
+     * Known fields have to be set in r, checking for them is left out. Values of blob
+     * columns above BLOB_INLINE are appended to f.
+     */
+    template <uint64_t Known = 0, typename... Schema>
+    void typed_row_write(bitstream& b, const typed_row<Schema...>& r, block_codec& d, blob_file* f = nullptr) {
+        assert((r.m_fields & Known) == Known);
+
+        d.write_mask(b, r.m_fields);
+        detail::typed_write_fields<Known>(b, r, d, f, std::index_sequence_for<Schema...>());
+        block_codec::write_padding(b);
+    }
+
+    /**
+     * Read row from bitstream, same encoding as row_read.
+     *
+     * Strings and bytes point into the stream. Large values of blob columns are fetched
+     * from f into the arena, they are nullptr without f.
+     */
+    template <typename... Schema>
+    void typed_row_read(bitstream& b, typed_row<Schema...>& r, block_codec& d, arena* a = nullptr, const blob_file* f = nullptr) {
+        r.m_fields = d.read_mask(b);
+        detail::typed_read_fields(b, r, d, a, f, std::index_sequence_for<Schema...>());
+        block_codec::read_padding(b);
+    }
+
+    /** Convert a row decoded by row_read or pax_reader, see typed_row_read */
+    template <typename... Schema>
+    void typed_row_convert(row& src, typed_row<Schema...>& r, arena* a = nullptr, const blob_file* f = nullptr) {
+        r.m_fields = src.m_fields.word(0);
+        detail::typed_convert_fields(src, r, a, f, std::index_sequence_for<Schema...>());
+    }
+
+    /**
+     * Table with a schema known at compile time.
+     *
+     * Rows are typed_row structs instead of row_value unions, they are encoded and decoded
+     * by code generated for the schema and the compiler checks the values written. The on
+     * disk format is the one of table, a table can be used through both.
+     *
+     * Opening a table with different columns leaves the typed_table closed.
+     */
+    template <typename... Schema>
+    class typed_table : private boost::noncopyable {
+    public:
+        /** Row type */
+        typedef typed_row<Schema...> row_type;
+        /** Struct of all values */
+        typedef typename row_type::values values;
+        /** Column names */
+        typedef std::array<const char*, sizeof...(Schema)> names;
+
+        /** Constructor, creates the table with the given column names and table_flags if it doesn't exist */
+        typed_table(std::string name, const names& cols, uint8_t flags = table_compact_masks) : m_table(name), m_match(false) {
+            if (!m_table.is_open()) {
+                const uint8_t data[] = {Schema::data...};
+                std::vector<col*> c;
+
+                for (uint32_t i = 0; i < sizeof...(Schema); ++i) {
+                    c.push_back(new col());
+                    c.back()->m_data = data[i];
+                    c.back()->m_comment[0] = '\0';
+                    snprintf(c.back()->m_name, sizeof(c.back()->m_name), "%s", cols[i]);
+                }
+
+                m_table.set_columns(c.data(), c.size(), flags);
+            }
+
+            m_match = matches();
+        }
+
+        /** Whether table is open and has the columns of the schema */
+        bool is_open() {
+            return m_table.is_open() && m_match;
+        }
+
+        /** Returns the table, for everything not typed */
+        table& untyped() {
+            return m_table;
+        }
+
+        /** Write row, returns false if it does not fit into a block, see table::write */
+        bool write(const row_type& r) {
+            assert(is_open());
+
+            return m_table.write_encoded(bitfield(r.m_fields), typed_row_size(r), [&](bitstream& b, block_codec& d) {
+                typed_row_write(b, r, d, &m_table.blobs());
+            });
+        }
+
+        /** Write a row with all fields set, see write */
+        bool write(const values& v) {
+            assert(is_open());
+            const row_type r(v);
+
+            return m_table.write_encoded(bitfield(r.m_fields), typed_row_size<row_type::all()>(r), [&](bitstream& b, block_codec& d) {
+                typed_row_write<row_type::all()>(b, r, d, &m_table.blobs());
+            });
+        }
+
+        /** Write the active block to disk if it has unflushed rows */
+        void flush() {
+            m_table.flush();
+        }
+
+        /**
+         * Calls fn(const row_type&) for every row in order, see table::scan.
+         *
+         * Strings and bytes point into the block or the arena, the row is only valid for the
+         * duration of the callback. Large values of blob columns are fetched. Scans a
+         * snapshot, rows written meanwhile are not seen.
+         */
+        template <typename F>
+        void scan(F&& fn, arena& a) {
+            assert(is_open());
+            row_type r;
+            table_snapshot s = m_table.snapshot();
+
+            for (uint32_t i = 0; i < s.size(); ++i) {
+                const block* blk = s.at(i);
+                const uint64_t start = metrics_ticks();
+                uint64_t rows = 0;
+
+                if (block_is_pax(blk)) {
+                    pax_reader reader(m_table.columns(), m_table.flags(), blk);
+
+                    while (row* src = reader.next(&a)) {
+                        typed_row_convert(*src, r, &a, &m_table.blobs());
+                        fn(static_cast<const row_type&>(r));
+                        ++rows;
+                    }
+                } else {
+                    bitstream b((bitstream::word_t*)blk->data, BLOCK_DSIZE);
+                    block_codec codec(m_table.columns(), m_table.flags());
+                    const uint32_t end = blk->pos * 8;
+
+                    while (b.position() < end) {
+                        typed_row_read(b, r, codec, &a, &m_table.blobs());
+                        fn(static_cast<const row_type&>(r));
+                        ++rows;
+                    }
+                }
+
+                a.reset();
+                metrics_add(metric_rows_decoded, rows);
+                metrics_record(hist_block_decode, metrics_ticks() - start);
+            }
+        }
+    private:
+        /** Table */
+        table m_table;
+        /** Whether the columns of the table match the schema */
+        bool m_match;
+
+        /** Check the columns of the table against the schema */
+        bool matches() {
+            const uint8_t data[] = {Schema::data...};
+            const std::vector<col*>& c = m_table.columns();
+
+            if (c.size() != sizeof...(Schema))
+                return false;
+
+            for (uint32_t i = 0; i < c.size(); ++i) {
+                if (c[i]->m_data != data[i])
+                    return false;
+            }
+
+            return true;
+        }
+    };
+} /* deltadb */
+
+#endif /* DELTADB_DB_TYPED_TABLE_HPP */
@@ -0,0 +1,185 @@
+/**
+ * @file arena.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_INTERNAL_ARENA_HPP
+#define DELTADB_INTERNAL_ARENA_HPP
+
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/noncopyable.hpp>
+
+/** Default arena chunk size */
+#define ARENA_CHUNK (256 * 1024)
+
+namespace deltadb {
+    /**
+     * Bump allocator for query scoped memory.
+     *
+     * Allocations are never freed individually, reset() releases everything at once and
+     * keeps the chunks around for the next query. Destructors of objects placed in the
+     * arena are not run.
+     */
+    class arena : private boost::noncopyable {
+    public:
+        /** Constructor */
+        arena(size_t chunk = ARENA_CHUNK)
+            : m_chunk(chunk), m_current(0), m_ptr(nullptr), m_end(nullptr), m_used(0) {}
+
+        /** Destructor, frees all chunks */
+        ~arena() {
+            reset();
+
+            for (auto c : m_chunks) {
+                delete[] c;
+            }
+        }
+
+        /** Allocate size bytes */
+        void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+            assert((align & (align - 1)) == 0);
+
+            char* p = align_up(m_ptr, align);
+            if (!m_ptr || p + size > m_end) {
+                if (size + align > m_chunk)
+                    return allocate_large(size);
+
+                next_chunk();
+                p = align_up(m_ptr, align);
+            }
+
+            m_ptr = p + size;
+            m_used += size;
+            return p;
+        }
+
+        /** Construct object in arena */
+        template <typename T, typename... Args>
+        T* create(Args&&... args) {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /** Release all allocations, keeps chunks for reuse */
+        void reset() {
+            for (auto l : m_large) {
+                delete[] l;
+            }
+
+            m_large.clear();
+            m_current = 0;
+            m_ptr = m_chunks.empty() ? nullptr : m_chunks[0];
+            m_end = m_chunks.empty() ? nullptr : m_chunks[0] + m_chunk;
+            m_used = 0;
+        }
+
+        /** Returns number of bytes allocated since the last reset */
+        size_t used() {
+            return m_used;
+        }
+    private:
+        /** Chunk size */
+        size_t m_chunk;
+        /** Chunks */
+        std::vector<char*> m_chunks;
+        /** Allocations larger than a chunk */
+        std::vector<char*> m_large;
+        /** Active chunk */
+        size_t m_current;
+        /** Next free byte */
+        char* m_ptr;
+        /** End of active chunk */
+        char* m_end;
+        /** Bytes handed out */
+        size_t m_used;
+
+        /** Align pointer */
+        static char* align_up(char* p, size_t align) {
+            return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(align - 1));
+        }
+
+        /** Advance to the next chunk, allocating it if required */
+        void next_chunk() {
+            if (m_ptr)
+                ++m_current;
+
+            if (m_current == m_chunks.size())
+                m_chunks.push_back(new char[m_chunk]);
+
+            m_ptr = m_chunks[m_current];
+            m_end = m_ptr + m_chunk;
+        }
+
+        /** Allocation which doesn't fit into a chunk */
+        void* allocate_large(size_t size) {
+            char* p = new char[size];
+            m_large.push_back(p);
+            m_used += size;
+            return p;
+        }
+    };
+
+    /** Allocator for standard containers, falls back to the heap without an arena */
+    template <typename T>
+    struct arena_allocator {
+        typedef T value_type;
+
+        /** Arena, may be null */
+        arena* m_arena;
+
+        /** Constructor */
+        arena_allocator(arena* a = nullptr) : m_arena(a) {}
+
+        /** Rebind constructor */
+        template <typename U>
+        arena_allocator(const arena_allocator<U>& o) : m_arena(o.m_arena) {}
+
+        /** Allocate n objects */
+        T* allocate(size_t n) {
+            if (m_arena)
+                return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+
+        /** Free n objects, no-op for arenas */
+        void deallocate(T* p, size_t) {
+            if (!m_arena)
+                ::operator delete(p);
+        }
+    };
+
+    template <typename T, typename U>
+    bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) {
+        return a.m_arena == b.m_arena;
+    }
+
+    template <typename T, typename U>
+    bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) {
+        return a.m_arena != b.m_arena;
+    }
+} /* deltadb */
+
+#endif /* DELTADB_INTERNAL_ARENA_HPP */
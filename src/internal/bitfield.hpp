@@ -22,61 +22,158 @@
 #ifndef DELTADB_INTERNAL_BITFIELD_HPP
 #define DELTADB_INTERNAL_BITFIELD_HPP
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 
+/** Words of a bitfield, it holds up to 64 times as many bits */
+#define BITFIELD_WORDS 8
+
 namespace deltadb {
-    /** Bitfield */
+    /**
+     * Fixed capacity bitmap with constant time rank.
+     *
+     * Bits are stored in 64 bit words. Next to each word it keeps the number of bits set in
+     * the words before it, so the rank of a bit is that count plus a single popcount. Only
+     * the words up to the highest one written are in use, a bitfield of the first 64 bits
+     * only ever touches a single word.
+     */
     class bitfield {
     public:
-        /** Constructor */
-        bitfield() : m_storage(0), m_size(0) {};
-
-        /** Constructor, sets size */
-        bitfield(uint8_t size) : m_storage(0), m_size(size) {
-            assert(size <= 64);
-        }
+        /** Constructor, no bit set */
+        bitfield() : m_words(0) {}
 
-        /** Resize bitfield */
-        void resize(uint8_t size) {
-            assert(size <= 64);
-            m_size = size;
+        /** Constructor, sets the bits of the first word */
+        explicit bitfield(uint64_t word) : m_words(0) {
+            set_word(0, word);
         }
 
         /** Return bit at index */
-        bool at(uint8_t idx) {
-            assert(idx < m_size);
-            return m_storage & bit_at(idx);
+        bool at(uint32_t idx) const {
+            const uint32_t w = idx >> 6;
+            return w < m_words && (m_storage[w] & mask(idx));
         }
 
         /** Set bit at index */
-        void set(uint8_t idx, bool value) {
-            assert(idx < m_size);
-            m_storage |= bit_at(idx);
+        void set(uint32_t idx) {
+            const uint32_t w = idx >> 6;
+            grow(w + 1);
+
+            if (m_storage[w] & mask(idx))
+                return;
+
+            m_storage[w] |= mask(idx);
+            for (uint32_t i = w + 1; i < m_words; ++i) {
+                ++m_rank[i];
+            }
+        }
+
+        /** Flip bit at index */
+        void flip(uint32_t idx) {
+            set_word(idx >> 6, word(idx >> 6) ^ mask(idx));
+        }
+
+        /** Returns the number of bits set below index */
+        uint32_t rank(uint32_t idx) const {
+            const uint32_t w = idx >> 6;
+            if (w >= m_words)
+                return count();
+
+            return m_rank[w] + __builtin_popcountll(m_storage[w] & (mask(idx) - 1));
+        }
+
+        /** Returns the number of bits set */
+        uint32_t count() const {
+            return m_words ? m_rank[m_words - 1] + __builtin_popcountll(m_storage[m_words - 1]) : 0;
         }
 
-        /** Return bitfield size */
-        uint8_t size() {
-            return m_size;
+        /** Whether any bit is set */
+        bool any() const {
+            return count() != 0;
         }
 
-        /** Return bytes require to store */
-        constexpr uint8_t width() {
-            return ((m_size + 7) & ~7) >> 3;
+        /** Returns the number of words in use */
+        uint32_t words() const {
+            return m_words;
         }
 
-        /** Return all bits */
-        uint64_t storage() {
-            return m_storage;
+        /** Returns word w, 0 past the words in use */
+        uint64_t word(uint32_t w) const {
+            return w < m_words ? m_storage[w] : 0;
+        }
+
+        /** Sets word w */
+        void set_word(uint32_t w, uint64_t v) {
+            grow(w + 1);
+            m_storage[w] = v;
+
+            for (uint32_t i = w + 1; i < m_words; ++i) {
+                m_rank[i] = m_rank[i - 1] + __builtin_popcountll(m_storage[i - 1]);
+            }
+        }
+
+        /** Clear all bits */
+        void reset() {
+            m_words = 0;
+        }
+
+        /** Returns the number of bits set in both */
+        uint32_t count_and(const bitfield& b) const {
+            uint32_t ret = 0;
+            for (uint32_t i = 0, n = std::min(m_words, b.m_words); i < n; ++i) {
+                ret += __builtin_popcountll(m_storage[i] & b.m_storage[i]);
+            }
+
+            return ret;
+        }
+
+        /** Set the bits set in b */
+        bitfield& operator|=(const bitfield& b) {
+            for (uint32_t i = 0; i < b.m_words; ++i) {
+                set_word(i, word(i) | b.m_storage[i]);
+            }
+
+            return *this;
+        }
+
+        /** Whether both have the same bits set */
+        bool operator==(const bitfield& b) const {
+            for (uint32_t i = 0, n = std::max(m_words, b.m_words); i < n; ++i) {
+                if (word(i) != b.word(i))
+                    return false;
+            }
+
+            return true;
+        }
+
+        /** Whether the bits set differ */
+        bool operator!=(const bitfield& b) const {
+            return !(*this == b);
         }
     private:
-        uint64_t m_storage;
-        uint8_t m_size;
+        /** Bits */
+        uint64_t m_storage[BITFIELD_WORDS];
+        /** Bits set in the words before each word */
+        uint16_t m_rank[BITFIELD_WORDS];
+        /** Words in use */
+        uint8_t m_words;
+
+        /** Returns mask of idx in its word */
+        static uint64_t mask(uint32_t idx) {
+            return static_cast<uint64_t>(1) << (idx & 63);
+        }
+
+        /** Put words up to w in use */
+        void grow(uint32_t w) {
+            assert(w <= BITFIELD_WORDS);
 
-        constexpr uint64_t bit_at(uint8_t idx) {
-            return static_cast<uint64_t>(1) << static_cast<uint64_t>(idx);
+            while (m_words < w) {
+                m_storage[m_words] = 0;
+                m_rank[m_words] = m_words ? m_rank[m_words - 1] + __builtin_popcountll(m_storage[m_words - 1]) : 0;
+                ++m_words;
+            }
         }
     };
-}
+} /* deltadb */
 
 #endif /* DELTADB_INTERNAL_BITFIELD_HPP */
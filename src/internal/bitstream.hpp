@@ -47,7 +47,9 @@ namespace deltadb {
         0xffffffffff,    0x1ffffffffff,    0x3ffffffffff,    0x7ffffffffff,
         0xfffffffffff,   0x1fffffffffff,   0x3fffffffffff,   0x7fffffffffff,
         0xffffffffffff,  0x1ffffffffffff,  0x3ffffffffffff,  0x7ffffffffffff,
-        0xfffffffffffff, 0x1fffffffffffff, 0x3fffffffffffff, 0x7fffffffffffff
+        0xfffffffffffff, 0x1fffffffffffff, 0x3fffffffffffff, 0x7fffffffffffff,
+        0xffffffffffffff, 0x1ffffffffffffff, 0x3ffffffffffffff, 0x7ffffffffffffff,
+        0xfffffffffffffff, 0x1fffffffffffffff, 0x3fffffffffffffff, 0x7fffffffffffffff
     };
 
     /** Returns bits until bit */
@@ -57,12 +59,12 @@ namespace deltadb {
 
     /** Returns mask for bit at given position */
     constexpr uint64_t bit_at(uint8_t bit) {
-        return (1 << bit);
+        return (static_cast<uint64_t>(1) << bit);
     }
 
     /** Set bit at given position */
     inline uint64_t bit_set(uint8_t bit, uint64_t v) {
-        return v |= (1 << bit);
+        return v |= (static_cast<uint64_t>(1) << bit);
     }
 
     /** This class provides functions to read and write data as a stream of bits. */
@@ -365,10 +367,11 @@ namespace deltadb {
         void read_bytes(uint32_t bytes, char* dest) {
             assert(m_error == error::none);
             assert(m_mode == mode::io_reader);
-            assert((m_pos>>3) + bytes < m_buffer_bytes);
+            assert((m_pos>>3) + bytes <= m_buffer_bytes);
 
             if ((m_pos & 7) == 0) {
                 memcpy(dest, &(reinterpret_cast<char*>(m_buffer)[m_pos >> 3]), bytes);
+                m_pos += 8 * bytes;
             } else {
                 for (uint32_t i = 0; i < bytes; ++i) {
                     dest[i] = static_cast<int8_t>(read(8));
@@ -393,7 +396,7 @@ namespace deltadb {
         bool read_bool() {
             assert(m_error == error::none);
             assert(m_mode == mode::io_reader);
-            assert(m_pos+1 < m_buffer_bits);
+            assert(m_pos+1 <= m_buffer_bits);
 
             bool ret = ( m_buffer[m_pos >> 5] >> ( m_pos & 31 ) ) & 1;
             m_pos += 1;
@@ -410,8 +413,8 @@ namespace deltadb {
 
         /** Verifies buffer size */
         bool verify_size(uint32_t size) {
-            static size_t size_bits_max = (2^32) - 1;
-            return (size * 8) + 1 > size_bits_max;
+            static constexpr uint64_t size_bits_max = 0xFFFFFFFF;
+            return static_cast<uint64_t>(size) * 8 <= size_bits_max;
         }
     };
 } /* deltadb */
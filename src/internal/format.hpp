@@ -0,0 +1,144 @@
+/**
+ * @file format.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_INTERNAL_FORMAT_HPP
+#define DELTADB_INTERNAL_FORMAT_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/** Buffer size that fits every value formatted by this file */
+#define FORMAT_MAX 32
+
+namespace deltadb {
+    /** Format v right aligned into a buffer ending at end, returns the first digit */
+    inline char* format_uint(uint64_t v, char* end) {
+        static const char pairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+        char* p = end;
+        while (v >= 100) {
+            const uint32_t i = (v % 100) * 2;
+            v /= 100;
+            *--p = pairs[i + 1];
+            *--p = pairs[i];
+        }
+
+        if (v >= 10) {
+            *--p = pairs[v * 2 + 1];
+            *--p = pairs[v * 2];
+        } else {
+            *--p = '0' + v;
+        }
+
+        return p;
+    }
+
+    /** Format signed v right aligned into a buffer ending at end, returns the first character */
+    inline char* format_int(int64_t v, char* end) {
+        char* p = format_uint(v < 0 ? 0 - (uint64_t)v : (uint64_t)v, end);
+
+        if (v < 0)
+            *--p = '-';
+
+        return p;
+    }
+
+    /**
+     * Format v with the fewest digits that parse back to the same value, returns the length.
+     *
+     * Values between 1e-3 and 1e15 are tried as m / 10^k for growing k, which is exact to
+     * check since both are integers below 2^53. Everything else, and the rare value this
+     * doesn't find a short form for, goes through printf. Set single for float values,
+     * which round trip with at most 9 digits instead of 17.
+     */
+    inline uint32_t format_double(double v, bool single, char* out) {
+        static const double pow10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17
+        };
+
+        const double a = v < 0 ? -v : v;
+        if ((a >= 1e-3 && a < 1e15) || v == 0) {
+            for (uint32_t k = 0; k < sizeof(pow10) / sizeof(pow10[0]); ++k) {
+                const double scaled = a * pow10[k];
+                if (scaled >= 9007199254740992.0)
+                    break;
+
+                const uint64_t m = (uint64_t)(scaled + 0.5);
+                const double back = (double)m / pow10[k];
+
+                if (single ? (float)back != (float)a : back != a)
+                    continue;
+
+                // a float goes through a double on the way, which only rounds differently
+                // if the double lands exactly on the midpoint to a neighbour
+                if (single) {
+                    const float f = a;
+                    if (back == ((double)f + nextafterf(f, 0)) / 2 || back == ((double)f + nextafterf(f, INFINITY)) / 2)
+                        break;
+                }
+
+                char buf[FORMAT_MAX];
+                char* end = buf + sizeof(buf);
+                char* p = format_uint(m, end);
+
+                while ((uint32_t)(end - p) <= k) {
+                    *--p = '0';
+                }
+
+                char* o = out;
+                if (__builtin_signbit(v))
+                    *o++ = '-';
+
+                const uint32_t whole = end - p - k;
+                memcpy(o, p, whole);
+                o += whole;
+
+                if (k) {
+                    *o++ = '.';
+                    memcpy(o, p + whole, k);
+                    o += k;
+                }
+
+                return o - out;
+            }
+        }
+
+        const int max = single ? 9 : 17;
+        int len = 0;
+
+        for (int digits = single ? 6 : 15; digits <= max; ++digits) {
+            len = snprintf(out, FORMAT_MAX, "%.*g", digits, v);
+
+            if (digits == max || (single ? strtof(out, nullptr) == (float)v : strtod(out, nullptr) == v))
+                break;
+        }
+
+        return len < FORMAT_MAX ? len : FORMAT_MAX - 1;
+    }
+} /* deltadb */
+
+#endif /* DELTADB_INTERNAL_FORMAT_HPP */
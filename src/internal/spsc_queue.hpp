@@ -0,0 +1,107 @@
+/**
+ * @file spsc_queue.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_INTERNAL_SPSC_QUEUE_HPP
+#define DELTADB_INTERNAL_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+
+#include <boost/noncopyable.hpp>
+
+/** Size of a cache line, used to keep producer and consumer state apart */
+#define CACHE_LINE 64
+
+namespace deltadb {
+    /**
+     * Bounded lock-free single producer / single consumer queue.
+     *
+     * Head and tail live on separate cache lines and each side keeps a private copy of
+     * the other side's index, so the shared lines are only touched when the cached
+     * value runs out.
+     */
+    template <typename T, uint32_t N>
+    class spsc_queue : private boost::noncopyable {
+        static_assert((N & (N - 1)) == 0, "Queue size has to be a power of 2");
+    public:
+        /** Constructor */
+        spsc_queue() : m_head(0), m_tail_cache(0), m_tail(0), m_head_cache(0) {}
+
+        /** Heap allocations have to honor the cache line alignment */
+        static void* operator new(size_t size) {
+            void* p;
+            if (posix_memalign(&p, CACHE_LINE, size) != 0)
+                throw std::bad_alloc();
+
+            return p;
+        }
+
+        /** Free queue */
+        static void operator delete(void* p) {
+            free(p);
+        }
+
+        /** Push value, returns false if the queue is full. Producer only. */
+        bool push(const T& v) {
+            const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+
+            if (tail - m_head_cache == N) {
+                m_head_cache = m_head.load(std::memory_order_acquire);
+                if (tail - m_head_cache == N)
+                    return false;
+            }
+
+            m_data[tail & (N - 1)] = v;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** Pop value, returns false if the queue is empty. Consumer only. */
+        bool pop(T& v) {
+            const uint32_t head = m_head.load(std::memory_order_relaxed);
+
+            if (head == m_tail_cache) {
+                m_tail_cache = m_tail.load(std::memory_order_acquire);
+                if (head == m_tail_cache)
+                    return false;
+            }
+
+            v = m_data[head & (N - 1)];
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+    private:
+        /** Consumer position */
+        alignas(CACHE_LINE) std::atomic<uint32_t> m_head;
+        /** Consumer copy of m_tail */
+        uint32_t m_tail_cache;
+        /** Producer position */
+        alignas(CACHE_LINE) std::atomic<uint32_t> m_tail;
+        /** Producer copy of m_head */
+        uint32_t m_head_cache;
+        /** Ring buffer */
+        alignas(CACHE_LINE) T m_data[N];
+    };
+} /* deltadb */
+
+#endif /* DELTADB_INTERNAL_SPSC_QUEUE_HPP */
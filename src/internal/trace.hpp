@@ -0,0 +1,53 @@
+/**
+ * @file trace.hpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTADB_INTERNAL_TRACE_HPP
+#define DELTADB_INTERNAL_TRACE_HPP
+
+#include "../config.hpp"
+
+/**
+ * Static tracepoints.
+ *
+ * With -DTRACING=ON these become USDT probes in the "deltadb" provider, which compile to
+ * a single nop until attached, e.g.:
+ *
+ *   bpftrace -e 'usdt:./deltadbd:deltadb:block_read_done { @[arg1] = count(); }'
+ *   perf probe -x ./deltadbd sdt_deltadb:flush_start
+ *
+ * Otherwise they expand to nothing.
+ */
+
+#ifdef DELTADB_TRACING
+#include <sys/sdt.h>
+
+#define DELTADB_TRACE0(name) DTRACE_PROBE(deltadb, name)
+#define DELTADB_TRACE1(name, a) DTRACE_PROBE1(deltadb, name, a)
+#define DELTADB_TRACE2(name, a, b) DTRACE_PROBE2(deltadb, name, a, b)
+#define DELTADB_TRACE3(name, a, b, c) DTRACE_PROBE3(deltadb, name, a, b, c)
+#else
+#define DELTADB_TRACE0(name) do {} while (0)
+#define DELTADB_TRACE1(name, a) do {} while (0)
+#define DELTADB_TRACE2(name, a, b) do {} while (0)
+#define DELTADB_TRACE3(name, a, b, c) do {} while (0)
+#endif
+
+#endif /* DELTADB_INTERNAL_TRACE_HPP */
@@ -0,0 +1,127 @@
+/**
+ * @file export.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Parallel CSV / TSV and columnar export.
+ *
+ * Usage: deltadb_export [options] --table <name> <file>
+ *
+ * Writes every row of a table with inherited fields resolved. The columnar format is
+ * described in db/export.hpp.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+#include "../config.hpp"
+#include "../db/export.hpp"
+#include "../db/table.hpp"
+#include "../internal/filesystem.hpp"
+
+namespace po = boost::program_options;
+
+int main(int argc, char** argv) {
+    using namespace deltadb;
+
+    std::string dir, name, format, file;
+    export_options o;
+
+    po::options_description desc("deltadb_export options");
+    desc.add_options()
+        ("help,h", "Show this help")
+        ("dir", po::value<std::string>(&dir)->default_value(DELTADB_PATH_DATA), "Data directory")
+        ("table", po::value<std::string>(&name), "Source table")
+        ("format", po::value<std::string>(&format)->default_value("csv"), "csv, tsv or columnar")
+        ("file", po::value<std::string>(&file), "Output file")
+        ("no-header", "Omit the header line")
+        ("threads", po::value<uint32_t>(&o.m_threads)->default_value(0), "Worker threads, 0 for all cores");
+
+    po::positional_options_description pos;
+    pos.add("file", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+        po::notify(vm);
+    } catch (po::error& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    if (vm.count("help") || name.empty() || file.empty() || name.size() > 32
+        || (format != "csv" && format != "tsv" && format != "columnar"))
+    {
+        std::cout << "Usage: deltadb_export [options] --table <name> <file>" << std::endl << desc << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    o.m_delimiter = format == "tsv" ? '\t' : ',';
+    o.m_header = !vm.count("no-header");
+
+    // resolve before changing into the data directory
+    if (file[0] != '/') {
+        char cwd[4096];
+        if (!getcwd(cwd, sizeof(cwd))) {
+            perror("Unable to get cwd");
+            return 1;
+        }
+
+        file = std::string(cwd) + "/" + file;
+    }
+
+    if (chdir(dir.c_str()) != 0) {
+        perror("Unable to set cwd");
+        return 1;
+    }
+
+    filelock lock("db.lock");
+    if (!lock.aquire()) {
+        perror("Unable to aquire database lock");
+        return 1;
+    }
+
+    if (!file_exists((name + ".tbl").c_str())) {
+        fprintf(stderr, "Table %s does not exist\n", name.c_str());
+        return 1;
+    }
+
+    table t(name);
+    auto start = std::chrono::steady_clock::now();
+
+    export_stats s;
+    const bool ok = format == "columnar" ? export_columnar(t, file.c_str(), o, &s) : export_csv(t, file.c_str(), o, &s);
+    if (!ok)
+        return 1;
+
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("rows=%lu\nblocks=%lu\nbytes=%lu\nseconds=%.3f\nrows_per_sec=%.0f\nmb_per_sec=%.1f\n",
+        s.m_rows, s.m_blocks, s.m_bytes, secs, s.m_rows / secs, s.m_bytes / secs / (1024 * 1024)
+    );
+
+    return 0;
+}
@@ -0,0 +1,202 @@
+/**
+ * @file import.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Bulk CSV / TSV import.
+ *
+ * Usage: deltadb_import [options] --table <name> <file>
+ *
+ * Appends the file to a table in the data directory. The table is created if it does
+ * not exist yet, which requires --schema "name:type[:unsigned|:dict|:xor|:blob],...".
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+#include "../config.hpp"
+#include "../db/import.hpp"
+#include "../db/table.hpp"
+#include "../db/table_col.hpp"
+#include "../internal/filesystem.hpp"
+
+namespace po = boost::program_options;
+
+namespace deltadb {
+    namespace {
+        /** Parse "name:type[:unsigned|:dict|:xor|:blob],..." */
+        bool parse_schema(const std::string& schema, std::vector<col*>& cols) {
+            static const char* names[] = {
+                "int8", "int16", "int32", "int64", "bool", "float", "double", "string", "bytes"
+            };
+
+            size_t start = 0;
+            while (start < schema.size()) {
+                size_t end = schema.find(',', start);
+                if (end == std::string::npos)
+                    end = schema.size();
+
+                const std::string def = schema.substr(start, end - start);
+                const size_t colon = def.find(':');
+                if (colon == std::string::npos || colon == 0 || colon > 31) {
+                    fprintf(stderr, "Invalid column definition %s\n", def.c_str());
+                    return false;
+                }
+
+                std::string type = def.substr(colon + 1);
+                std::string flag;
+
+                const size_t sep = type.find(':');
+                if (sep != std::string::npos) {
+                    flag = type.substr(sep + 1);
+                    type = type.substr(0, sep);
+                }
+
+                col* c = new col();
+                c->m_data = 0xFF;
+                for (uint8_t i = 0; i <= col_bytes; ++i) {
+                    if (type == names[i])
+                        c->m_data = i;
+                }
+
+                if (c->m_data == 0xFF) {
+                    fprintf(stderr, "Unknown column type %s\n", type.c_str());
+                    delete c;
+                    return false;
+                }
+
+                if (flag == "unsigned") {
+                    c->m_data |= col_unsigned;
+                } else if ((flag == "dict" && c->m_data == col_string)
+                    || (flag == "xor" && (c->m_data == col_float || c->m_data == col_double))
+                    || (flag == "blob" && c->m_data == col_bytes))
+                {
+                    c->m_data |= col_encoded;
+                } else if (!flag.empty()) {
+                    fprintf(stderr, "Invalid flag %s for column %s\n", flag.c_str(), def.substr(0, colon).c_str());
+                    delete c;
+                    return false;
+                }
+
+                snprintf(c->m_name, sizeof(c->m_name), "%s", def.substr(0, colon).c_str());
+                c->m_comment[0] = '\0';
+                cols.push_back(c);
+
+                start = end + 1;
+            }
+
+            return !cols.empty() && cols.size() <= TABLE_MAX_COLUMNS;
+        }
+    }
+} /* deltadb */
+
+int main(int argc, char** argv) {
+    using namespace deltadb;
+
+    std::string dir, name, schema, file;
+    import_options o;
+
+    po::options_description desc("deltadb_import options");
+    desc.add_options()
+        ("help,h", "Show this help")
+        ("dir", po::value<std::string>(&dir)->default_value(DELTADB_PATH_DATA), "Data directory")
+        ("table", po::value<std::string>(&name), "Target table")
+        ("schema", po::value<std::string>(&schema), "Columns for a new table, name:type[:unsigned|:dict|:xor|:blob],...")
+        ("file", po::value<std::string>(&file), "Input file")
+        ("tsv", "Tab separated input")
+        ("header", "First line names the columns")
+        ("pax", "Store sealed blocks of a new table column by column")
+        ("compress", "Store sealed blocks of a new table compressed")
+        ("threads", po::value<uint32_t>(&o.m_threads)->default_value(0), "Parser threads, 0 for all cores");
+
+    po::positional_options_description pos;
+    pos.add("file", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+        po::notify(vm);
+    } catch (po::error& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    if (vm.count("help") || name.empty() || file.empty() || name.size() > 32) {
+        std::cout << "Usage: deltadb_import [options] --table <name> <file>" << std::endl << desc << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    o.m_delimiter = vm.count("tsv") ? '\t' : ',';
+    o.m_header = vm.count("header");
+
+    // resolve before changing into the data directory
+    char* input = realpath(file.c_str(), nullptr);
+    if (!input) {
+        perror("Unable to resolve input file");
+        return 1;
+    }
+
+    if (chdir(dir.c_str()) != 0) {
+        perror("Unable to set cwd");
+        return 1;
+    }
+
+    filelock lock("db.lock");
+    if (!lock.aquire()) {
+        perror("Unable to aquire database lock");
+        return 1;
+    }
+
+    table t(name);
+    if (!t.is_open()) {
+        std::vector<col*> cols;
+        if (schema.empty() || !parse_schema(schema, cols)) {
+            fprintf(stderr, "Table %s does not exist, a valid --schema is required\n", name.c_str());
+            return 1;
+        }
+
+        t.set_columns(cols.data(), cols.size(),
+            table_compact_masks | (vm.count("pax") ? table_pax : 0) | (vm.count("compress") ? table_compressed : 0));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    import_stats s;
+    if (!import_csv(t, input, o, &s))
+        return 1;
+
+    t.flush();
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("rows=%lu\nblocks=%lu\nerrors=%lu\nseconds=%.3f\nrows_per_sec=%.0f\nmb_per_sec=%.1f\n",
+        s.m_rows, s.m_blocks, s.m_errors, secs, s.m_rows / secs, s.m_bytes / secs / (1024 * 1024)
+    );
+
+    free(input);
+    return 0;
+}
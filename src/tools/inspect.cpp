@@ -0,0 +1,689 @@
+/**
+ * @file inspect.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Offline table inspector.
+ *
+ * Usage: deltadb_inspect [options] <path/to/table>
+ *
+ * Maps <table>.tbl and <table>.blk read-only, with <table>.idx of compressed tables,
+ * decodes all blocks in parallel and prints per column and per block statistics.
+ * Structural problems are reported, the exit code is 1 if any were found. Files are
+ * never written, so this is safe to run next to a live server; the tail block may be
+ * caught mid-flush.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+
+#include "../db/block.hpp"
+#include "../db/block_codec.hpp"
+#include "../db/block_lz.hpp"
+#include "../db/block_pax.hpp"
+#include "../db/column_codec.hpp"
+#include "../db/table_col.hpp"
+#include "../db/table_row.hpp"
+#include "../internal/arena.hpp"
+#include "../internal/bitstream.hpp"
+
+/** Zeroed space behind a block copy, large enough for the biggest possible row */
+#define INSPECT_PAD (TABLE_MAX_COLUMNS * (2 + 0xFFFF) + 64)
+
+/** Number of problems printed before going quiet */
+#define INSPECT_MAX_ERRORS 32
+
+namespace po = boost::program_options;
+
+namespace deltadb {
+    namespace {
+        /** Read-only file mapping */
+        struct mapping {
+            const char* m_data;
+            size_t m_size;
+
+            mapping() : m_data(nullptr), m_size(0) {}
+
+            ~mapping() {
+                if (m_data)
+                    munmap(const_cast<char*>(m_data), m_size);
+            }
+
+            bool open(const std::string& path) {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    perror(path.c_str());
+                    return false;
+                }
+
+                struct stat st;
+                fstat(fd, &st);
+                m_size = st.st_size;
+
+                if (m_size) {
+                    void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (p == MAP_FAILED) {
+                        perror("Unable to map file");
+                        ::close(fd);
+                        return false;
+                    }
+
+#ifdef MADV_SEQUENTIAL
+                    madvise(p, m_size, MADV_SEQUENTIAL);
+#endif
+                    m_data = static_cast<const char*>(p);
+                }
+
+                ::close(fd);
+                return true;
+            }
+        };
+
+        /** Statistics of a single block */
+        struct block_stats {
+            uint32_t m_num;
+            uint32_t m_pos;
+            uint32_t m_rows;
+            uint32_t m_decoded;
+            bool m_valid;
+            bool m_pax;
+        };
+
+        /** Statistics gathered by one thread */
+        struct stats {
+            /** Rows in which a column is set */
+            std::vector<uint64_t> m_set;
+            /** Encoded bits per column */
+            std::vector<uint64_t> m_bits;
+            /** PAX blocks per column and column_codec_id */
+            std::vector<uint32_t> m_codecs;
+            /** Bits of row masks and padding */
+            uint64_t m_mask_bits;
+            /** Rows decoded */
+            uint64_t m_rows;
+            /** Bytes used by all blocks */
+            uint64_t m_used;
+
+            stats(uint32_t cols)
+                : m_set(cols, 0), m_bits(cols, 0), m_codecs(cols * column_codecs, 0), m_mask_bits(0), m_rows(0),
+                  m_used(0) {}
+
+            void merge(const stats& s) {
+                for (uint32_t i = 0; i < m_set.size(); ++i) {
+                    m_set[i] += s.m_set[i];
+                    m_bits[i] += s.m_bits[i];
+                }
+
+                for (uint32_t i = 0; i < m_codecs.size(); ++i) {
+                    m_codecs[i] += s.m_codecs[i];
+                }
+
+                m_mask_bits += s.m_mask_bits;
+                m_rows += s.m_rows;
+                m_used += s.m_used;
+            }
+        };
+
+        /** Collects problems from all threads */
+        class report {
+        public:
+            report() : m_errors(0) {}
+
+            void error(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+                std::lock_guard<std::mutex> l(m_lock);
+
+                if (++m_errors <= INSPECT_MAX_ERRORS) {
+                    va_list args;
+                    va_start(args, fmt);
+                    fprintf(stderr, "error: ");
+                    vfprintf(stderr, fmt, args);
+                    fprintf(stderr, "\n");
+                    va_end(args);
+                }
+            }
+
+            uint32_t errors() {
+                return m_errors;
+            }
+        private:
+            std::mutex m_lock;
+            uint32_t m_errors;
+        };
+
+        /** Type names for output */
+        const char* type_name(col* c) {
+            static const char* names[] = {
+                "int8", "int16", "int32", "int64", "bool", "float", "double", "string", "bytes"
+            };
+
+            if (c->is_encoded()) {
+                switch (c->type()) {
+                case col_string: return "dict";
+                case col_bytes:  return "blob";
+                case col_float:  return "xfloat";
+                case col_double: return "xdouble";
+                }
+            }
+
+            return c->type() <= col_bytes ? names[c->type()] : "unknown";
+        }
+
+        /**
+         * Returns the block at off, nullptr if it is cut short or does not decompress.
+         *
+         * Compressed blocks are decompressed into buffer, blocks at an unaligned offset copied.
+         */
+        const block* locate(const mapping& m, uint64_t off, uint32_t num, char* buffer, bool& compressed, report& r) {
+            const uint32_t record = sizeof(block_header) + sizeof(uint32_t);
+
+            if (off > m.m_size || m.m_size - off < sizeof(block_header)) {
+                r.error("block %u: offset %lu is past the end of the file", num, off);
+                return nullptr;
+            }
+
+            const block* b = reinterpret_cast<const block*>(m.m_data + off);
+            block* out = reinterpret_cast<block*>(buffer);
+            compressed = block_is_compressed(b);
+
+            if (compressed && m.m_size - off < record) {
+                r.error("block %u is cut short", num);
+                return nullptr;
+            }
+
+            if (!compressed) {
+                // blocks of indexed files end at their used size
+                const uint64_t used = std::min<uint64_t>(block_used(b), BLOCK_DSIZE);
+                if (m.m_size - off < sizeof(block_header) + used) {
+                    r.error("block %u is cut short", num);
+                    return nullptr;
+                }
+
+                if (off % alignof(block) == 0 && m.m_size - off >= sizeof(block))
+                    return b;
+
+                memcpy(out, b, sizeof(block_header) + used);
+                memset(out->data + used, 0, BLOCK_DSIZE - used);
+                return out;
+            }
+
+            uint32_t size;
+            memcpy(&size, b->data, sizeof(size));
+
+            if (m.m_size - off - record < size) {
+                r.error("block %u: compressed data is cut short", num);
+                return nullptr;
+            }
+
+            const int64_t used = lz_decompress(b->data + sizeof(size), size, out->data, BLOCK_DSIZE);
+            if (used != block_used(b)) {
+                r.error("block %u: compressed data is malformed", num);
+                return nullptr;
+            }
+
+            out->crc = b->crc;
+            out->pos = b->pos & ~BLOCK_LZ;
+            out->rows = b->rows;
+            memset(out->data + used, 0, BLOCK_DSIZE - used);
+
+            return out;
+        }
+
+        /** Parse and verify the table definition */
+        bool read_schema(const mapping& m, const std::string& name, std::vector<col*>& cols, uint8_t& flags, report& r) {
+            if (m.m_size < 2 || m.m_size > TABLE_MAX_DEFINITION) {
+                r.error("table definition has an invalid size of %zu bytes", m.m_size);
+                return false;
+            }
+
+            // copy with room for a truncated column to be read in full
+            std::vector<char> buf(m.m_size + 256, 0);
+            memcpy(buf.data(), m.m_data, m.m_size);
+
+            if (!memchr(buf.data(), '\0', std::min<size_t>(m.m_size, 33))) {
+                r.error("table definition has no terminated name");
+                return false;
+            }
+
+            bitstream b((bitstream::word_t*)buf.data(), buf.size());
+
+            char l_name[33];
+            b.read_string(33, l_name);
+            if (name != l_name)
+                r.error("table definition names %s, expected %s", l_name, name.c_str());
+
+            const uint32_t size = table_header_read(b, &flags);
+
+            if (size == 0 || size > TABLE_MAX_COLUMNS) {
+                r.error("table definition has %u columns", size);
+                return false;
+            }
+
+            for (uint32_t i = 0; i < size; ++i) {
+                // type, name, comment flag
+                if (b.position() + 8 + 8 + 1 > m.m_size * 8) {
+                    r.error("table definition ends in column %u", i);
+                    return false;
+                }
+
+                col* c = col_read(b);
+                if (c->type() > col_bytes)
+                    r.error("column %s has unknown type %u", c->m_name, c->type());
+
+                cols.push_back(c);
+            }
+
+            if (b.position() > m.m_size * 8) {
+                r.error("table definition is truncated");
+                return false;
+            }
+
+            return true;
+        }
+
+        /** Verify the directory of a PAX block and decode it from a copy in scratch */
+        void inspect_pax(const std::vector<col*>& cols, uint8_t flags, const block* blk, uint32_t num, char* scratch,
+            arena& a, stats& s, block_stats& bs, report& r)
+        {
+            const uint32_t used = block_used(blk);
+            const pax_column* dir = pax_directory(blk);
+            std::vector<uint64_t> values;
+            uint64_t column_bits = 0;
+
+            if (cols.size() * sizeof(pax_column) > used) {
+                r.error("block %u: pax directory exceeds pos", num);
+                bs.m_valid = false;
+                return;
+            }
+
+            for (uint32_t i = 0; i < cols.size(); ++i) {
+                const uint32_t width = col_width(cols[i]->type());
+
+                if ((uint64_t)dir[i].m_values + dir[i].m_size > used) {
+                    r.error("block %u: pax column %s is out of bounds", num, cols[i]->m_name);
+                    bs.m_valid = false;
+                    return;
+                }
+
+                if (pax_fixed(cols[i]) && dir[i].m_codec >= column_codecs) {
+                    r.error("block %u: pax column %s has unknown codec %u", num, cols[i]->m_name, dir[i].m_codec);
+                    bs.m_valid = false;
+                    return;
+                }
+
+                uint32_t set;
+                if (!pax_presence_count(blk, i, set)) {
+                    r.error("block %u: pax column %s has a malformed presence map", num, cols[i]->m_name);
+                    bs.m_valid = false;
+                    return;
+                }
+
+                if (set != dir[i].m_count) {
+                    r.error("block %u: pax column %s has %u values for %u set rows", num, cols[i]->m_name,
+                        dir[i].m_count, set);
+                    bs.m_valid = false;
+                    return;
+                }
+
+                if (pax_fixed(cols[i])) {
+                    values.resize(set);
+                    if (!column_decoder(dir[i].m_codec, width)(blk->data + dir[i].m_values, dir[i].m_size, set,
+                        values.data()))
+                    {
+                        r.error("block %u: pax column %s has a malformed %s run", num, cols[i]->m_name,
+                            column_codec_name(dir[i].m_codec));
+                        bs.m_valid = false;
+                        return;
+                    }
+
+                    ++s.m_codecs[i * column_codecs + dir[i].m_codec];
+                }
+
+                s.m_set[i] += set;
+                s.m_bits[i] += (uint64_t)(dir[i].m_values - dir[i].m_present + dir[i].m_size) * 8;
+                column_bits += (uint64_t)(dir[i].m_values - dir[i].m_present + dir[i].m_size) * 8;
+            }
+
+            // decode from a copy, corrupt lengths run into the zeroed padding instead of the next block
+            memcpy(scratch, blk, sizeof(block));
+
+            const block* copy = reinterpret_cast<const block*>(scratch);
+            pax_reader reader(cols, flags, copy);
+
+            while (reader.next(&a)) {
+                ++bs.m_decoded;
+            }
+
+            a.reset();
+
+            s.m_mask_bits += (uint64_t)used * 8 - column_bits;
+            s.m_rows += bs.m_decoded;
+            s.m_used += used;
+        }
+
+        /** Decode a single block */
+        void inspect_block(const std::vector<col*>& cols, uint8_t flags, const block* blk, uint32_t num, char* scratch,
+            arena& a, stats& s, block_stats& bs, report& r)
+        {
+            bs.m_num = num;
+            bs.m_pos = block_used(blk);
+            bs.m_rows = blk->rows;
+            bs.m_decoded = 0;
+            bs.m_valid = true;
+            bs.m_pax = block_is_pax(blk);
+
+            if (bs.m_pos > BLOCK_DSIZE) {
+                r.error("block %u: pos %u exceeds block size", num, bs.m_pos);
+                bs.m_valid = false;
+                return;
+            }
+
+            if ((bs.m_pos == 0) != (blk->rows == 0)) {
+                r.error("block %u: %u rows in %u bytes", num, blk->rows, bs.m_pos);
+                bs.m_valid = false;
+            }
+
+            if (bs.m_pax) {
+                inspect_pax(cols, flags, blk, num, scratch, a, s, bs, r);
+                return;
+            }
+
+            // decode from a copy, corrupt lengths run into the zeroed padding instead of the next block
+            memcpy(scratch, blk->data, BLOCK_DSIZE);
+
+            bitstream b((bitstream::word_t*)scratch, BLOCK_DSIZE + INSPECT_PAD);
+            const uint32_t words = (cols.size() + 63) / 64;
+            const uint64_t valid = (cols.size() & 63) ? bits_until(cols.size() & 63) : ~0ull;
+            const uint32_t end = blk->pos * 8;
+            uint32_t bits[TABLE_MAX_COLUMNS];
+            block_codec codec(cols, flags);
+            const uint32_t min_row = flags & table_compact_masks ? 8 : 64 * words;
+
+            while (b.position() < end) {
+                const uint32_t start = b.position();
+                if (end - start < min_row) {
+                    r.error("block %u: partial row at byte %u", num, start / 8);
+                    bs.m_valid = false;
+                    break;
+                }
+
+                row* rw = row_read(cols, b, &a, bits, &codec);
+
+                if (rw->m_fields.words() > words || (rw->m_fields.word(words - 1) & ~valid)) {
+                    r.error("block %u: row %u sets unknown fields", num, bs.m_decoded);
+                    bs.m_valid = false;
+                    break;
+                }
+
+                if (b.position() > end) {
+                    r.error("block %u: row %u ends past pos at byte %u", num, bs.m_decoded, b.position() / 8);
+                    bs.m_valid = false;
+                    break;
+                }
+
+                uint32_t mask_bits = b.position() - start;
+                for (uint32_t i = 0; i < cols.size(); ++i) {
+                    if (rw->m_fields.at(i)) {
+                        s.m_set[i] += 1;
+                        s.m_bits[i] += bits[i];
+                        mask_bits -= bits[i];
+                    }
+                }
+
+                s.m_mask_bits += mask_bits;
+
+                for (auto &v : rw->m_data) {
+                    if (v.m_code != DICT_NONE && (v.m_code & ~DICT_ADDED) >= codec.dict().size(v.m_pos)) {
+                        r.error("block %u: row %u refers to unknown dictionary entry %u of %s",
+                            num, bs.m_decoded, v.m_code, cols[v.m_pos]->m_name);
+                        bs.m_valid = false;
+                    }
+                }
+
+                ++bs.m_decoded;
+            }
+
+            a.reset();
+
+            if (bs.m_valid && bs.m_decoded != blk->rows) {
+                r.error("block %u: header has %u rows, decoded %u", num, blk->rows, bs.m_decoded);
+                bs.m_valid = false;
+            }
+
+            s.m_rows += bs.m_decoded;
+            s.m_used += blk->pos;
+        }
+    }
+} /* deltadb */
+
+int main(int argc, char** argv) {
+    using namespace deltadb;
+
+    std::string path;
+    uint32_t threads;
+
+    po::options_description desc("deltadb_inspect options");
+    desc.add_options()
+        ("help,h", "Show this help")
+        ("table", po::value<std::string>(&path), "Table path without extension")
+        ("threads", po::value<uint32_t>(&threads)->default_value(std::thread::hardware_concurrency()), "Decoder threads")
+        ("blocks", "Print a line per block");
+
+    po::positional_options_description pos;
+    pos.add("table", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+        po::notify(vm);
+    } catch (po::error& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    if (vm.count("help") || path.empty()) {
+        std::cout << "Usage: deltadb_inspect [options] <path/to/table>" << std::endl << desc << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    threads = std::max<uint32_t>(threads, 1);
+
+    const size_t slash = path.rfind('/');
+    const std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    report r;
+    mapping tbl, blk;
+    if (!tbl.open(path+".tbl") || !blk.open(path+".blk"))
+        return 1;
+
+    std::vector<col*> cols;
+    uint8_t flags = 0;
+    if (!read_schema(tbl, name, cols, flags, r))
+        return 1;
+
+    // blocks without row counts are laid out differently, opening the table converts them
+    if (!(flags & table_row_counts)) {
+        r.error("table has blocks without row counts, open it once to convert it");
+        return 1;
+    }
+
+    // compressed tables index their blocks
+    std::vector<uint64_t> offsets;
+    mapping idx;
+
+    if (access((path+".idx").c_str(), F_OK) == 0) {
+        if (!idx.open(path+".idx"))
+            return 1;
+
+        if (idx.m_size % sizeof(uint64_t) != 0)
+            r.error("index size %zu is not a multiple of %zu, trailing bytes ignored", idx.m_size, sizeof(uint64_t));
+
+        offsets.resize(idx.m_size / sizeof(uint64_t));
+        memcpy(offsets.data(), idx.m_data, offsets.size() * sizeof(uint64_t));
+    } else {
+        if (blk.m_size % sizeof(block) != 0)
+            r.error("block file size %zu is not a multiple of %zu, trailing bytes ignored", blk.m_size, sizeof(block));
+
+        for (uint64_t i = 0; i < blk.m_size / sizeof(block); ++i) {
+            offsets.push_back(i * sizeof(block));
+        }
+    }
+
+    const uint32_t blocks = offsets.size();
+    std::atomic<uint32_t> compressed(0);
+    std::vector<block_stats> per_block(blocks);
+    stats total(cols.size());
+    std::atomic<uint32_t> next(0);
+    std::mutex lock;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < std::min(threads, std::max<uint32_t>(blocks, 1)); ++t) {
+        workers.push_back(std::thread([&]() {
+            std::vector<char> scratch(BLOCK_DSIZE + INSPECT_PAD, 0);
+            std::vector<uint64_t> buffer(sizeof(block) / sizeof(uint64_t) + 1);
+            stats s(cols.size());
+            arena a;
+
+            for (uint32_t i = next++; i < blocks; i = next++) {
+                bool lz = false;
+                const block* b = locate(blk, offsets[i], i + 1, reinterpret_cast<char*>(buffer.data()), lz, r);
+
+                if (!b) {
+                    per_block[i] = {i + 1, 0, 0, 0, false, false};
+                    continue;
+                }
+
+                compressed += lz;
+                inspect_block(cols, flags, b, i + 1, scratch.data(), a, s, per_block[i], r);
+            }
+
+            std::lock_guard<std::mutex> l(lock);
+            total.merge(s);
+        }));
+    }
+
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // table summary
+    uint64_t data_bits = 0;
+    for (auto b : total.m_bits) {
+        data_bits += b;
+    }
+
+    printf("table=%s\ncolumns=%zu\nmasks=%s\nlayout=%s\ncompression=%s\nblocks=%u\ncompressed_blocks=%u\nrows=%lu\n"
+        "file_bytes=%zu\nused_bytes=%lu\n",
+        name.c_str(), cols.size(), flags & table_compact_masks ? "compact" : "plain",
+        flags & table_pax ? "pax" : "rows", flags & table_compressed ? "lz" : "none", blocks, compressed.load(),
+        total.m_rows, blk.m_size, total.m_used
+    );
+
+    if (flags & table_pax) {
+        // the last block is still open and always in rows
+        uint32_t fallbacks = 0;
+        for (uint32_t i = 0; i + 1 < blocks; ++i) {
+            fallbacks += per_block[i].m_valid && !per_block[i].m_pax;
+        }
+
+        printf("pax_fallback_blocks=%u\n", fallbacks);
+    }
+
+    if (total.m_rows) {
+        printf("avg_row_bytes=%.2f\nmask_bytes=%lu\nfield_bytes=%lu\n",
+            (double)total.m_used / total.m_rows, total.m_mask_bits / 8, data_bits / 8
+        );
+    }
+
+    if (blocks) {
+        printf("avg_fill=%.2f%%\nsealed_fill=%.2f%%\n",
+            100.0 * total.m_used / ((double)blocks * BLOCK_DSIZE),
+            blocks > 1 ? 100.0 * (total.m_used - per_block.back().m_pos) / ((double)(blocks - 1) * BLOCK_DSIZE) : 0.0
+        );
+    }
+
+    printf("decode_seconds=%.3f\ndecode_rows_per_sec=%.0f\nthreads=%zu\n\n",
+        secs, total.m_rows / secs, workers.size()
+    );
+
+    // per column
+    printf("%-32s %-7s %12s %8s %14s %9s %7s %s\n", "column", "type", "set", "change%", "bytes", "bytes/set", "share%",
+        "codecs");
+    for (uint32_t i = 0; i < cols.size(); ++i) {
+        const uint64_t bytes = total.m_bits[i] / 8;
+
+        // blocks per codec of PAX blocks, e.g. raw:2,delta:30
+        std::string codecs;
+        for (uint8_t c = 0; c < column_codecs; ++c) {
+            const uint32_t n = total.m_codecs[i * column_codecs + c];
+            if (n)
+                codecs += (codecs.empty() ? "" : ",") + std::string(column_codec_name(c)) + ":" + std::to_string(n);
+        }
+
+        printf("%-32s %-7s %12lu %8.3f %14lu %9.2f %7.2f %s\n",
+            cols[i]->m_name, type_name(cols[i]), total.m_set[i],
+            total.m_rows ? 100.0 * total.m_set[i] / total.m_rows : 0.0,
+            bytes, total.m_set[i] ? (double)bytes / total.m_set[i] : 0.0,
+            total.m_used ? 100.0 * bytes / total.m_used : 0.0, codecs.empty() ? "-" : codecs.c_str()
+        );
+    }
+
+    // per block
+    if (vm.count("blocks")) {
+        printf("\n%8s %8s %8s %7s %9s %6s %s\n", "block", "rows", "pos", "fill%", "row_bytes", "layout", "status");
+
+        for (auto &b : per_block) {
+            printf("%8u %8u %8u %7.2f %9.2f %6s %s\n",
+                b.m_num, b.m_rows, b.m_pos, 100.0 * b.m_pos / BLOCK_DSIZE,
+                b.m_decoded ? (double)b.m_pos / b.m_decoded : 0.0, b.m_pax ? "pax" : "rows", b.m_valid ? "ok" : "invalid"
+            );
+        }
+    }
+
+    for (auto c : cols) {
+        delete c;
+    }
+
+    if (r.errors()) {
+        fprintf(stderr, "%u problems found\n", r.errors());
+        return 1;
+    }
+
+    return 0;
+}
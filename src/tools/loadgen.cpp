@@ -0,0 +1,717 @@
+/**
+ * @file loadgen.cpp
+ * @author Robin Dietrich <me (at) invokr (dot) org>
+ *
+ * @par License
+ *   This file is part of deltadb.
+ *
+ *   Foobar is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Foobar is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * End-to-end load generator.
+ *
+ * Creates a table, ingests delta rows from several threads and then scans or point reads
+ * the result. Rows only carry the fields that changed, with the share of changing fields
+ * set by --change. Ingest goes through a single locked database (--shards 0) or through
+ * the shard pool.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "../db/block.hpp"
+#include "../db/block_codec.hpp"
+#include "../db/block_pax.hpp"
+#include "../db/block_pool.hpp"
+#include "../db/database.hpp"
+#include "../db/metrics.hpp"
+#include "../db/profile.hpp"
+#include "../db/shard.hpp"
+#include "../db/table.hpp"
+#include "../db/table_col.hpp"
+#include "../db/table_row.hpp"
+#include "../internal/arena.hpp"
+
+namespace po = boost::program_options;
+
+namespace deltadb {
+    namespace {
+        typedef std::chrono::steady_clock clock;
+
+        /** Load profile */
+        struct profile {
+            /** Data directory */
+            std::string m_dir;
+            /** Number of writer threads */
+            uint32_t m_threads;
+            /** Number of shards, 0 uses a single locked database */
+            uint32_t m_shards;
+            /** Rows per thread */
+            uint64_t m_rows;
+            /** Number of columns */
+            uint32_t m_columns;
+            /** Column types, repeated to fill m_columns */
+            std::vector<uint8_t> m_types;
+            /** Share of fields changing per row */
+            double m_change;
+            /** Value distribution: uniform, sequential or skewed */
+            std::string m_dist;
+            /** String length */
+            uint32_t m_string_size;
+            /** Distinct strings */
+            uint32_t m_string_count;
+            /** Length of blob values */
+            uint32_t m_blob_size;
+            /** Rows per burst, 0 disables bursts */
+            uint32_t m_burst;
+            /** Pause between bursts in microseconds */
+            uint32_t m_pause;
+            /** Number of entities rows are keyed by */
+            uint64_t m_keys;
+            /** Read phase: scan, column, range, point or none */
+            std::string m_read;
+            /** Upper bound of the range read, counts values of the first column in [0, m_range] */
+            uint64_t m_range;
+            /** Number of point reads */
+            uint64_t m_points;
+            /** Print a per stage breakdown of the read phase */
+            bool m_profile;
+            /** Table flags of the created table */
+            uint8_t m_flags;
+        };
+
+        /** Removes a temporary data directory when going out of scope */
+        struct scratch_dir {
+            /** Directory, nothing is removed if empty */
+            std::string m_path;
+
+            ~scratch_dir() {
+                if (m_path.empty())
+                    return;
+
+                boost::system::error_code ec;
+                boost::filesystem::remove_all(m_path, ec);
+                if (ec)
+                    fprintf(stderr, "Unable to remove %s: %s\n", m_path.c_str(), ec.message().c_str());
+            }
+        };
+
+        /** xorshift64 */
+        struct rng {
+            uint64_t m_state;
+
+            rng(uint64_t seed) : m_state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+            uint64_t next() {
+                m_state ^= m_state << 13;
+                m_state ^= m_state >> 7;
+                m_state ^= m_state << 17;
+                return m_state;
+            }
+
+            /** Uniform double in [0, 1) */
+            double unit() {
+                return (next() >> 11) * (1.0 / 9007199254740992.0);
+            }
+        };
+
+        /** Latency samples in nanoseconds */
+        typedef std::vector<uint32_t> samples;
+
+        /** Print percentiles of samples */
+        void report_latency(const char* name, samples& s) {
+            if (s.empty())
+                return;
+
+            std::sort(s.begin(), s.end());
+            auto pct = [&](double p) {
+                return s[std::min<size_t>(s.size() - 1, s.size() * p)];
+            };
+
+            printf("%s_p50_ns=%u\n%s_p99_ns=%u\n%s_p999_ns=%u\n%s_max_ns=%u\n",
+                name, pct(0.5), name, pct(0.99), name, pct(0.999), name, s.back()
+            );
+        }
+
+        /** Print resident set size */
+        void report_rss(const char* name) {
+            long pages = 0, resident = 0;
+            FILE* fp = fopen("/proc/self/statm", "r");
+            if (fp) {
+                if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+                    resident = 0;
+
+                fclose(fp);
+            }
+
+            struct rusage ru;
+            getrusage(RUSAGE_SELF, &ru);
+
+            printf("%s_rss_kb=%ld\n%s_peak_rss_kb=%ld\n",
+                name, resident * (sysconf(_SC_PAGESIZE) / 1024), name, ru.ru_maxrss
+            );
+        }
+
+        /** Parse type list */
+        bool parse_types(const std::string& list, std::vector<uint8_t>& out) {
+            static const char* names[] = {
+                "int8", "int16", "int32", "int64", "bool", "float", "double", "string", "bytes"
+            };
+
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos)
+                    end = list.size();
+
+                std::string t = list.substr(start, end - start);
+                if (t == "dict" || t == "xfloat" || t == "xdouble" || t == "blob") {
+                    out.push_back((t == "dict" ? col_string : t == "xfloat" ? col_float : t == "xdouble" ? col_double
+                        : col_bytes) | col_encoded);
+                    start = end + 1;
+                    continue;
+                }
+
+                auto it = std::find_if(std::begin(names), std::end(names), [&](const char* n) {
+                    return t == n;
+                });
+
+                if (it == std::end(names)) {
+                    fprintf(stderr, "Unknown column type %s\n", t.c_str());
+                    return false;
+                }
+
+                out.push_back(it - std::begin(names));
+                start = end + 1;
+            }
+
+            return !out.empty();
+        }
+
+        /** Generates delta rows for one writer */
+        class generator {
+        public:
+            generator(const profile& p, const std::vector<col*>& cols, uint32_t id, const std::vector<std::string>& strings)
+                : m_p(p), m_cols(cols), m_rng(id + 1), m_strings(strings), m_seq(0) {}
+
+            /** Build next row, every field is set for the first row */
+            row* next() {
+                row* r = new row();
+
+                for (uint32_t i = 0; i < m_cols.size(); ++i) {
+                    if (m_seq != 0 && m_rng.unit() >= m_p.m_change)
+                        continue;
+
+                    r->set(i, value(m_cols[i]));
+                }
+
+                // at least one field changes
+                if (!r->m_fields.any()) {
+                    const uint32_t i = m_rng.next() % m_cols.size();
+                    r->set(i, value(m_cols[i]));
+                }
+
+                ++m_seq;
+                return r;
+            }
+
+            /** Next entity key */
+            uint64_t key() {
+                return m_rng.next() % m_p.m_keys;
+            }
+        private:
+            const profile& m_p;
+            const std::vector<col*>& m_cols;
+            rng m_rng;
+            const std::vector<std::string>& m_strings;
+            uint64_t m_seq;
+
+            /** Draw a raw value from the distribution */
+            uint64_t draw() {
+                if (m_p.m_dist == "sequential")
+                    return m_seq;
+
+                if (m_p.m_dist == "skewed") {
+                    // most draws hit a few small values
+                    const double u = m_rng.unit();
+                    return (uint64_t)(u * u * u * 1000);
+                }
+
+                return m_rng.next();
+            }
+
+            row_value value(col* c) {
+                const uint8_t type = c->type();
+
+                row_value v;
+                v.m_type = type;
+                v.m_size = 0;
+                v.m_value.v_u64 = draw();
+
+                switch (type) {
+                case col_bool:
+                    v.m_value.v_bool = v.m_value.v_u64 & 1;
+                    break;
+                case col_float:
+                    v.m_value.v_float = (v.m_value.v_u64 % 1000000) / 100.0f;
+                    break;
+                case col_double:
+                    v.m_value.v_double = (v.m_value.v_u64 % 1000000) / 100.0;
+                    break;
+                case col_bytes:
+                    if (col_is_blob(c)) {
+                        // windows into the buffer at the end of the pool
+                        const std::string& s = m_strings.back();
+                        v.m_value.v_bytes = const_cast<char*>(s.c_str()) + v.m_value.v_u64 % (s.size() - m_p.m_blob_size + 1);
+                        v.m_size = m_p.m_blob_size;
+                        break;
+                    }
+                    /* fallthrough */
+                case col_string: {
+                    const std::string& s = m_strings[v.m_value.v_u64 % (m_strings.size() - 1)];
+                    v.m_value.v_bytes = const_cast<char*>(s.c_str());
+                    v.m_size = s.size();
+                } break;
+                }
+
+                return v;
+            }
+        };
+
+        /** Ingest phase, returns number of rows written */
+        uint64_t ingest(const profile& p, std::vector<col*>& cols, const std::vector<std::string>& strings,
+            samples& latency)
+        {
+            database* db = nullptr;
+            shard_pool* pool = nullptr;
+            std::mutex lock;
+
+            if (p.m_shards == 0) {
+                db = new database();
+                if (!db->open(p.m_dir.c_str()))
+                    return 0;
+
+                db->create("lg", cols.data(), cols.size(), p.m_flags);
+            } else {
+                pool = new shard_pool(p.m_shards, p.m_threads);
+                if (!pool->open(p.m_dir.c_str()))
+                    return 0;
+
+                pool->create(0, "lg", cols.data(), cols.size(), p.m_flags);
+                pool->sync(0);
+            }
+
+            std::vector<samples> per_thread(p.m_threads);
+            std::vector<std::thread> threads;
+
+            auto start = clock::now();
+            for (uint32_t t = 0; t < p.m_threads; ++t) {
+                threads.push_back(std::thread([&, t]() {
+                    generator gen(p, cols, t, strings);
+                    samples& lat = per_thread[t];
+                    lat.reserve(p.m_rows);
+
+                    for (uint64_t i = 0; i < p.m_rows; ++i) {
+                        if (p.m_burst && i && (i % p.m_burst) == 0)
+                            std::this_thread::sleep_for(std::chrono::microseconds(p.m_pause));
+
+                        row* r = gen.next();
+                        const uint64_t key = gen.key();
+
+                        auto t0 = clock::now();
+                        if (db) {
+                            std::lock_guard<std::mutex> l(lock);
+                            db->write_row("lg", r);
+                        } else {
+                            pool->write_row(t, "lg", key, r);
+                        }
+                        auto t1 = clock::now();
+
+                        if (db)
+                            delete r;
+
+                        lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+                    }
+
+                    if (pool)
+                        pool->sync(t);
+                }));
+            }
+
+            for (auto &t : threads) {
+                t.join();
+            }
+
+            delete db;
+            delete pool;
+
+            const double secs = std::chrono::duration<double>(clock::now() - start).count();
+            const uint64_t rows = p.m_rows * p.m_threads;
+            printf("ingest_rows=%lu\ningest_seconds=%.3f\ningest_rows_per_sec=%.0f\n", rows, secs, rows / secs);
+
+            for (auto &s : per_thread) {
+                latency.insert(latency.end(), s.begin(), s.end());
+            }
+
+            return rows;
+        }
+
+        /** Names of the written table partitions */
+        std::vector<std::string> partitions(const profile& p) {
+            std::vector<std::string> ret;
+
+            if (p.m_shards == 0) {
+                ret.push_back("lg");
+            } else {
+                for (uint32_t i = 0; i < p.m_shards; ++i) {
+                    ret.push_back("lg."+std::to_string(i));
+                }
+            }
+
+            return ret;
+        }
+
+        /** Report on disk footprint */
+        void report_disk(const profile& p, uint64_t rows) {
+            uint64_t file = 0;
+            uint64_t used = 0;
+
+            for (auto &name : partitions(p)) {
+                const std::string blk = name+".blk";
+
+                struct stat st;
+                if (stat(blk.c_str(), &st) == 0)
+                    file += st.st_size;
+
+                if (stat((name+".idx").c_str(), &st) == 0)
+                    file += st.st_size;
+
+                if (stat((name+".blob").c_str(), &st) == 0)
+                    file += st.st_size;
+
+                const uint32_t blocks = block_num(blk.c_str());
+                for (uint32_t i = 1; i <= blocks; ++i) {
+                    block_header h;
+                    if (block_read_header(blk.c_str(), i, &h))
+                        used += block_used(&h);
+                }
+            }
+
+            printf("disk_bytes=%lu\ndisk_bytes_per_row=%.2f\ndata_bytes_per_row=%.2f\n",
+                file, (double)file / rows, (double)used / rows
+            );
+        }
+
+        /** Read phase */
+        void read(const profile& p) {
+            const std::vector<std::string> names = partitions(p);
+            std::vector<table*> tables;
+            query_profile qp;
+            query_profile* prof = p.m_profile ? &qp : nullptr;
+
+            // opening a table reads its blocks
+            {
+                query_timer timer(prof, stage_io);
+                for (auto &name : names) {
+                    tables.push_back(new table(name));
+                }
+            }
+
+            if (p.m_read == "scan") {
+                arena a;
+                uint64_t rows = 0;
+                uint64_t matches = 0;
+                uint64_t fields = 0;
+
+                // count rows touching the first column, sum changed fields
+                auto start = clock::now();
+                for (auto t : tables) {
+                    t->scan([&](row* r) {
+                        ++rows;
+                        bool match;
+                        {
+                            query_timer timer(prof, stage_filter);
+                            match = r->has(0);
+                        }
+
+                        query_timer timer(prof, stage_aggregate);
+                        matches += match;
+                        fields += r->m_data.size();
+                    }, a, prof);
+                }
+
+                const double secs = std::chrono::duration<double>(clock::now() - start).count();
+                printf("scan_rows=%lu\nscan_matches=%lu\nscan_fields=%lu\nscan_seconds=%.3f\nscan_rows_per_sec=%.0f\n",
+                    rows, matches, fields, secs, rows / secs
+                );
+            } else if (p.m_read == "column") {
+                arena a;
+                uint64_t values = 0;
+                uint64_t sum = 0;
+
+                // sum the raw bits of the values set in the first column, strings only count
+                auto start = clock::now();
+                for (auto t : tables) {
+                    t->scan_column(0, [&](const row_value& v) {
+                        uint64_t bits = 0;
+                        memcpy(&bits, &v.m_value, col_width(v.m_type));
+
+                        ++values;
+                        sum += bits;
+                    }, a);
+                }
+
+                const double secs = std::chrono::duration<double>(clock::now() - start).count();
+                printf("column_values=%lu\ncolumn_sum=%lu\ncolumn_seconds=%.3f\ncolumn_values_per_sec=%.0f\n",
+                    values, sum, secs, values / secs
+                );
+            } else if (p.m_read == "range") {
+                arena a;
+                uint64_t matches = 0;
+                uint64_t rows = 0;
+
+                // count values of the first column in [0, m_range]
+                auto start = clock::now();
+                for (auto t : tables) {
+                    matches += t->count_column(0, 0, p.m_range, a);
+
+                    for (auto b : t->blocks()) {
+                        rows += b->rows;
+                    }
+                }
+
+                const double secs = std::chrono::duration<double>(clock::now() - start).count();
+                printf("range_matches=%lu\nrange_seconds=%.3f\nrange_rows_per_sec=%.0f\n",
+                    matches, secs, rows / secs
+                );
+            } else if (p.m_read == "point") {
+                // read a random row: load its block and decode up to it
+                rng r(42);
+                arena a;
+                samples latency;
+                latency.reserve(p.m_points);
+
+                std::vector<row_plan> plans;
+                for (auto t : tables) {
+                    plans.emplace_back(t->columns());
+                }
+
+                for (uint64_t i = 0; i < p.m_points; ++i) {
+                    const uint32_t idx = r.next() % tables.size();
+                    table* t = tables[idx];
+                    const std::string blk = names[idx]+".blk";
+                    const uint32_t blocks = block_num(blk.c_str());
+                    if (blocks == 0)
+                        continue;
+
+                    auto t0 = clock::now();
+                    block* b;
+                    {
+                        query_timer timer(prof, stage_io);
+                        b = block_read(blk.c_str(), (r.next() % blocks) + 1);
+                    }
+
+                    if (b->rows && block_is_pax(b)) {
+                        query_timer timer(prof, stage_decode);
+                        const uint32_t target = r.next() % b->rows;
+                        pax_reader reader(t->columns(), t->flags(), b);
+
+                        for (uint32_t j = 0; j <= target; ++j) {
+                            reader.next(&a);
+                        }
+
+                        qp.m_rows += target + 1;
+                    } else if (b->rows) {
+                        query_timer timer(prof, stage_decode);
+                        const uint32_t target = r.next() % b->rows;
+                        bitstream bs((bitstream::word_t*)b->data, BLOCK_DSIZE);
+                        block_codec codec(t->columns(), t->flags());
+
+                        for (uint32_t j = 0; j <= target; ++j) {
+                            row_read(plans[idx], bs, &a, &codec);
+                        }
+
+                        qp.m_rows += target + 1;
+                    }
+
+                    qp.m_blocks += 1;
+                    qp.m_bytes += sizeof(block);
+                    block_free(b);
+                    a.reset();
+                    auto t1 = clock::now();
+
+                    latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+                }
+
+                report_latency("point", latency);
+            }
+
+            if (prof)
+                prof->print(stdout);
+
+            for (auto t : tables) {
+                delete t;
+            }
+        }
+    }
+} /* deltadb */
+
+int main(int argc, char** argv) {
+    using namespace deltadb;
+
+    profile p;
+    std::string types;
+
+    po::options_description desc("deltadb_loadgen options");
+    desc.add_options()
+        ("help,h", "Show this help")
+        ("dir", po::value<std::string>(&p.m_dir)->default_value(""), "Empty data directory, defaults to a temporary one removed when done")
+        ("keep", "Keep the temporary data directory")
+        ("threads", po::value<uint32_t>(&p.m_threads)->default_value(4), "Writer threads")
+        ("shards", po::value<uint32_t>(&p.m_shards)->default_value(4), "Shards, 0 for a single locked database")
+        ("rows", po::value<uint64_t>(&p.m_rows)->default_value(250000), "Rows per writer thread")
+        ("columns", po::value<uint32_t>(&p.m_columns)->default_value(16), "Columns, at most 512")
+        ("types", po::value<std::string>(&types)->default_value("int32,int64,double,string"), "Column types, repeated, dict, xfloat and xdouble are encoded per block, blob bytes go to the blob file")
+        ("change", po::value<double>(&p.m_change)->default_value(0.05), "Share of fields changing per row")
+        ("dist", po::value<std::string>(&p.m_dist)->default_value("uniform"), "Values: uniform, sequential or skewed")
+        ("string-size", po::value<uint32_t>(&p.m_string_size)->default_value(12), "String and bytes length")
+        ("string-count", po::value<uint32_t>(&p.m_string_count)->default_value(64), "Distinct strings")
+        ("blob-size", po::value<uint32_t>(&p.m_blob_size)->default_value(4096), "Length of blob values")
+        ("burst", po::value<uint32_t>(&p.m_burst)->default_value(0), "Rows per burst, 0 writes continuously")
+        ("pause", po::value<uint32_t>(&p.m_pause)->default_value(1000), "Pause between bursts in microseconds")
+        ("keys", po::value<uint64_t>(&p.m_keys)->default_value(1024), "Entity keys rows are routed by")
+        ("read", po::value<std::string>(&p.m_read)->default_value("scan"), "Read phase: scan, column, range, point or none")
+        ("range", po::value<uint64_t>(&p.m_range)->default_value(99), "Upper bound of --read range, from 0")
+        ("points", po::value<uint64_t>(&p.m_points)->default_value(10000), "Point reads")
+        ("profile", "Print a per stage breakdown of the read phase")
+        ("pax", "Store sealed blocks column by column")
+        ("compress", "Store sealed blocks compressed")
+        ("metrics", "Dump the metrics registry when done");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (po::error& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    p.m_profile = vm.count("profile");
+    p.m_flags = table_compact_masks | (vm.count("pax") ? table_pax : 0) | (vm.count("compress") ? table_compressed : 0);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    if (!parse_types(types, p.m_types) || p.m_columns == 0 || p.m_columns > TABLE_MAX_COLUMNS || p.m_threads == 0 || p.m_keys == 0) {
+        std::cerr << desc << std::endl;
+        return 1;
+    }
+
+    if (p.m_read == "range" && (p.m_types[0] & 15) > col_int64) {
+        fprintf(stderr, "--read range needs an integer first column\n");
+        return 1;
+    }
+
+    p.m_string_size = std::min<uint32_t>(std::max<uint32_t>(p.m_string_size, 1), 255);
+    p.m_string_count = std::max<uint32_t>(p.m_string_count, 1);
+    p.m_blob_size = std::min<uint32_t>(std::max<uint32_t>(p.m_blob_size, 1), 0xFFFF);
+
+    scratch_dir scratch;
+    if (p.m_dir.empty()) {
+        char dir[] = "/tmp/deltadb_loadgen.XXXXXX";
+        if (!mkdtemp(dir)) {
+            perror("Unable to create data directory");
+            return 1;
+        }
+
+        p.m_dir = dir;
+        if (!vm.count("keep"))
+            scratch.m_path = dir;
+    }
+
+    // schema
+    std::vector<col*> cols;
+    for (uint32_t i = 0; i < p.m_columns; ++i) {
+        col* c = new col();
+        c->m_data = p.m_types[i % p.m_types.size()];
+        snprintf(c->m_name, sizeof(c->m_name), "c%u", i);
+        c->m_comment[0] = '\0';
+        cols.push_back(c);
+    }
+
+    // string pool, rows point into it
+    std::vector<std::string> strings;
+    rng r(7);
+    for (uint32_t i = 0; i < p.m_string_count; ++i) {
+        std::string s(p.m_string_size, 'a');
+        for (auto &ch : s) {
+            ch = 'a' + r.next() % 26;
+        }
+
+        strings.push_back(s);
+    }
+
+    // the last entry is the buffer blob values are cut from
+    std::string blob(p.m_blob_size + 4096, 'a');
+    for (auto &ch : blob) {
+        ch = r.next();
+    }
+
+    strings.push_back(blob);
+
+    printf("dir=%s\n", p.m_dir.c_str());
+
+    samples latency;
+    const uint64_t rows = ingest(p, cols, strings, latency);
+    if (rows == 0)
+        return 1;
+
+    report_latency("write", latency);
+    report_rss("ingest");
+    report_disk(p, rows);
+
+    read(p);
+    report_rss("read");
+
+    auto pool = block_pool_occupancy();
+    printf("block_pool_slabs=%lu\nblock_pool_used=%lu\n", pool.m_slabs, pool.m_used);
+
+    if (vm.count("metrics")) {
+        metrics_snapshot s;
+        metrics_collect(s);
+        metrics_dump(stdout, s);
+    }
+
+    return 0;
+}